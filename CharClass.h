@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+// Classes of the ASCII characters the editor treats specially, a single lookup in a table built at compile time.
+// Characters outside ASCII are in no class, each character type only differs in how it indexes the table.
+namespace CharClass
+{
+    enum Class : uint8_t
+    {
+        Space = 0x01,
+        WordBreak = 0x02,   // Ends a word for word movement, as does a space
+        Control = 0x04,     // Shown as ^A to ^Z, two cells
+        Printable = 0x08,   // Always one cell
+    };
+
+    struct Table
+    {
+        uint8_t classes[128];
+    };
+
+    constexpr Table MakeTable()
+    {
+        Table t = {};
+        for (int c = 1; c <= 26; ++c)
+            if (c != '\r' && c != '\n')
+                t.classes[c] |= Control;
+        for (int c = ' '; c < 0x7F; ++c)
+            t.classes[c] |= Printable;
+        t.classes[' '] |= Space;
+        for (const char* s = "/\\=[]{}()"; *s != '\0'; ++s)
+            t.classes[uint8_t(*s)] |= WordBreak;
+        return t;
+    }
+
+    inline constexpr Table g_table = MakeTable();
+
+    template <class C>
+    struct Traits;
+
+    template <>
+    struct Traits<char>
+    {
+        static constexpr uint8_t Get(const char c) { return uint8_t(c) < 0x80 ? g_table.classes[uint8_t(c)] : 0; }
+    };
+
+    template <>
+    struct Traits<wchar_t>
+    {
+        static constexpr uint8_t Get(const wchar_t c) { return uint16_t(c) < 0x80 ? g_table.classes[uint16_t(c)] : 0; }
+    };
+
+    template <class C>
+    constexpr bool Is(const C c, const Class cls) { return (Traits<C>::Get(c) & cls) != 0; }
+
+    static_assert(Is('/', WordBreak) && Is(L' ', Space) && Is('\t', Control) && !Is(L'\n', Control), "CharClass table");
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Names sorted for case insensitive prefix lookups.
+// Case is only folded for ASCII, as file names in PATH are compared by the shell.
+template <class C>
+class CommandNames
+{
+public:
+    typedef std::basic_string<C> string;
+
+    size_t size() const { return m_names.size(); }
+    const string& operator[](const size_t i) const { return m_names[i]; }
+
+    void clear() { m_names.clear(); }
+
+    void Add(const C* name, const size_t length)
+    {
+        m_names.emplace_back(name, length);
+    }
+
+    // Call after adding, before finding, of names that only differ in case the first added is kept
+    void Sort()
+    {
+        std::stable_sort(m_names.begin(), m_names.end(), [](const string& a, const string& b) { return Compare(a.data(), a.length(), b.data(), b.length()) < 0; });
+        m_names.erase(std::unique(m_names.begin(), m_names.end(), [](const string& a, const string& b) { return Compare(a.data(), a.length(), b.data(), b.length()) == 0; }), m_names.end());
+    }
+
+    // Returns the range of names starting with prefix
+    std::pair<size_t, size_t> Find(const C* prefix, const size_t length) const
+    {
+        const auto begin = std::lower_bound(m_names.begin(), m_names.end(), prefix, [length](const string& name, const C* p)
+            { return Compare(name.data(), std::min(name.length(), length), p, length) < 0; });
+        const auto end = std::upper_bound(begin, m_names.end(), prefix, [length](const C* p, const string& name)
+            { return Compare(p, length, name.data(), std::min(name.length(), length)) < 0; });
+        return std::make_pair(size_t(begin - m_names.begin()), size_t(end - m_names.begin()));
+    }
+
+    static C Fold(const C c)
+    {
+        return c >= C('A') && c <= C('Z') ? C(c - C('A') + C('a')) : c;
+    }
+
+    static int Compare(const C* a, const size_t alength, const C* b, const size_t blength)
+    {
+        const size_t length = std::min(alength, blength);
+        for (size_t i = 0; i < length; ++i)
+        {
+            const C fa = Fold(a[i]);
+            const C fb = Fold(b[i]);
+            if (fa != fb)
+                return fa < fb ? -1 : 1;
+        }
+        return alength == blength ? 0 : alength < blength ? -1 : 1;
+    }
+
+private:
+    std::vector<string> m_names;
+};
+
+// Executable names in a list of directories, for completing the command word.
+// Each directory is kept with its modified time so a refresh only lists the directories that changed,
+// and can be saved and loaded so the listing survives between processes.
+// The file system is only reached through the callables given to Refresh, so it can be run against a fake tree.
+template <class C>
+class CommandIndex
+{
+public:
+    typedef std::basic_string<C> string;
+
+    // gettime(const string& dir, uint64_t* pTime) returns false if dir doesn't exist
+    // list(const string& dir, std::vector<string>& files) returns false if dir can't be read
+    // exts are the executable extensions including the dot, as in PATHEXT
+    // Returns whether the names have changed
+    template <class FTime, class FList>
+    bool Refresh(const std::vector<string>& dirs, const std::vector<string>& exts, FTime gettime, FList list)
+    {
+        std::vector<Directory> refreshed;
+        std::vector<string> files;
+        bool changed = false;
+        for (const string& dir : dirs)
+        {
+            uint64_t time = 0;
+            if (FindDirectory(refreshed, dir) != nullptr || !gettime(dir, &time))
+                continue;
+
+            Directory* cached = FindDirectory(m_dirs, dir);
+            if (cached != nullptr && cached->time == time)
+            {
+                if (size_t(cached - m_dirs.data()) != refreshed.size())
+                    changed = true;     // Order changed
+                refreshed.push_back(std::move(*cached));
+                cached->path.clear();
+                continue;
+            }
+
+            Directory d;
+            d.path = dir;
+            d.time = time;
+            files.clear();
+            if (list(dir, files))
+            {
+                for (const string& f : files)
+                    if (HasExtension(f, exts))
+                        d.names.push_back(f);
+            }
+            refreshed.push_back(std::move(d));
+            changed = true;
+        }
+
+        if (refreshed.size() != m_dirs.size())
+            changed = true;
+        m_dirs.swap(refreshed);
+        return changed;
+    }
+
+    void GetNames(CommandNames<C>& names) const
+    {
+        for (const Directory& d : m_dirs)
+            for (const string& n : d.names)
+                names.Add(n.data(), n.length());
+        names.Sort();
+    }
+
+    void Save(std::vector<uint8_t>& out) const
+    {
+        out.clear();
+        Put(out, Magic);
+        Put(out, Version);
+        Put(out, uint32_t(sizeof(C)));
+        Put(out, uint32_t(m_dirs.size()));
+        for (const Directory& d : m_dirs)
+        {
+            Put(out, d.path);
+            Put(out, d.time);
+            Put(out, uint32_t(d.names.size()));
+            for (const string& n : d.names)
+                Put(out, n);
+        }
+    }
+
+    // Returns false, leaving the index empty, if the data isn't a complete index from Save
+    bool Load(const uint8_t* p, const size_t size)
+    {
+        m_dirs.clear();
+        Reader r = { p, p + size };
+        uint32_t magic = 0, version = 0, charsize = 0, count = 0;
+        if (!r.Get(&magic) || magic != Magic || !r.Get(&version) || version != Version
+            || !r.Get(&charsize) || charsize != sizeof(C) || !r.Get(&count))
+            return false;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            Directory d;
+            uint32_t names = 0;
+            // Each name takes at least its length, so a count the data can't hold is rejected before resizing
+            if (!r.Get(&d.path) || !r.Get(&d.time) || !r.Get(&names) || r.Remaining() / sizeof(uint32_t) < names)
+            {
+                m_dirs.clear();
+                return false;
+            }
+            d.names.resize(names);
+            for (string& n : d.names)
+                if (!r.Get(&n))
+                {
+                    m_dirs.clear();
+                    return false;
+                }
+            m_dirs.push_back(std::move(d));
+        }
+        return true;
+    }
+
+private:
+    static const uint32_t Magic = 0x444D4352;  // RCMD
+    static const uint32_t Version = 1;
+
+    struct Directory
+    {
+        string path;
+        uint64_t time;
+        std::vector<string> names;
+    };
+
+    struct Reader
+    {
+        const uint8_t* p;
+        const uint8_t* end;
+
+        size_t Remaining() const { return size_t(end - p); }
+
+        template <class T>
+        bool Get(T* v)
+        {
+            if (Remaining() < sizeof(T))
+                return false;
+            memcpy(v, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+
+        bool Get(string* s)
+        {
+            uint32_t length = 0;
+            if (!Get(&length) || (Remaining() / sizeof(C)) < length)
+                return false;
+            s->resize(length);
+            if (length > 0)
+                memcpy(&(*s)[0], p, length * sizeof(C));
+            p += length * sizeof(C);
+            return true;
+        }
+    };
+
+    template <class T>
+    static void Put(std::vector<uint8_t>& out, const T v)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+        out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    static void Put(std::vector<uint8_t>& out, const string& s)
+    {
+        Put(out, uint32_t(s.length()));
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(s.data());
+        out.insert(out.end(), p, p + s.length() * sizeof(C));
+    }
+
+    static Directory* FindDirectory(std::vector<Directory>& dirs, const string& path)
+    {
+        for (Directory& d : dirs)
+            if (CommandNames<C>::Compare(d.path.data(), d.path.length(), path.data(), path.length()) == 0)
+                return &d;
+        return nullptr;
+    }
+
+    static bool HasExtension(const string& name, const std::vector<string>& exts)
+    {
+        for (const string& ext : exts)
+            if (name.length() > ext.length()
+                && CommandNames<C>::Compare(name.data() + name.length() - ext.length(), ext.length(), ext.data(), ext.length()) == 0)
+                return true;
+        return false;
+    }
+
+    std::vector<Directory> m_dirs;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Run count, last use and a frecency ranking for each distinct command.
+// Each run adds 2^((time - origin) / halflife) to the score of the command, so older runs count for less.
+// Because every score decays at the same rate the order only changes for the command that was run,
+// so an update is a single O(log n) reposition in the ranking.
+// Scores are kept as log2 so they don't overflow however long the history runs.
+template <class C>
+class FrecencyRank
+{
+public:
+    typedef uint32_t Id;
+    typedef std::pair<double, Id> Key;
+    typedef std::pmr::basic_string<C> string;
+    typedef std::pmr::set<Key, std::greater<Key>> Ranking;
+    typedef typename Ranking::const_iterator const_iterator;
+
+    struct Stats
+    {
+        uint32_t count;
+        int64_t last;       // Time of the last run
+        double score;       // log2 of the decayed run count
+    };
+
+    explicit FrecencyRank(std::pmr::memory_resource* resource = std::pmr::get_default_resource(), const double halflife = 3 * 24 * 60 * 60)
+        : m_halflife(halflife), m_origin(0), m_started(false), m_ids(resource), m_entries(resource), m_ranking(resource)
+    {
+    }
+
+    size_t size() const { return m_entries.size(); }
+
+    // Highest ranked first
+    const_iterator begin() const { return m_ranking.begin(); }
+    const_iterator end() const { return m_ranking.end(); }
+
+    const string& Text(const const_iterator it) const { return *m_entries[it->second].text; }
+    const string& Text(const Id id) const { return *m_entries[id].text; }
+    const Stats& GetStats(const const_iterator it) const { return m_entries[it->second].stats; }
+
+    // time is in seconds, any epoch as long as it is always the same
+    // Returns the id of the command, the same for as long as the ranking lives
+    Id Update(const C* text, const size_t length, const int64_t time)
+    {
+        if (!m_started)
+        {
+            m_origin = time;
+            m_started = true;
+        }
+
+        auto found = m_ids.emplace(std::piecewise_construct, std::forward_as_tuple(text, length), std::forward_as_tuple(Id(m_entries.size())));
+        const Id id = found.first->second;
+        if (found.second)
+        {
+            Entry e = { &found.first->first, { 0, 0, -std::numeric_limits<double>::infinity() } };
+            m_entries.push_back(e);
+        }
+        else
+            m_ranking.erase(Key(m_entries[id].stats.score, id));
+
+        Stats& stats = m_entries[id].stats;
+        const double run = double(time - m_origin) / m_halflife;
+        stats.score = stats.count == 0 ? run : LogAdd(stats.score, run);
+        ++stats.count;
+        stats.last = stats.count == 1 ? time : std::max(stats.last, time);     // Runs loaded from a file come oldest last
+        m_ranking.insert(Key(stats.score, id));
+        return id;
+    }
+
+private:
+    struct Entry
+    {
+        const string* text;     // Key in m_ids
+        Stats stats;
+    };
+
+    // log2(2^a + 2^b)
+    static double LogAdd(const double a, const double b)
+    {
+        const double hi = a > b ? a : b;
+        const double lo = a > b ? b : a;
+        return hi + std::log2(1.0 + std::exp2(lo - hi));
+    }
+
+    double m_halflife;
+    int64_t m_origin;
+    bool m_started;
+    std::pmr::unordered_map<string, Id> m_ids;
+    std::pmr::vector<Entry> m_entries;
+    Ranking m_ranking;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Incremental tokenizer for command line highlighting.
+// Keeps the lexer state before every character so an edit only re-lexes from the first changed
+// character until the state matches what was recorded for the old text again.
+template <class C>
+class Highlighter
+{
+public:
+    enum eToken : unsigned char { DEFAULT, COMMAND, STRING, REDIRECT, VARIABLE };
+
+    explicit Highlighter(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_text(resource), m_tokens(resource), m_state(1, 0, resource)
+    {
+    }
+
+    const eToken* Tokens() const { return m_tokens.data(); }
+    size_t Length() const { return m_text.length(); }
+
+    // Returns the index of the first character whose token may have changed
+    size_t Update(const C* text, size_t length)
+    {
+        const size_t oldlength = m_text.length();
+        const size_t common = std::min(oldlength, length);
+        const size_t prefix = std::mismatch(m_text.data(), m_text.data() + common, text).first - m_text.data();
+        size_t suffix = 0;
+        while (suffix < (common - prefix) && m_text[oldlength - suffix - 1] == text[length - suffix - 1])
+            ++suffix;
+
+        const size_t removed = oldlength - prefix - suffix;
+        const size_t inserted = length - prefix - suffix;
+        if (removed == 0 && inserted == 0)
+            return length;
+
+        m_text.replace(prefix, removed, text + prefix, inserted);
+
+        m_tokens.erase(m_tokens.begin() + prefix, m_tokens.begin() + prefix + removed);
+        m_tokens.insert(m_tokens.begin() + prefix, inserted, DEFAULT);
+
+        // m_state[i] is the state before character i, so m_state[prefix] is still valid
+        m_state.erase(m_state.begin() + prefix + 1, m_state.begin() + prefix + 1 + removed);
+        m_state.insert(m_state.begin() + prefix + 1, inserted, 0);
+
+        unsigned char state = m_state[prefix];
+        for (size_t i = prefix; i < length; ++i)
+        {
+            m_tokens[i] = Lex(state, m_text[i]);
+            if (i >= (prefix + inserted) && m_state[i + 1] == state)
+                break;  // Resynced with the old text, the rest of the tokens are unchanged
+            m_state[i + 1] = state;
+        }
+
+        return prefix;
+    }
+
+private:
+    enum eState : unsigned char
+    {
+        QUOTE = 0x01,
+        VAR = 0x02,
+        WORD = 0x04,
+        ARGS = 0x08,    // Past the command word
+        ESCAPE = 0x10,
+    };
+
+    static eToken Word(unsigned char& state)
+    {
+        state |= WORD;
+        return (state & ARGS) ? DEFAULT : COMMAND;
+    }
+
+    static void EndWord(unsigned char& state)
+    {
+        if (state & WORD)
+            state = (state & ~WORD) | ARGS;
+    }
+
+    static eToken Lex(unsigned char& state, const C c)
+    {
+        if (state & ESCAPE)
+        {
+            state &= ~ESCAPE;
+            return Word(state);
+        }
+
+        if (c == C('%'))
+        {
+            state ^= VAR;
+            state |= WORD;
+            return VARIABLE;
+        }
+        if (state & VAR)
+            return VARIABLE;
+
+        if (c == C('"'))
+        {
+            state ^= QUOTE;
+            state |= WORD;
+            return STRING;
+        }
+        if (state & QUOTE)
+            return STRING;
+
+        switch (c)
+        {
+        case C(' '): case C('\t'):
+            EndWord(state);
+            return DEFAULT;
+
+        case C('|'): case C('&'):
+            // Next word is a new command
+            state &= ~(WORD | ARGS);
+            return REDIRECT;
+
+        case C('<'): case C('>'):
+            EndWord(state);
+            state |= ARGS;
+            return REDIRECT;
+
+        case C('^'):
+            state |= ESCAPE;
+            return Word(state);
+
+        default:
+            return Word(state);
+        }
+    }
+
+    std::pmr::basic_string<C> m_text;
+    std::pmr::vector<eToken> m_tokens;
+    std::pmr::vector<unsigned char> m_state;
+};
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Append-only byte strings packed into large chunks.
+// A reference is the chunk index in the top bits and the offset in the chunk in the bottom bits,
+// each string is prefixed with its length as a varint.
+class HistoryArena
+{
+public:
+    typedef uint32_t Ref;
+
+    static const uint32_t OffsetBits = 20;
+    static const size_t ChunkSize = size_t(1) << OffsetBits;
+    static const size_t MaxChunks = size_t(1) << (32 - OffsetBits);
+
+    explicit HistoryArena(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_chunks(resource), m_used(ChunkSize)
+    {
+    }
+
+    HistoryArena(const HistoryArena&) = delete;
+    HistoryArena& operator=(const HistoryArena&) = delete;
+
+    ~HistoryArena()
+    {
+        std::pmr::memory_resource* resource = m_chunks.get_allocator().resource();
+        for (const Chunk& c : m_chunks)
+            resource->deallocate(c.data, c.size, 1);
+    }
+
+    size_t Capacity() const { return m_chunks.size() * ChunkSize; }
+
+    bool Append(const void* data, const size_t bytes, Ref* pRef)
+    {
+        uint8_t header[10];
+        const size_t headerlength = EncodeLength(bytes, header);
+        const size_t total = headerlength + bytes;
+
+        if (total > ChunkSize)
+        {
+            // Too big to share a chunk, gets one of its own at offset 0
+            if (m_chunks.size() >= MaxChunks)
+                return false;
+            uint8_t* p = NewChunk(total);
+            memcpy(p, header, headerlength);
+            memcpy(p + headerlength, data, bytes);
+            *pRef = Ref((m_chunks.size() - 1) << OffsetBits);
+            m_used = ChunkSize;
+            return true;
+        }
+
+        if ((m_used + total) > ChunkSize)
+        {
+            if (m_chunks.size() >= MaxChunks)
+                return false;
+            NewChunk(ChunkSize);
+            m_used = 0;
+        }
+
+        uint8_t* p = m_chunks.back().data + m_used;
+        memcpy(p, header, headerlength);
+        memcpy(p + headerlength, data, bytes);
+        *pRef = Ref(((m_chunks.size() - 1) << OffsetBits) | m_used);
+        m_used += total;
+        return true;
+    }
+
+    const uint8_t* Get(const Ref ref, size_t* pBytes) const
+    {
+        const uint8_t* p = m_chunks[ref >> OffsetBits].data + (ref & (ChunkSize - 1));
+        size_t bytes = 0;
+        for (unsigned int shift = 0;; shift += 7)
+        {
+            bytes |= size_t(*p & 0x7F) << shift;
+            if ((*p++ & 0x80) == 0)
+                break;
+        }
+        *pBytes = bytes;
+        return p;
+    }
+
+private:
+    struct Chunk
+    {
+        uint8_t* data;
+        size_t size;
+    };
+
+    uint8_t* NewChunk(const size_t size)
+    {
+        m_chunks.reserve(m_chunks.size() + 1);  // So the push_back can't throw and lose the chunk
+        const Chunk c = { static_cast<uint8_t*>(m_chunks.get_allocator().resource()->allocate(size, 1)), size };
+        m_chunks.push_back(c);
+        return c.data;
+    }
+
+    static size_t EncodeLength(size_t bytes, uint8_t* p)
+    {
+        size_t i = 0;
+        while (bytes >= 0x80)
+        {
+            p[i++] = uint8_t(bytes | 0x80);
+            bytes >>= 7;
+        }
+        p[i++] = uint8_t(bytes);
+        return i;
+    }
+
+    std::pmr::vector<Chunk> m_chunks;
+    size_t m_used;  // In the last chunk
+};
+
+// History entries, most recent first, stored in a HistoryArena.
+// Entries are either kept as C or, for 16 bit C, optionally as UTF-8 and decoded when read.
+// Entries can also be added as older than all the others, an entry keeps its index from the most recent
+// until a newer one is added.
+template <class C>
+class HistoryStore
+{
+public:
+    explicit HistoryStore(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_arena(resource), m_refs(resource), m_older(resource), m_scratch(resource), m_utf8(false)
+    {
+    }
+
+    size_t size() const { return m_refs.size() + m_older.size(); }
+    bool empty() const { return size() == 0; }
+
+    // Only takes effect while the history is empty
+    void SetUtf8(const bool utf8)
+    {
+        if (empty())
+            m_utf8 = utf8 && sizeof(C) == 2;
+    }
+
+    bool IsUtf8() const { return m_utf8; }
+
+    void push_front(const C* text, const size_t length)
+    {
+        HistoryArena::Ref ref = 0;
+        if (Append(text, length, &ref))
+            m_refs.push_back(ref);
+    }
+
+    // Adds the entry as the oldest
+    void push_back(const C* text, const size_t length)
+    {
+        HistoryArena::Ref ref = 0;
+        if (Append(text, length, &ref))
+            m_older.push_back(ref);
+    }
+
+    // 0 is the most recent
+    template <class A>
+    void Get(const size_t i, std::basic_string<C, std::char_traits<C>, A>& text) const
+    {
+        size_t bytes = 0;
+        const HistoryArena::Ref ref = i < m_refs.size() ? m_refs[m_refs.size() - 1 - i] : m_older[i - m_refs.size()];
+        const uint8_t* p = m_arena.Get(ref, &bytes);
+        if (m_utf8)
+            DecodeUtf8(p, bytes, text);
+        else
+        {
+            // Entries aren't aligned in the arena
+            text.resize(bytes / sizeof(C));
+            if (!text.empty())
+                memcpy(&text[0], p, bytes);
+        }
+    }
+
+private:
+    bool Append(const C* text, const size_t length, HistoryArena::Ref* pRef)
+    {
+        if (m_utf8)
+        {
+            EncodeUtf8(text, length, m_scratch);
+            return m_arena.Append(m_scratch.data(), m_scratch.size(), pRef);
+        }
+        else
+            return m_arena.Append(text, length * sizeof(C), pRef);
+    }
+
+    static void EncodeUtf8(const C* text, const size_t length, std::pmr::vector<uint8_t>& out)
+    {
+        out.clear();
+        for (size_t i = 0; i < length; ++i)
+        {
+            uint32_t c = uint16_t(text[i]);
+            if (c >= 0xD800 && c < 0xDC00 && (i + 1) < length && uint16_t(text[i + 1]) >= 0xDC00 && uint16_t(text[i + 1]) < 0xE000)
+                c = 0x10000 + ((c - 0xD800) << 10) + (uint16_t(text[++i]) - 0xDC00);
+
+            if (c < 0x80)
+                out.push_back(uint8_t(c));
+            else if (c < 0x800)
+            {
+                out.push_back(uint8_t(0xC0 | (c >> 6)));
+                out.push_back(uint8_t(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                // Unpaired surrogates are kept as is so the text round trips
+                out.push_back(uint8_t(0xE0 | (c >> 12)));
+                out.push_back(uint8_t(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(uint8_t(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                out.push_back(uint8_t(0xF0 | (c >> 18)));
+                out.push_back(uint8_t(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back(uint8_t(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(uint8_t(0x80 | (c & 0x3F)));
+            }
+        }
+    }
+
+    // Only has to decode what EncodeUtf8 produced
+    template <class A>
+    static void DecodeUtf8(const uint8_t* p, const size_t bytes, std::basic_string<C, std::char_traits<C>, A>& text)
+    {
+        text.clear();
+        const uint8_t* const end = p + bytes;
+        while (p < end)
+        {
+            uint32_t c = *p++;
+            if (c >= 0xF0)
+            {
+                c = ((c & 0x07) << 18) | (uint32_t(p[0] & 0x3F) << 12) | (uint32_t(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+                p += 3;
+                c -= 0x10000;
+                text.push_back(C(0xD800 + (c >> 10)));
+                text.push_back(C(0xDC00 + (c & 0x3FF)));
+                continue;
+            }
+            else if (c >= 0xE0)
+            {
+                c = ((c & 0x0F) << 12) | (uint32_t(p[0] & 0x3F) << 6) | (p[1] & 0x3F);
+                p += 2;
+            }
+            else if (c >= 0xC0)
+            {
+                c = ((c & 0x1F) << 6) | (p[0] & 0x3F);
+                p += 1;
+            }
+            text.push_back(C(c));
+        }
+    }
+
+    HistoryArena m_arena;
+    std::pmr::vector<HistoryArena::Ref> m_refs;    // Oldest first
+    std::pmr::vector<HistoryArena::Ref> m_older;   // Added with push_back, older than all of m_refs, newest first
+    std::pmr::vector<uint8_t> m_scratch;
+    bool m_utf8;
+};
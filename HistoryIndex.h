@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Radix trie over history entries for prefix suggestions.
+// Every node caches the highest ranked entry below it so a lookup only walks the prefix.
+// Entry text is kept once in a single pool, edge labels are ranges of the pool.
+template <class C>
+class PrefixIndex
+{
+public:
+    explicit PrefixIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_pool(resource), m_nodes(1, resource), m_count(0)
+    {
+        m_nodes[0].rank = NoRank;
+    }
+
+    size_t Size() const { return m_count; }
+
+    // Higher rank wins, use an increasing rank for most recent first
+    void Insert(const C* text, const size_t length, const int64_t rank)
+    {
+        uint32_t entry = 0;
+        if (!FindEntry(text, length, &entry))
+        {
+            entry = uint32_t(m_pool.length());
+            m_pool.append(text, length);
+            ++m_count;
+        }
+
+        uint32_t node = 0;
+        size_t pos = 0;
+        Rank(node, entry, length, rank);
+        while (pos < length)
+        {
+            uint32_t link = FindChild(node, text[pos]);
+            if (link == 0)
+            {
+                Node leaf = {};
+                leaf.begin = uint32_t(entry + pos);
+                leaf.length = uint32_t(length - pos);
+                leaf.sibling = m_nodes[node].child;
+                leaf.rank = NoRank;
+                link = uint32_t(m_nodes.size());
+                m_nodes[node].child = link;
+                m_nodes.push_back(leaf);
+                pos = length;
+            }
+            else
+            {
+                const Node& child = m_nodes[link];
+                uint32_t common = 1;
+                while (common < child.length && (pos + common) < length && m_pool[child.begin + common] == text[pos + common])
+                    ++common;
+
+                if (common < child.length)
+                    link = Split(node, link, common);
+                pos += common;
+            }
+
+            node = link;
+            Rank(node, entry, length, rank);
+        }
+        m_nodes[node].terminal = entry + 1;
+    }
+
+    // Returns the highest ranked entry starting with prefix
+    bool Find(const C* prefix, const size_t length, const C** pText, size_t* pLength) const
+    {
+        size_t end = 0;
+        const uint32_t node = Walk(prefix, length, &end);
+        if (node == NoNode || m_nodes[node].rank == NoRank)
+            return false;
+        *pText = m_pool.data() + m_nodes[node].best;
+        *pLength = m_nodes[node].best_length;
+        return true;
+    }
+
+private:
+    static const uint32_t NoNode = ~uint32_t(0);
+    static const int64_t NoRank = std::numeric_limits<int64_t>::min();
+
+    struct Node
+    {
+        uint32_t begin;         // Edge label in m_pool
+        uint32_t length;
+        uint32_t child;         // 0 is the root so can mark no child/sibling
+        uint32_t sibling;
+        uint32_t terminal;      // Entry ending at this node + 1
+        uint32_t best;          // Highest ranked entry at or below this node
+        uint32_t best_length;
+        int64_t rank;
+    };
+
+    uint32_t FindChild(const uint32_t node, const C c) const
+    {
+        uint32_t child = m_nodes[node].child;
+        while (child != 0 && m_pool[m_nodes[child].begin] != c)
+            child = m_nodes[child].sibling;
+        return child;
+    }
+
+    // Splits the edge to child after length characters, returns the new node in between
+    uint32_t Split(const uint32_t parent, const uint32_t child, const uint32_t length)
+    {
+        Node mid = m_nodes[child];
+        mid.length = length;
+        mid.child = child;
+        mid.terminal = 0;
+        m_nodes[child].begin += length;
+        m_nodes[child].length -= length;
+        m_nodes[child].sibling = 0;
+
+        const uint32_t split = uint32_t(m_nodes.size());
+        uint32_t* link = &m_nodes[parent].child;
+        while (*link != child)
+            link = &m_nodes[*link].sibling;
+        *link = split;
+        m_nodes.push_back(mid);
+        return split;
+    }
+
+    void Rank(const uint32_t node, const uint32_t entry, const size_t length, const int64_t rank)
+    {
+        Node& n = m_nodes[node];
+        if (rank >= n.rank)
+        {
+            n.rank = rank;
+            n.best = entry;
+            n.best_length = uint32_t(length);
+        }
+    }
+
+    // Returns the node at or below the end of prefix, *pEnd is the length of text up to that node
+    uint32_t Walk(const C* prefix, const size_t length, size_t* pEnd) const
+    {
+        uint32_t node = 0;
+        size_t pos = 0;
+        while (pos < length)
+        {
+            const uint32_t child = FindChild(node, prefix[pos]);
+            if (child == 0)
+                return NoNode;
+
+            const Node& c = m_nodes[child];
+            for (uint32_t i = 1; i < c.length && (pos + i) < length; ++i)
+                if (m_pool[c.begin + i] != prefix[pos + i])
+                    return NoNode;
+
+            node = child;
+            pos += c.length;
+        }
+        *pEnd = pos;
+        return node;
+    }
+
+    bool FindEntry(const C* text, const size_t length, uint32_t* pEntry) const
+    {
+        size_t end = 0;
+        const uint32_t node = Walk(text, length, &end);
+        if (node == NoNode || end != length || m_nodes[node].terminal == 0)
+            return false;
+        *pEntry = m_nodes[node].terminal - 1;
+        return true;
+    }
+
+    std::pmr::basic_string<C> m_pool;
+    std::pmr::vector<Node> m_nodes;
+    size_t m_count;
+};
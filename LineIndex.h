@@ -0,0 +1,87 @@
+#pragma once
+
+#include "PrefixSums.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Offsets of the start of each line in a buffer, kept in step with edits to it.
+// The lengths of the lines, each with its newline, are held as prefix sums, so the start of a line and the line
+// holding an offset are O(log n). An edit within a line only changes its length, one adding or removing lines
+// also rebuilds the sums and only scans the inserted text for new lines.
+template <class C>
+class LineIndex
+{
+public:
+    static const C Newline = C('\n');
+
+    explicit LineIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_lengths(resource), m_split(resource)
+    {
+        const size_t empty = 0;
+        m_lengths.Assign(&empty, 1);
+    }
+
+    size_t Lines() const { return m_lengths.Size(); }
+    size_t Start(const size_t line) const { return m_lengths.Sum(line); }
+
+    // The offset of the newline ending the line, or length for the last line
+    size_t End(const size_t line, const size_t length) const
+    {
+        return (line + 1) < Lines() ? Start(line) + m_lengths[line] - 1 : length;
+    }
+
+    // The line holding offset, an offset on a newline is in the line it ends
+    size_t Find(const size_t offset) const
+    {
+        return std::min(m_lengths.Find(offset), Lines() - 1);
+    }
+
+    void Reset(const C* s, const size_t length)
+    {
+        m_split.clear();
+        Split(s, length, 0, 0);
+        m_lengths.Assign(m_split.data(), m_split.size());
+    }
+
+    // Call after s has been inserted at offset
+    void Insert(const size_t offset, const C* s, const size_t length)
+    {
+        const size_t line = Find(offset);
+        const size_t before = offset - Start(line);
+        m_split.clear();
+        Split(s, length, before, m_lengths[line] - before);
+        m_lengths.Replace(line, line + 1, m_split.data(), m_split.size());
+    }
+
+    // Call after length characters have been erased at offset
+    void Erase(const size_t offset, const size_t length)
+    {
+        // Lines starting inside the erased text lost the newline before them and join the line it starts in
+        const size_t first = Find(offset);
+        const size_t last = Find(offset + length);
+        const size_t joined = Start(last) + m_lengths[last] - Start(first) - length;
+        m_lengths.Replace(first, last + 1, &joined, 1);
+    }
+
+private:
+    // The lengths of the lines in s with before added to the first and after to the last
+    void Split(const C* s, const size_t length, const size_t before, const size_t after)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (s[i] == Newline)
+            {
+                m_split.push_back(i + 1 - start + (m_split.empty() ? before : 0));
+                start = i + 1;
+            }
+        }
+        m_split.push_back(length - start + (m_split.empty() ? before : 0) + after);
+    }
+
+    PrefixSums<size_t> m_lengths;
+    std::pmr::vector<size_t> m_split;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+
+// Predicts the next command from the one or two run before it, like git commit after git add -A.
+// Each context of the last command, and of the last two, keeps a few of the commands that followed it with counts,
+// space-saving style: a new follower replaces the least counted one and starts from its count.
+// So a context is a fixed size and frequent followers are kept however many rare ones come and go.
+// Both an update and a prediction are a couple of hash lookups.
+class NextCommandModel
+{
+public:
+    typedef uint32_t Id;
+    static const Id NoId = ~Id(0);
+
+    // A prediction needs to have followed its context at least this many times
+    static const uint32_t MinCount = 2;
+
+    explicit NextCommandModel(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_contexts(resource), m_last(NoId), m_before(NoId), m_first(NoId), m_second(NoId)
+    {
+    }
+
+    size_t Contexts() const { return m_contexts.size(); }
+
+    // Call with each command as it is run, in order
+    void Add(const Id id)
+    {
+        Learn(NoId, m_last, id);
+        if (m_before != NoId)
+            Learn(m_before, m_last, id);
+        m_before = m_last;
+        m_last = id;
+        if (m_first == NoId)
+            m_first = id;
+        else if (m_second == NoId)
+            m_second = id;
+    }
+
+    // Call with commands run before all the others, newest first, as when history is loaded from its end
+    void AddOlder(const Id id)
+    {
+        Learn(NoId, id, m_first);
+        Learn(id, m_first, m_second);
+        m_second = m_first;
+        m_first = id;
+        if (m_last == NoId)
+            m_last = id;
+        else if (m_before == NoId)
+            m_before = id;
+    }
+
+    // The command most likely to be run next, NoId if nothing has followed the last commands often enough
+    Id Predict() const
+    {
+        if (m_last == NoId)
+            return NoId;
+
+        Id id = NoId;
+        if (m_before != NoId && Find(Key(m_before, m_last), &id))
+            return id;
+        if (Find(Key(NoId, m_last), &id))
+            return id;
+        return NoId;
+    }
+
+private:
+    static const size_t Slots = 4;
+
+    struct Followers
+    {
+        Id ids[Slots] = { NoId, NoId, NoId, NoId };
+        uint32_t counts[Slots] = {};
+
+        void Add(const Id id)
+        {
+            size_t least = 0;
+            for (size_t i = 0; i < Slots; ++i)
+            {
+                if (ids[i] == id)
+                {
+                    ++counts[i];
+                    return;
+                }
+                if (counts[i] < counts[least])
+                    least = i;
+            }
+            ids[least] = id;
+            ++counts[least];
+        }
+
+        size_t Best() const
+        {
+            size_t best = 0;
+            for (size_t i = 1; i < Slots; ++i)
+                if (counts[i] > counts[best])
+                    best = i;
+            return best;
+        }
+    };
+
+    // next followed last, or before then last
+    void Learn(const Id before, const Id last, const Id next)
+    {
+        if (last == NoId || next == NoId)
+            return;
+        m_contexts[Key(before, last)].Add(next);
+    }
+
+    static uint64_t Key(const Id before, const Id last)
+    {
+        return (uint64_t(before) << 32) | last;
+    }
+
+    bool Find(const uint64_t key, Id* pId) const
+    {
+        const auto it = m_contexts.find(key);
+        if (it == m_contexts.end())
+            return false;
+        const Followers& f = it->second;
+        const size_t best = f.Best();
+        if (f.counts[best] < MinCount)
+            return false;
+        *pId = f.ids[best];
+        return true;
+    }
+
+    std::pmr::unordered_map<uint64_t, Followers> m_contexts;
+    Id m_last;          // The last command run
+    Id m_before;        // The command before it
+    Id m_first;         // The first command run, or the oldest loaded
+    Id m_second;        // The command after it
+};
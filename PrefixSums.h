@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// A sequence of non-negative values with the sum of any prefix of them, held as a Fenwick tree.
+// Summing a prefix, finding the value a sum falls in and changing a value are O(log n),
+// replacing values with a different number of them rebuilds the tree in O(n).
+template <class T>
+class PrefixSums
+{
+public:
+    explicit PrefixSums(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_values(resource), m_tree(resource)
+    {
+    }
+
+    size_t Size() const { return m_values.size(); }
+    T operator[](const size_t i) const { return m_values[i]; }
+
+    // The sum of the first count values
+    T Sum(size_t count) const
+    {
+        T sum = 0;
+        for (; count > 0; count &= count - 1)
+            sum += m_tree[count - 1];
+        return sum;
+    }
+
+    T Total() const { return Sum(m_values.size()); }
+
+    // The index of the value sum falls in, the first with Sum(i + 1) > sum, or Size() if there is none
+    size_t Find(T sum) const
+    {
+        size_t i = 0;
+        for (size_t step = HighBit(m_tree.size()); step > 0; step >>= 1)
+        {
+            if ((i + step) <= m_tree.size() && m_tree[i + step - 1] <= sum)
+            {
+                i += step;
+                sum -= m_tree[i - 1];
+            }
+        }
+        return i;
+    }
+
+    void Set(const size_t i, const T value)
+    {
+        const T diff = value - m_values[i];
+        m_values[i] = value;
+        for (size_t j = i + 1; j <= m_tree.size(); j += j & (~j + 1))
+            m_tree[j - 1] += diff;
+    }
+
+    // Replaces the values from first up to last with count values
+    void Replace(const size_t first, const size_t last, const T* values, const size_t count)
+    {
+        if (count == (last - first))
+        {
+            for (size_t i = 0; i < count; ++i)
+                Set(first + i, values[i]);
+            return;
+        }
+
+        m_values.erase(m_values.begin() + first, m_values.begin() + last);
+        m_values.insert(m_values.begin() + first, values, values + count);
+        Build();
+    }
+
+    void Assign(const T* values, const size_t count)
+    {
+        m_values.assign(values, values + count);
+        Build();
+    }
+
+private:
+    static size_t HighBit(size_t n)
+    {
+        size_t bit = 0;
+        for (; n != 0; n &= n - 1)
+            bit = n;
+        return bit;
+    }
+
+    // Each node adds itself to its parent, so building takes one pass
+    void Build()
+    {
+        m_tree.assign(m_values.begin(), m_values.end());
+        for (size_t i = 1; i <= m_tree.size(); ++i)
+        {
+            const size_t parent = i + (i & (~i + 1));
+            if (parent <= m_tree.size())
+                m_tree[parent - 1] += m_tree[i - 1];
+        }
+    }
+
+    std::pmr::vector<T> m_values;
+    std::pmr::vector<T> m_tree;     // m_tree[i - 1] is the sum of the (i & -i) values ending at i - 1
+};
@@ -5,52 +5,215 @@
 #include <shlwapi.h>
 
 #include <string>
-#include <deque>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <type_traits>
 
 #include "RadReadConsole.h"
+#include "SharedHistory.h"
+#include "Highlight.h"
+#include "HistoryIndex.h"
+#include "History.h"
+#include "Frecency.h"
+#include "Utf.h"
+#include "Unicode.h"
+#include "CommandIndex.h"
+#include "NextCommand.h"
+#include "CharClass.h"
+#include "LineIndex.h"
+#include "PrefixSums.h"
+#include "SpscQueue.h"
+#include "Trace.h"
 
 #define ARRAY_X(a) (a), ARRAYSIZE(a)
 #define BUFFER_X(p, s, o) (p) + (o), (*s) - (o)
 
 #ifdef UNICODE
-#define tmemmove wmemmove
-#define tmemcpy wmemcpy
-#define tmemset wmemset
 #define tChar UnicodeChar
 #define tstring wstring
+#define tstring_view wstring_view
 #else
-#define tmemmove memmove
-#define tmemcpy memcpy
-#define tmemset memset
 #define tChar AsciiChar
 #define tstring string
+#define tstring_view string_view
 #endif
 
 namespace
 {
-    class SaveConsoleMode
+    // The RAD_ environment variables that turn on parts of the editor
+    struct EditorOptions
+    {
+        bool history_utf8;                  // RAD_HISTORY_UTF8
+        bool history_ranked;                // RAD_HISTORY_RANKED
+        bool multiline;                     // RAD_MULTILINE
+        bool highlight;                     // RAD_HIGHLIGHT
+        bool autosuggest;                   // RAD_AUTOSUGGEST
+        bool command_index;                 // RAD_COMMAND_INDEX
+        bool input_thread;                  // RAD_INPUT_THREAD
+        TCHAR history_shared[MAX_PATH];     // RAD_HISTORY_SHARED, empty if not set
+
+        void Read()
+        {
+            history_utf8 = IsSet(TEXT("RAD_HISTORY_UTF8"));
+            history_ranked = IsSet(TEXT("RAD_HISTORY_RANKED"));
+            multiline = IsSet(TEXT("RAD_MULTILINE"));
+            highlight = IsSet(TEXT("RAD_HIGHLIGHT"));
+            autosuggest = IsSet(TEXT("RAD_AUTOSUGGEST"));
+            command_index = IsSet(TEXT("RAD_COMMAND_INDEX"));
+            input_thread = IsSet(TEXT("RAD_INPUT_THREAD"));
+            if (!GetEnvironmentVariable(TEXT("RAD_HISTORY_SHARED"), history_shared, ARRAYSIZE(history_shared)))
+                history_shared[0] = TEXT('\0');
+        }
+
+    private:
+        static bool IsSet(LPCTSTR lpName)
+        {
+            return GetEnvironmentVariable(lpName, nullptr, 0) != 0;
+        }
+    };
+
+    // The console modes the editor needs, set up for each read and the callers restored when it returns.
+    // Between RadBeginSession and RadEndSession the modes and the options are worked out once and kept, each read then
+    // only checks that the output handle and both modes are still the ones it restored, a program run between prompts
+    // may have changed them, in which case the changed modes are taken as the callers and worked out again.
+    class ConsoleSession
     {
     public:
-        SaveConsoleMode(HANDLE hConsoleHandle)
-            : m_hConsoleHandle(hConsoleHandle), m_dwMode(0)
+        ConsoleSession()
+            : m_hInput(NULL), m_hOutput(NULL), m_saved_input(0), m_saved_output(0), m_input(0), m_output(0), m_cursor(), m_options(), m_active(false), m_kept(false), m_persistent(false)
+        {
+        }
+
+        HANDLE Output() const { return m_hOutput; }
+        DWORD InputMode() const { return m_saved_input; }
+        const CONSOLE_CURSOR_INFO& Cursor() const { return m_cursor; }
+        const EditorOptions& Options() const { return m_options; }
+
+        enum Result
+        {
+            Ready,
+            NotConsole,     // The input is a pipe or file
+            NotLineMode,    // The read should fall back to ReadConsole
+        };
+
+        Result Begin(const HANDLE hInput)
         {
-            if (!GetConsoleMode(m_hConsoleHandle, &m_dwMode))
+            Trace::Span span("ConsoleSetup");
+            DWORD mode_input = 0;
+            if (!GetConsoleMode(hInput, &mode_input))
+                return NotConsole;
+
+            DWORD mode_output = 0;
+            if (m_kept && hInput == m_hInput && mode_input == m_saved_input && GetStdHandle(STD_OUTPUT_HANDLE) == m_hOutput
+                && GetConsoleMode(m_hOutput, &mode_output) && mode_output == m_saved_output)
+            {
+                GetConsoleCursorInfo(m_hOutput, &m_cursor);
+                Apply();
+                return Ready;
+            }
+            m_kept = false;
+
+            if ((mode_input & (ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT)) == 0)
+            {
+                OutputDebugString(TEXT("Error Invalid input console mode reverting to default\n"));
+                return NotLineMode;
+            }
+
+            // ENABLE_WINDOW_INPUT to reflow the line when the console is resized
+            m_hInput = hInput;
+            m_saved_input = mode_input;
+            m_input = m_saved_input | ENABLE_WINDOW_INPUT;
+            m_hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+            if (!GetConsoleMode(m_hOutput, &m_saved_output))
                 OutputDebugString(TEXT("Error GetConsoleMode\n"));
+
+            // ENABLE_VIRTUAL_TERMINAL_PROCESSING stops ENABLE_WRAP_AT_EOL_OUTPUT from working
+            m_output = (m_saved_output & ~ENABLE_VIRTUAL_TERMINAL_PROCESSING) | ENABLE_WRAP_AT_EOL_OUTPUT;
+            Apply();
+
+            DWORD mode_output_check;
+            if (!GetConsoleMode(m_hOutput, &mode_output_check))
+                OutputDebugString(TEXT("Error GetConsoleMode hOutput\n"));
+
+            if (mode_output_check != m_output)
+            {
+                OutputDebugString(TEXT("Error setting output console mode\n"));
+                m_output = mode_output_check;
+            }
+
+            GetConsoleCursorInfo(m_hOutput, &m_cursor);
+            m_options.Read();
+            m_kept = m_persistent;
+            return Ready;
+        }
+
+        // When the read returns
+        void End()
+        {
+            if (m_active)
+                Restore();
         }
 
-        ~SaveConsoleMode()
+        void SetPersistent(const bool persistent)
         {
-            if (!SetConsoleMode(m_hConsoleHandle, m_dwMode))
+            m_persistent = persistent;
+            m_kept = false;
+        }
+
+    private:
+        void Apply()
+        {
+            if (!SetConsoleMode(m_hInput, m_input))
+                OutputDebugString(TEXT("Error SetConsoleMode hConsoleInput\n"));
+            if (!SetConsoleMode(m_hOutput, m_output))
+                OutputDebugString(TEXT("Error SetConsoleMode hOutput\n"));
+            m_active = true;
+        }
+
+        void Restore()
+        {
+            Trace::Span span("ConsoleRestore");
+            if (!SetConsoleMode(m_hInput, m_saved_input))
+                OutputDebugString(TEXT("Error SetConsoleMode\n"));
+            if (!SetConsoleMode(m_hOutput, m_saved_output))
                 OutputDebugString(TEXT("Error SetConsoleMode\n"));
+            m_active = false;
         }
 
-        DWORD mode() const { return m_dwMode; }
+        HANDLE m_hInput;
+        HANDLE m_hOutput;
+        DWORD m_saved_input;    // As the caller had them
+        DWORD m_saved_output;
+        DWORD m_input;          // As set for the editor
+        DWORD m_output;
+        CONSOLE_CURSOR_INFO m_cursor;
+        EditorOptions m_options;
+        bool m_active;          // The editor's modes are set
+        bool m_kept;            // The modes and options are kept for the next read
+        bool m_persistent;
+    };
+
+    class EndConsoleSession
+    {
+    public:
+        explicit EndConsoleSession(ConsoleSession& session)
+            : m_session(session)
+        {
+        }
+
+        ~EndConsoleSession()
+        {
+            m_session.End();
+        }
 
     private:
-        HANDLE m_hConsoleHandle;
-        DWORD m_dwMode;
+        ConsoleSession& m_session;
     };
 
     struct HANDLE_Deleter
@@ -59,6 +222,12 @@ namespace
         void operator()(HANDLE h) { CloseHandle(h); }
     };
 
+    struct FIND_Deleter
+    {
+        typedef HANDLE pointer;
+        void operator()(HANDLE h) { FindClose(h); }
+    };
+
     template <class T, class U>
     class unique_ptr_ptr
     {
@@ -85,7 +254,7 @@ namespace
     };
 
     template<class T, class U>
-    typename unique_ptr_ptr<T, U> operator&(std::unique_ptr<T, U>& up)
+    unique_ptr_ptr<T, U> operator&(std::unique_ptr<T, U>& up)
     {
         return unique_ptr_ptr<T, U>(up);
     }
@@ -123,311 +292,2749 @@ namespace
         return TRUE;
     }
 
-    BOOL WriteFileANSI(HANDLE hFile, _In_NLS_string_(cchWideChar)LPCWCH lpWideCharStr, int cchWideChar = -1)
+    // Encoding of the RAD_HISTORY_PIPE process input and output, set RAD_HISTORY_PIPE_ENCODING to UTF8 or ANSI (the default)
+    UINT GetHistoryPipeCodePage()
+    {
+        TCHAR encoding[16] = TEXT("");
+        GetEnvironmentVariable(TEXT("RAD_HISTORY_PIPE_ENCODING"), ARRAY_X(encoding));
+        return (lstrcmpi(encoding, TEXT("UTF8")) == 0 || lstrcmpi(encoding, TEXT("UTF-8")) == 0) ? CP_UTF8 : CP_ACP;
+    }
+
+    // Encoding of input that isn't a console, set RAD_INPUT_ENCODING to UTF8 or it is in the console input code page
+    UINT GetInputStreamCodePage()
+    {
+        TCHAR encoding[16] = TEXT("");
+        GetEnvironmentVariable(TEXT("RAD_INPUT_ENCODING"), ARRAY_X(encoding));
+        if (lstrcmpi(encoding, TEXT("UTF8")) == 0 || lstrcmpi(encoding, TEXT("UTF-8")) == 0)
+            return CP_UTF8;
+        const UINT CodePage = GetConsoleCP();
+        return CodePage != 0 ? CodePage : CP_ACP;
+    }
+
+    // Buffers text written to a file, converting to the code page
+    class FileWriter
+    {
+    public:
+        static const size_t BufferSize = 64 * 1024;
+
+        FileWriter(HANDLE hFile, UINT CodePage)
+            : m_hFile(hFile), m_CodePage(CodePage), m_buffer(BufferSize), m_used(0)
+        {
+        }
+
+        BOOL Write(const WCHAR* lpStr, const DWORD length)
+        {
+            // Worst case is a 4 byte GB18030 sequence for each UTF-16 code unit
+            const size_t need = m_CodePage == CP_UTF8 ? Utf::Utf8Size(length) + 3 : size_t(length) * 4;
+            if ((m_used + need) > m_buffer.size())
+            {
+                if (!WriteBuffer())
+                    return FALSE;
+                if (need > m_buffer.size())
+                    m_buffer.resize(need);
+            }
+
+            if (m_CodePage == CP_UTF8)
+                m_used += m_utf8.Convert(lpStr, length, reinterpret_cast<uint8_t*>(m_buffer.data() + m_used));
+            else if (length > 0)
+            {
+                const int bytes = WideCharToMultiByte(m_CodePage, 0, lpStr, length, m_buffer.data() + m_used, int(m_buffer.size() - m_used), nullptr, nullptr);
+                if (bytes == 0)
+                    return FALSE;
+                m_used += bytes;
+            }
+            return TRUE;
+        }
+
+        // Text in the ANSI code page goes through UTF-16
+        BOOL Write(const CHAR* lpStr, const DWORD length)
+        {
+            m_wide.resize(length);
+            const int chars = length > 0 ? MultiByteToWideChar(CP_ACP, 0, lpStr, int(length), m_wide.data(), int(length)) : 0;
+            return Write(m_wide.data(), DWORD(chars));
+        }
+
+        // Ends the text, a high surrogate left at the end is written as U+FFFD
+        BOOL Flush()
+        {
+            if (m_CodePage == CP_UTF8)
+            {
+                if ((m_used + 3) > m_buffer.size() && !WriteBuffer())
+                    return FALSE;
+                m_used += m_utf8.Finish(reinterpret_cast<uint8_t*>(m_buffer.data() + m_used));
+            }
+            return WriteBuffer();
+        }
+
+    private:
+        BOOL WriteBuffer()
+        {
+            const DWORD cbBytesToWrite = DWORD(m_used);
+            m_used = 0;
+            DWORD cbBytesWritten = 0;
+            return cbBytesToWrite == 0
+                || (WriteFile(m_hFile, m_buffer.data(), cbBytesToWrite, &cbBytesWritten, nullptr) && cbBytesWritten == cbBytesToWrite);
+        }
+
+        HANDLE m_hFile;
+        UINT m_CodePage;
+        std::vector<CHAR> m_buffer;
+        size_t m_used;
+        Utf::Utf16ToUtf8<WCHAR> m_utf8;
+        std::vector<WCHAR> m_wide;
+    };
+
+    // Reads until the end of the file, converting from the code page to UTF-16
+    BOOL ReadFileText(HANDLE hFile, UINT CodePage, std::wstring& text)
     {
-        CHAR szAnsiCharStr[1024];
-        int bytes = WideCharToMultiByte(CP_ACP, 0, lpWideCharStr, cchWideChar, szAnsiCharStr, ARRAYSIZE(szAnsiCharStr), nullptr, nullptr);
-        DWORD dwWritten;
-        return WriteFile(hFile, szAnsiCharStr, bytes, &dwWritten, NULL);
+        text.clear();
+        std::string bytes;
+        Utf::Utf8ToUtf16<WCHAR> utf8;
+        CHAR buffer[4096];
+        DWORD dwRead = 0;
+        BOOL fSuccess;
+        while ((fSuccess = ReadFile(hFile, buffer, ARRAYSIZE(buffer), &dwRead, nullptr)) && dwRead > 0)
+        {
+            if (CodePage == CP_UTF8)
+            {
+                const size_t used = text.length();
+                text.resize(used + Utf::Utf16Size(dwRead) + 4);
+                text.resize(used + utf8.Convert(reinterpret_cast<const uint8_t*>(buffer), dwRead, &text[used]));
+            }
+            else
+                bytes.append(buffer, dwRead);
+        }
+
+        if (!fSuccess && GetLastError() != ERROR_BROKEN_PIPE)
+            return FALSE;
+
+        if (CodePage == CP_UTF8)
+        {
+            WCHAR tail[4];
+            text.append(tail, utf8.Finish(tail));
+        }
+        else if (!bytes.empty())
+        {
+            const int chars = MultiByteToWideChar(CodePage, 0, bytes.data(), int(bytes.length()), nullptr, 0);
+            text.resize(chars);
+            MultiByteToWideChar(CodePage, 0, bytes.data(), int(bytes.length()), &text[0], chars);
+        }
+        return TRUE;
     }
 
-    BOOL ReadFileANSI(HANDLE hFile, _Out_writes_to_opt_(cchWideChar, return) LPWCH lpWideCharStr, int cchWideChar, LPDWORD pchars)
+    // The same into the ANSI code page
+    inline BOOL ReadFileText(HANDLE hFile, UINT CodePage, std::string& text)
     {
-        CHAR szAnsiCharStr[1024];
-        DWORD dwRead;
-        if (!ReadFile(hFile, szAnsiCharStr, ARRAYSIZE(szAnsiCharStr), &dwRead, NULL))
+        std::wstring wide;
+        if (!ReadFileText(hFile, CodePage, wide))
             return FALSE;
-        int chars = MultiByteToWideChar(CP_ACP, 0, szAnsiCharStr, dwRead, lpWideCharStr, cchWideChar);
-        if (lpWideCharStr)
-            lpWideCharStr[chars] = L'\0';
-        if (pchars)
-            *pchars = chars;
+        text.resize(wide.length() * 4);
+        text.resize(wide.empty() ? 0 : WideCharToMultiByte(CP_ACP, 0, wide.data(), int(wide.length()), &text[0], int(text.size()), nullptr, nullptr));
         return TRUE;
     }
 
-std::deque<std::tstring> g_history;
+    // Converts UTF-8 to UTF-16 or the ANSI code page, returns the number of characters written to lpText
+    DWORD Utf8ToText(const uint8_t* lpUtf8, const DWORD length, WCHAR* lpText, const DWORD capacity)
+    {
+        std::vector<WCHAR> wide(Utf::Utf16Size(length) + 4);
+        Utf::Utf8ToUtf16<WCHAR> utf8;
+        size_t chars = utf8.Convert(lpUtf8, length, wide.data());
+        chars += utf8.Finish(wide.data() + chars);
+        chars = std::min(chars, size_t(capacity));
+        std::char_traits<WCHAR>::copy(lpText, wide.data(), chars);
+        return DWORD(chars);
+    }
 
-std::vector<std::tstring> split(const std::tstring& str, const TCHAR delim)
-{
-    std::vector<std::tstring> result;
-    size_t start = 0;
+    inline DWORD Utf8ToText(const uint8_t* lpUtf8, const DWORD length, CHAR* lpText, const DWORD capacity)
+    {
+        std::vector<WCHAR> wide(Utf::Utf16Size(length) + 4);
+        const DWORD chars = Utf8ToText(lpUtf8, length, wide.data(), DWORD(wide.size()));
+        return DWORD(WideCharToMultiByte(CP_ACP, 0, wide.data(), int(chars), lpText, int(capacity), nullptr, nullptr));
+    }
 
-    for (size_t found = str.find(delim); found != std::tstring::npos; found = str.find(delim, start))
+    // Converts a complete line from the code page, lpText must hold Utf::Utf16Size(length) + 4 characters
+    // Returns the number of characters written to lpText
+    DWORD LineToText(const UINT CodePage, const CHAR* lpBytes, const DWORD length, WCHAR* lpText)
     {
-        result.emplace_back(str.begin() + start, str.begin() + found);
-        start = found + 1;
+        if (length == 0)
+            return 0;
+        if (CodePage == CP_UTF8)
+        {
+            Utf::Utf8ToUtf16<WCHAR> utf8;
+            const size_t chars = utf8.Convert(reinterpret_cast<const uint8_t*>(lpBytes), length, lpText);
+            return DWORD(chars + utf8.Finish(lpText + chars));
+        }
+        return DWORD(MultiByteToWideChar(CodePage, 0, lpBytes, int(length), lpText, int(Utf::Utf16Size(length) + 4)));
     }
-    if (start != str.size())
-        result.emplace_back(str.begin() + start, str.end());
-    return result;
-}
 
-inline bool IsDoubleWidth(const TCHAR ch)
+    // Any other code page is taken to be the ANSI one
+    inline DWORD LineToText(const UINT CodePage, const CHAR* lpBytes, const DWORD length, CHAR* lpText)
+    {
+        if (CodePage == CP_UTF8)
+            return Utf8ToText(reinterpret_cast<const uint8_t*>(lpBytes), length, lpText, length);
+        memcpy(lpText, lpBytes, length);
+        return length;
+    }
+
+    // Converts UTF-16 to UTF-8, out must hold Utf::Utf8Size(length) + 3 bytes or just Utf8Length(lpText, length), returns
+    // the number of bytes written
+    size_t TextToUtf8(const WCHAR* lpText, const DWORD length, uint8_t* out)
+    {
+        Utf::Utf16ToUtf8<WCHAR> utf8;
+        const size_t bytes = utf8.Convert(lpText, length, out);
+        return bytes + utf8.Finish(out + bytes);
+    }
+
+    // The bytes TextToUtf8 writes for lpText, exactly
+    size_t Utf8Length(const WCHAR* lpText, const DWORD length)
+    {
+        return Utf::Utf8Length(lpText, length);
+    }
+
+    // Text in the ANSI code page goes through UTF-16
+    inline std::vector<WCHAR> AnsiToWide(const CHAR* lpText, const DWORD length)
+    {
+        std::vector<WCHAR> wide(length > 0 ? MultiByteToWideChar(CP_ACP, 0, lpText, int(length), nullptr, 0) : 0);
+        if (!wide.empty())
+            MultiByteToWideChar(CP_ACP, 0, lpText, int(length), wide.data(), int(wide.size()));
+        return wide;
+    }
+
+    inline size_t TextToUtf8(const CHAR* lpText, const DWORD length, uint8_t* out)
+    {
+        const std::vector<WCHAR> wide = AnsiToWide(lpText, length);
+        return TextToUtf8(wide.data(), DWORD(wide.size()), out);
+    }
+
+    inline size_t Utf8Length(const CHAR* lpText, const DWORD length)
+    {
+        const std::vector<WCHAR> wide = AnsiToWide(lpText, length);
+        return Utf8Length(wide.data(), DWORD(wide.size()));
+    }
+
+    // Memory for the history and the editor state of each read, from the allocator set with RadSetAllocator or the C++ heap.
+    // Each block records the functions it came from so the allocator can change while blocks are still held.
+    class HostMemoryResource : public std::pmr::memory_resource
+    {
+    public:
+        HostMemoryResource()
+            : m_alloc(NewBlock), m_free(DeleteBlock), m_context(nullptr)
+        {
+        }
+
+        void Set(const RadAllocFn pAlloc, const RadFreeFn pFree, const LPVOID lpContext)
+        {
+            m_alloc = pAlloc != nullptr ? pAlloc : NewBlock;
+            m_free = pAlloc != nullptr ? pFree : DeleteBlock;
+            m_context = pAlloc != nullptr ? lpContext : nullptr;
+        }
+
+    private:
+        struct Header
+        {
+            RadFreeFn free;
+            LPVOID context;
+        };
+
+        // Before the block, a multiple of its alignment so the block keeps it
+        static size_t HeaderSize(const size_t alignment) { return std::max(alignment, sizeof(Header)); }
+        static size_t BlockAlignment(const size_t alignment) { return std::max(alignment, alignof(Header)); }
+
+        static LPVOID NewBlock(const SIZE_T nBytes, const SIZE_T nAlignment, LPVOID)
+        {
+            return ::operator new(nBytes, std::align_val_t(nAlignment), std::nothrow);
+        }
+
+        static void DeleteBlock(const LPVOID lpMemory, const SIZE_T nBytes, const SIZE_T nAlignment, LPVOID)
+        {
+            ::operator delete(lpMemory, nBytes, std::align_val_t(nAlignment));
+        }
+
+        void* do_allocate(const size_t bytes, const size_t alignment) override
+        {
+            const size_t header = HeaderSize(alignment);
+            BYTE* block = static_cast<BYTE*>(m_alloc(header + bytes, BlockAlignment(alignment), m_context));
+            if (block == nullptr)
+                throw std::bad_alloc();
+            Header* h = reinterpret_cast<Header*>(block + header) - 1;
+            h->free = m_free;
+            h->context = m_context;
+            return block + header;
+        }
+
+        void do_deallocate(void* p, const size_t bytes, const size_t alignment) override
+        {
+            const size_t header = HeaderSize(alignment);
+            const Header h = *(static_cast<const Header*>(p) - 1);
+            h.free(static_cast<BYTE*>(p) - header, header + bytes, BlockAlignment(alignment), h.context);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        RadAllocFn m_alloc;
+        RadFreeFn m_free;
+        LPVOID m_context;
+    };
+
+// Defined before anything using it so it is destroyed after them
+HostMemoryResource g_memory;
+
+// The editor state for a single read, released all at once when the read returns.
+// Typing only takes memory from here, a read only goes to g_memory once this is used up.
+alignas(std::max_align_t) BYTE g_read_memory[64 * 1024];
+
+ConsoleSession g_session;
+HistoryStore<TCHAR> g_history(&g_memory);
+
+// Opt-in history shared between processes, set RAD_HISTORY_SHARED to the name of the file mapping
+class SharedHistory
 {
-    switch (ch)
+public:
+    static const uint32_t SlotCount = 1024;
+    static const uint32_t SlotChars = 512;
+    static const ULONGLONG PendingTimeout = 1000;
+
+    SharedHistory()
+        : m_pView(nullptr), m_dwProcessId(0), m_seen(0), m_pending(0)
     {
-    case TEXT('\0'):
-    case TEXT('\r'):
-    case TEXT('\n'):
-        return false;
-    default: return ch <= 26;
     }
-}
 
-inline DWORD GetPrintWidth(LPCTSTR lpStr, const DWORD begin, const DWORD end)
+    ~SharedHistory()
+    {
+        if (m_pView)
+            UnmapViewOfFile(m_pView);
+    }
+
+    bool IsOpen() const { return m_ring.IsOpen(); }
+
+    bool Open(LPCTSTR lpName)
+    {
+        const size_t size = SharedHistoryRing<TCHAR>::Size(SlotCount, SlotChars);
+        if (!m_hMapping)
+        {
+            m_hMapping.reset(CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, DWORD(size), lpName));
+            if (!m_hMapping)
+                return false;
+            m_pView = MapViewOfFile(m_hMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, size);
+            if (!m_pView)
+            {
+                m_hMapping.reset();
+                return false;
+            }
+        }
+
+        // Waits for another process initialising the mapping, fails if its layout doesn't match
+        if (!m_ring.Open(m_pView, size, SlotCount, SlotChars))
+            return false;
+
+        m_dwProcessId = GetCurrentProcessId();
+        m_text.resize(m_ring.SlotChars());
+        return true;
+    }
+
+    void Append(LPCTSTR lpStr, DWORD length)
+    {
+        m_ring.Append(m_dwProcessId, lpStr, length);
+    }
+
+    // Import entries appended by other processes since the last sync
+    // Only touches the mapped memory so it is cheap enough to call on the navigation path
+    template <class F>
+    void Sync(F add)
+    {
+        const uint64_t head = m_ring.Head();
+        uint64_t seq = std::max(m_seen, m_ring.Tail());
+        for (; seq < head; ++seq)
+        {
+            uint32_t length = 0;
+            uint32_t owner = 0;
+            if (m_ring.Read(seq, &m_text[0], &length, &owner))
+            {
+                if (owner != m_dwProcessId)
+                    add(m_text.data(), length);
+            }
+            else if (m_ring.IsPending(seq))
+            {
+                // Wait for the writer to publish, unless it looks like it died mid-append
+                const ULONGLONG now = GetTickCount64();
+                if (m_pending == 0)
+                    m_pending = now;
+                if ((now - m_pending) < PendingTimeout)
+                    break;
+            }
+            m_pending = 0;
+        }
+        m_seen = seq;
+    }
+
+private:
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hMapping;
+    LPVOID m_pView;
+    SharedHistoryRing<TCHAR> m_ring;
+    DWORD m_dwProcessId;
+    uint64_t m_seen;
+    ULONGLONG m_pending;
+    std::tstring m_text;
+};
+
+SharedHistory g_shared_history;
+PrefixIndex<TCHAR> g_history_index(&g_memory);
+int64_t g_history_rank = 0;
+FrecencyRank<TCHAR> g_frecency(&g_memory);
+NextCommandModel g_next_command(&g_memory);    // Over ids from g_frecency, only learns the commands run in this process
+
+// Line buffer for RadReadConsoleView, the same limit as cmd.exe
+const DWORD LineCapacity = 8192;
+TCHAR g_line[LineCapacity];
+
+// The rest of a line read as UTF-8 that didn't fit the callers buffer, kept for each input handle and returned by the
+// next reads of that handle before another line is read
+struct PendingLine
 {
-    _ASSERTE(begin <= end);
-    DWORD w = 0;
-    for (DWORD i = begin; i < end; ++i)
-        w += IsDoubleWidth(lpStr[i]) ? 2 : 1;
-    return w;
-}
+    HANDLE hInput;
+    std::tstring text;
+    size_t offset;
+};
 
-inline COORD GetConsoleCursorPosition(const HANDLE h)
+std::vector<PendingLine> g_pending_lines;
+
+PendingLine& GetPendingLine(const HANDLE hInput)
 {
-    CONSOLE_SCREEN_BUFFER_INFO bi = {};
-    GetConsoleScreenBufferInfo(h, &bi);
-    return bi.dwCursorPosition;
+    for (PendingLine& pending : g_pending_lines)
+        if (pending.hInput == hInput)
+            return pending;
+    g_pending_lines.push_back({ hInput, std::tstring(), 0 });
+    return g_pending_lines.back();
 }
 
-inline SMALL_RECT GetConsoleWindow(const HANDLE h)
+BOOL WriteTrace(HANDLE hFile)
 {
-    CONSOLE_SCREEN_BUFFER_INFO bi = {};
-    GetConsoleScreenBufferInfo(h, &bi);
-    return bi.srWindow;
+    std::string json;
+    Trace::g_recorder.Write(json, GetCurrentProcessId());
+    DWORD written = 0;
+    return WriteFile(hFile, json.data(), DWORD(json.size()), &written, nullptr) && written == json.size();
 }
 
-inline COORD Move(const HANDLE h, COORD p, SHORT d)
+// Set RAD_TRACE to a file name to trace the editor, the file is written when the process exits
+class TraceFile
 {
-    CONSOLE_SCREEN_BUFFER_INFO bi = {};
-    GetConsoleScreenBufferInfo(h, &bi);
-
-    p.X += d;
-    while (p.X < 0)
+public:
+    TraceFile()
     {
-        p.X += bi.dwSize.X;
-        --p.Y;
+        TCHAR filename[MAX_PATH] = TEXT("");
+        if (GetEnvironmentVariable(TEXT("RAD_TRACE"), ARRAY_X(filename)))
+        {
+            m_filename = filename;
+            Trace::Enable(true);
+        }
     }
-    while (p.X >= bi.dwSize.X)
+
+    ~TraceFile()
     {
-        p.X -= bi.dwSize.X;
-        ++p.Y;
+        if (m_filename.empty())
+            return;
+
+        std::unique_ptr<HANDLE, HANDLE_Deleter> hFile(CreateFile(m_filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (hFile.get() == INVALID_HANDLE_VALUE || !WriteTrace(hFile.get()))
+            OutputDebugString(TEXT("Error writing RAD_TRACE\n"));
     }
-    return p;
-}
 
-inline SHORT CalcScroll(const HANDLE h, COORD p, SHORT len)
-{
-    if (len < 0)
-        return 0;
-    const COORD endpos = Move(h, p, len);
-    const SMALL_RECT srWindow = GetConsoleWindow(h);
-    if (endpos.Y > srWindow.Bottom)
-        return endpos.Y - srWindow.Bottom;
-    else
-        return 0;
-}
+private:
+    std::tstring m_filename;
+};
 
-inline DWORD StrFind(LPCTSTR lpStr, LPDWORD lpLength, DWORD offset, TCHAR ch)
+TraceFile g_trace;
+
+// Seconds since 1601
+inline int64_t GetTimeSeconds()
 {
-    _ASSERTE(offset <= *lpLength);
-    while (offset < *lpLength && lpStr[offset] != ch)
-        ++offset;
-    return offset;
+    FILETIME ft = {};
+    GetSystemTimeAsFileTime(&ft);
+    ULARGE_INTEGER t;
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    return int64_t(t.QuadPart / 10000000);
 }
 
-inline void StrErase(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, DWORD length)
+FrecencyRank<TCHAR>::Id AddHistoryLocal(LPCTSTR lpStr, DWORD length)
 {
-    _ASSERTE(offset <= *lpLength);
-    _ASSERTE((offset + length) <= *lpLength);
-    tmemmove(lpStr + offset, BUFFER_X(lpStr, lpLength, offset + length));
-    *lpLength -= length;
+    g_history.push_front(lpStr, length);
+    g_history_index.Insert(lpStr, length, ++g_history_rank);
+    return g_frecency.Update(lpStr, length, GetTimeSeconds());
 }
 
-inline void StrInsert(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, TCHAR ch)
+// Set RAD_HISTORY_UTF8 to keep history as UTF-8, roughly halves the memory for mostly ASCII commands
+void InitHistory(const bool utf8)
 {
-    _ASSERTE(offset <= *lpLength);
-    tmemmove(lpStr + offset + 1, BUFFER_X(lpStr, lpLength, offset));
-    lpStr[offset] = ch;
-    ++(*lpLength);
+    if (g_history.empty())
+        g_history.SetUtf8(utf8);
 }
 
-inline DWORD StrInsert(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, LPCTSTR lpInsert)
+void InitHistory()
 {
-    _ASSERTE(offset <= *lpLength);
-    const DWORD length = DWORD(_tcslen(lpInsert));
-    tmemmove(lpStr + offset + length, BUFFER_X(lpStr, lpLength, offset));
-    tmemcpy(lpStr + offset, lpInsert, length);
-    *lpLength += length;
-    return length;
+    if (g_history.empty())
+        InitHistory(GetEnvironmentVariable(TEXT("RAD_HISTORY_UTF8"), nullptr, 0) != 0);
 }
 
-inline void StrOverwrite(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, TCHAR ch)
+void AddHistory(LPCTSTR lpStr, DWORD length)
 {
-    _ASSERTE(offset <= *lpLength);
-    lpStr[offset] = ch;
-    if (offset >= *lpLength)
-        *lpLength = offset + 1;
+    g_next_command.Add(AddHistoryLocal(lpStr, length));
+    if (g_shared_history.IsOpen())
+        g_shared_history.Append(lpStr, length);
 }
 
-inline void StrAppend(LPTSTR lpStr, LPDWORD lpLength, LPCTSTR text)
+// How often the shared history is imported while waiting for input
+const ULONGLONG SharedHistorySyncPeriod = 2000;
+
+void SyncSharedHistory()
 {
-    int i = 0;
-    while (text[i] != TEXT('\0'))
-        lpStr[(*lpLength)++] = text[i++];
+    if (g_shared_history.IsOpen())
+        g_shared_history.Sync(AddHistoryLocal);
 }
 
-inline void StrCopy(LPTSTR lpStr, LPDWORD lpLength, LPCTSTR text, DWORD length)
+// The command predicted to follow the ones just run, to suggest on an empty line
+bool PredictCommand(LPCTSTR* lplpEntry, size_t* pLength)
 {
-    tmemcpy(lpStr, text, length);
-    *lpLength = length;
+    const NextCommandModel::Id id = g_next_command.Predict();
+    if (id == NextCommandModel::NoId)
+        return false;
+    const std::pmr::tstring& text = g_frecency.Text(id);
+    *lplpEntry = text.data();
+    *pLength = text.length();
+    return true;
 }
 
-inline DWORD StrFindPrev(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, LPCTSTR find)
+// Position while navigating the history with Up/Down
+// Either most recent first or, with RAD_HISTORY_RANKED set, highest frecency first
+class HistoryCursor
 {
-    _ASSERTE(offset <= *lpLength);
-    _ASSERTE(offset > 0);
-
-    while (offset > 0 && _tcschr(TEXT(" "), lpStr[offset - 1]) != nullptr)
-        --offset;
+public:
+    HistoryCursor(bool ranked)
+        : m_ranked(ranked), m_pos(NoHistory)
+    {
+    }
+
+    bool IsActive() const { return m_pos != NoHistory; }
 
-    if (offset > 0 && _tcschr(find, lpStr[offset - 1]) != nullptr)
+    // Entries older than all the others leave the position alone, except in the frecency ranking
+    bool CanAddOlder() const { return !m_ranked || !IsActive(); }
+
+    bool Up(std::pmr::tstring& entry)
     {
-        while (offset > 0 && _tcschr(find, lpStr[offset - 1]) != nullptr)
-            --offset;
+        const size_t size = m_ranked ? g_frecency.size() : g_history.size();
+        if (m_pos == NoHistory ? size == 0 : (m_pos + 1) >= size)
+            return false;
+
+        if (m_pos == NoHistory)
+        {
+            m_pos = 0;
+            if (m_ranked)
+                m_it = g_frecency.begin();
+        }
+        else
+        {
+            ++m_pos;
+            if (m_ranked)
+                ++m_it;
+        }
+        Get(entry);
+        return true;
     }
-    else
+
+    bool Down(std::pmr::tstring& entry)
     {
-        while (offset > 0 && lpStr[offset - 1] != TEXT(' ') && _tcschr(find, lpStr[offset - 1]) == nullptr)
-            --offset;
+        if (m_pos == NoHistory || m_pos == 0)
+            return false;
+
+        --m_pos;
+        if (m_ranked)
+            --m_it;
+        Get(entry);
+        return true;
     }
-    return offset;
+
+    // Ranked browsing ends once the line is changed from the entry browsed to, the next Up starts from the top again
+    // Returns true if it ended
+    bool Leave(const std::tstring_view line, const std::pmr::tstring& entry)
+    {
+        if (!m_ranked || !IsActive() || line == std::tstring_view(entry))
+            return false;
+        m_pos = NoHistory;
+        return true;
+    }
+
+private:
+    static const size_t NoHistory = size_t(-1);
+
+    void Get(std::pmr::tstring& entry) const
+    {
+        if (m_ranked)
+            entry = g_frecency.Text(m_it);
+        else
+            g_history.Get(m_pos, entry);
+    }
+
+    bool m_ranked;
+    size_t m_pos;
+    FrecencyRank<TCHAR>::const_iterator m_it;   // Only used when m_ranked
+};
+
+// File name of the process, the console aliases belong to it
+LPTSTR GetExeName()
+{
+    static LPTSTR lpExeName = nullptr;
+    if (lpExeName == nullptr)
+    {
+        static TCHAR filename[MAX_PATH] = TEXT("");
+        GetModuleFileName(NULL, ARRAY_X(filename));
+        lpExeName = PathFindFileName(filename);
+    }
+    return lpExeName;
 }
 
-inline DWORD StrFindNext(LPTSTR lpStr, LPDWORD lpLength, DWORD offset, LPCTSTR find)
+template <class C>
+std::pmr::vector<std::pmr::basic_string<C>> split(const std::basic_string_view<C> str, const C delim, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
 {
-    _ASSERTE(offset <= *lpLength);
+    std::pmr::vector<std::pmr::basic_string<C>> result(resource);
+    size_t start = 0;
 
-    if (offset <= *lpLength && _tcschr(find, lpStr[offset]) != nullptr)
+    for (size_t found = str.find(delim); found != std::basic_string_view<C>::npos; found = str.find(delim, start))
     {
-        while (offset < *lpLength && _tcschr(find, lpStr[offset]) != nullptr)
-            ++offset;
+        result.emplace_back(str.substr(start, found - start));
+        start = found + 1;
     }
-    else
+    if (start != str.size())
+        result.emplace_back(str.substr(start));
+    return result;
+}
+
+template <class C>
+inline bool IsDoubleWidth(const C ch)
+{
+    return CharClass::Is(ch, CharClass::Control);
+}
+
+template <class C>
+inline bool IsPrintableAscii(const C ch)
+{
+    return CharClass::Is(ch, CharClass::Printable);
+}
+
+// The code page of CHAR text, the console input code page set by each read
+UINT g_code_page = CP_ACP;
+
+// The cursor only moves between grapheme clusters, or in CHAR text between the characters of the code page,
+// a UTF-8 sequence or a DBCS lead and trail byte
+template <class C>
+inline DWORD NextChar(const C* lpStr, const DWORD length, const DWORD i)
+{
+    return DWORD(Unicode::NextGrapheme(lpStr, length, i));
+}
+
+template <class C>
+inline DWORD PrevChar(const C* lpStr, const DWORD length, const DWORD i)
+{
+    return DWORD(Unicode::PrevGrapheme(lpStr, length, i));
+}
+
+inline bool IsUtf8Trail(const CHAR ch)
+{
+    return (BYTE(ch) & 0xC0) == 0x80;
+}
+
+inline DWORD NextChar(const CHAR* lpStr, const DWORD length, DWORD i)
+{
+    if (g_code_page == CP_UTF8)
     {
-        while (offset < *lpLength && lpStr[offset] != TEXT(' ') && _tcschr(find, lpStr[offset]) == nullptr)
-            ++offset;
+        const DWORD begin = i;
+        do
+            ++i;
+        while (i < length && (i - begin) < 4 && IsUtf8Trail(lpStr[i]));
+        return i;
     }
+    return IsDBCSLeadByteEx(g_code_page, BYTE(lpStr[i])) && (i + 1) < length ? i + 2 : i + 1;
+}
 
-    while (offset < *lpLength && _tcschr(TEXT(" "), lpStr[offset]) != nullptr)
-        ++offset;
+inline DWORD PrevChar(const CHAR* lpStr, const DWORD length, DWORD i)
+{
+    if (g_code_page == CP_UTF8)
+    {
+        const DWORD end = i;
+        do
+            --i;
+        while (i > 0 && (end - i) < 4 && IsUtf8Trail(lpStr[i]));
+        return i;
+    }
+    // A trail byte can have the value of a lead byte, so only stepping from the start finds where a character begins
+    DWORD prev = 0;
+    for (DWORD j = 0; j < i; j = NextChar(lpStr, length, j))
+        prev = j;
+    return prev;
+}
 
-    return offset;
+// Cells taken by the grapheme cluster from begin to end
+template <class C>
+inline DWORD GetGraphemePrintWidth(const C* lpStr, const DWORD begin, const DWORD end)
+{
+    if (IsDoubleWidth(lpStr[begin]))
+        return 2;
+    return std::max(1, Unicode::GetGraphemeWidth(lpStr + begin, end - begin));
 }
 
-inline SHORT ScreenMoveCursor(HANDLE hOutput, LPCTSTR lpCharBuffer, LPDWORD poffset, const DWORD newoffset)
+// A character of a DBCS code page takes a cell for each byte
+inline DWORD GetGraphemePrintWidth(const CHAR* lpStr, const DWORD begin, const DWORD end)
 {
-    const SHORT diff = newoffset < *poffset
-        ? -SHORT(GetPrintWidth(lpCharBuffer, newoffset, *poffset))
-        : SHORT(GetPrintWidth(lpCharBuffer, *poffset, newoffset));
-    const COORD pos = Move(hOutput, GetConsoleCursorPosition(hOutput), diff);
-    SetConsoleCursorPosition(hOutput, pos);
-    *poffset = newoffset;
-    return diff;
+    if (IsDoubleWidth(lpStr[begin]))
+        return 2;
+    if (g_code_page != CP_UTF8 || (end - begin) == 1)
+        return end - begin;
+
+    const DWORD length = end - begin;
+    char32_t c = BYTE(lpStr[begin]) & (0x7F >> length);
+    for (DWORD i = begin + 1; i < end; ++i)
+        c = (c << 6) | (BYTE(lpStr[i]) & 0x3F);
+    return DWORD(Unicode::GetWidth(c));
 }
 
-inline void ScreenEraseBack(HANDLE hOutput, LPTSTR lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, const DWORD length)
+template <class C>
+inline DWORD GetPrintWidth(const C* lpStr, const DWORD begin, const DWORD end)
 {
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
-    _ASSERTE(length <= *poffset);
-    const DWORD newoffset = *poffset - length;
-    const SHORT diff = ScreenMoveCursor(hOutput, lpCharBuffer, poffset, newoffset);
-    StrErase(lpCharBuffer, lpNumberOfCharsRead, newoffset, length);
-    const COORD pos = GetConsoleCursorPosition(hOutput);
-    DWORD written = 0;
-    RadWriteConsoleOutputCharacter(hOutput, lpCharBuffer + newoffset, *lpNumberOfCharsRead - newoffset, pos, &written);
-    FillConsoleOutputCharacter(hOutput, TEXT(' '), -diff, Move(hOutput, pos, SHORT(written)), &written);
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+    _ASSERTE(begin <= end);
+    DWORD w = 0;
+    for (DWORD i = begin; i < end;)
+    {
+        const DWORD next = NextChar(lpStr, end, i);
+        w += GetGraphemePrintWidth(lpStr, i, next);
+        i = next;
+    }
+    return w;
 }
 
-inline void ScreenEraseForward(HANDLE hOutput, LPTSTR lpCharBuffer, LPDWORD lpNumberOfCharsRead, const DWORD offset, const DWORD length)
+inline COORD GetConsoleCursorPosition(const HANDLE h)
 {
-    _ASSERTE(offset <= *lpNumberOfCharsRead);
-    _ASSERTE(length <= (*lpNumberOfCharsRead  - offset));
-    const DWORD newoffset = offset + length;
-    const DWORD width = GetPrintWidth(lpCharBuffer, offset, newoffset);
-    StrErase(lpCharBuffer, lpNumberOfCharsRead, offset, length);
-    const COORD pos = GetConsoleCursorPosition(hOutput);
-    DWORD written = 0;
-    RadWriteConsoleOutputCharacter(hOutput, lpCharBuffer + offset, *lpNumberOfCharsRead - offset, pos, &written);
-    FillConsoleOutputCharacter(hOutput, TEXT(' '), width, Move(hOutput, pos, SHORT(written)), &written);
-    _ASSERTE(offset <= *lpNumberOfCharsRead);
+    CONSOLE_SCREEN_BUFFER_INFO bi = {};
+    GetConsoleScreenBufferInfo(h, &bi);
+    return bi.dwCursorPosition;
 }
 
-inline void ScreenReplace(HANDLE hOutput, LPTSTR lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, LPCTSTR lpText, const DWORD length)
+inline SMALL_RECT GetConsoleWindow(const HANDLE h)
 {
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
-    const SHORT diff = SHORT(GetPrintWidth(lpCharBuffer, 0, *lpNumberOfCharsRead)) - SHORT(GetPrintWidth(lpText, 0, length));
-    ScreenMoveCursor(hOutput, lpCharBuffer, poffset, 0);
-    StrCopy(lpCharBuffer, lpNumberOfCharsRead, lpText, length);
-    RadWriteConsole(hOutput, lpCharBuffer, *lpNumberOfCharsRead, nullptr, nullptr);
-    if (diff > 0)
+    CONSOLE_SCREEN_BUFFER_INFO bi = {};
+    GetConsoleScreenBufferInfo(h, &bi);
+    return bi.srWindow;
+}
+
+inline COORD Move(COORD p, LONG d, const SHORT columns)
+{
+    LONG x = p.X + d;
+    LONG y = p.Y;
+    y += x / columns;
+    x %= columns;
+    if (x < 0)
     {
-        DWORD written = 0;
-        FillConsoleOutputCharacter(hOutput, TEXT(' '), diff, GetConsoleCursorPosition(hOutput), &written);
+        x += columns;
+        --y;
     }
-    *poffset = *lpNumberOfCharsRead;
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+    p.X = SHORT(x);
+    p.Y = SHORT(y);
+    return p;
 }
 
-inline void ScreenInsert(HANDLE hOutput, LPTSTR lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, LPCTSTR lpText)
+inline COORD Move(const HANDLE h, COORD p, SHORT d)
 {
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
-    const DWORD length = StrInsert(lpCharBuffer, lpNumberOfCharsRead, *poffset, lpText);
-    RadWriteConsole(hOutput, lpText, length, nullptr, nullptr);
-    *poffset += length;
+    CONSOLE_SCREEN_BUFFER_INFO bi = {};
+    GetConsoleScreenBufferInfo(h, &bi);
+    return Move(p, d, bi.dwSize.X);
+}
 
-    COORD pos = GetConsoleCursorPosition(hOutput);
-    RadWriteConsole(hOutput, BUFFER_X(lpCharBuffer, lpNumberOfCharsRead, *poffset), nullptr, nullptr);
-    pos.Y -= CalcScroll(hOutput, pos, (SHORT) (*lpNumberOfCharsRead - *poffset));
-    SetConsoleCursorPosition(hOutput, pos);
-    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+inline SHORT CalcScroll(const HANDLE h, COORD p, SHORT len)
+{
+    if (len < 0)
+        return 0;
+    const COORD endpos = Move(h, p, len);
+    const SMALL_RECT srWindow = GetConsoleWindow(h);
+    if (endpos.Y > srWindow.Bottom)
+        return endpos.Y - srWindow.Bottom;
+    else
+        return 0;
 }
 
+// The console functions for each character type, so the callers can be templates
+inline BOOL WriteConsoleT(HANDLE hConsoleOutput, const CHAR* lpBuffer, DWORD nLength, LPDWORD lpWritten, LPVOID lpReserved)
+{
+    return WriteConsoleA(hConsoleOutput, lpBuffer, nLength, lpWritten, lpReserved);
 }
 
-extern "C" {
+inline BOOL WriteConsoleT(HANDLE hConsoleOutput, const WCHAR* lpBuffer, DWORD nLength, LPDWORD lpWritten, LPVOID lpReserved)
+{
+    return WriteConsoleW(hConsoleOutput, lpBuffer, nLength, lpWritten, lpReserved);
+}
+
+inline BOOL WriteConsoleOutputCharacterT(HANDLE hConsoleOutput, const CHAR* lpCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpWritten)
+{
+    return WriteConsoleOutputCharacterA(hConsoleOutput, lpCharacter, nLength, dwWriteCoord, lpWritten);
+}
+
+inline BOOL WriteConsoleOutputCharacterT(HANDLE hConsoleOutput, const WCHAR* lpCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpWritten)
+{
+    return WriteConsoleOutputCharacterW(hConsoleOutput, lpCharacter, nLength, dwWriteCoord, lpWritten);
+}
+
+inline BOOL ReadConsoleOutputCharacterT(HANDLE hConsoleOutput, CHAR* lpCharacter, DWORD nLength, COORD dwReadCoord, LPDWORD lpNumberOfCharsRead)
+{
+    return ReadConsoleOutputCharacterA(hConsoleOutput, lpCharacter, nLength, dwReadCoord, lpNumberOfCharsRead);
+}
+
+inline BOOL ReadConsoleOutputCharacterT(HANDLE hConsoleOutput, WCHAR* lpCharacter, DWORD nLength, COORD dwReadCoord, LPDWORD lpNumberOfCharsRead)
+{
+    return ReadConsoleOutputCharacterW(hConsoleOutput, lpCharacter, nLength, dwReadCoord, lpNumberOfCharsRead);
+}
+
+inline BOOL ReadConsoleT(HANDLE hConsoleInput, CHAR* lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl)
+{
+    return ReadConsoleA(hConsoleInput, lpBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+}
+
+inline BOOL ReadConsoleT(HANDLE hConsoleInput, WCHAR* lpBuffer, DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead, PCONSOLE_READCONSOLE_CONTROL pInputControl)
+{
+    return ReadConsoleW(hConsoleInput, lpBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+}
+
+inline DWORD GetConsoleAliasT(CHAR* lpSource, CHAR* lpTargetBuffer, DWORD TargetBufferLength, CHAR* lpExeName)
+{
+    return GetConsoleAliasA(lpSource, lpTargetBuffer, TargetBufferLength, lpExeName);
+}
+
+inline DWORD GetConsoleAliasT(WCHAR* lpSource, WCHAR* lpTargetBuffer, DWORD TargetBufferLength, WCHAR* lpExeName)
+{
+    return GetConsoleAliasW(lpSource, lpTargetBuffer, TargetBufferLength, lpExeName);
+}
+
+template <class C>
+BOOL WriteConsoleText(HANDLE hConsoleOutput, const C* lpCharBuffer, DWORD nNumberOfCharsToWrite, LPDWORD lpNumberOfCharsWritten, LPVOID lpReserved)
+{
+    Trace::Span span("WriteConsole", "length", nNumberOfCharsToWrite);
+    if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten = 0;
+    DWORD NumberOfCharsWritten;
+    DWORD begin = 0;
+    for (DWORD end = begin; end < nNumberOfCharsToWrite; ++end)
+        if (IsDoubleWidth(lpCharBuffer[end]))
+        {
+            if (!WriteConsoleT(hConsoleOutput, lpCharBuffer + begin, end - begin, &NumberOfCharsWritten, lpReserved)) return FALSE;
+            if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
+            const C chevron[] = { C('^'), C(C('A') + lpCharBuffer[end] - 1) };
+            if (!WriteConsoleT(hConsoleOutput, ARRAY_X(chevron), &NumberOfCharsWritten, lpReserved)) return FALSE;
+            if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
+            begin = end + 1;
+        }
+    if (!WriteConsoleT(hConsoleOutput, lpCharBuffer + begin, nNumberOfCharsToWrite - begin, &NumberOfCharsWritten, lpReserved)) return FALSE;
+    if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
+    return TRUE;
+}
+
+template <class C>
+BOOL WriteConsoleOutputText(HANDLE hConsoleOutput, const C* lpCharacter, DWORD nLength, COORD dwWriteCoord, LPDWORD lpNumberOfCharsWritten)
+{
+    Trace::Span span("WriteConsoleOutputCharacter", "length", nLength);
+    *lpNumberOfCharsWritten = 0;
+    DWORD NumberOfCharsWritten;
+    DWORD begin = 0;
+    for (DWORD end = begin; end < nLength; ++end)
+        if (IsDoubleWidth(lpCharacter[end]))
+        {
+            if (!WriteConsoleOutputCharacterT(hConsoleOutput, lpCharacter + begin, end - begin, dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
+            NumberOfCharsWritten = GetPrintWidth(lpCharacter, begin, begin + NumberOfCharsWritten);
+            dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, SHORT(NumberOfCharsWritten));
+            *lpNumberOfCharsWritten += NumberOfCharsWritten;
+            const C chevron[] = { C('^'), C(C('A') + lpCharacter[end] - 1) };
+            if (!WriteConsoleOutputCharacterT(hConsoleOutput, ARRAY_X(chevron), dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
+            dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, SHORT(NumberOfCharsWritten));
+            *lpNumberOfCharsWritten += NumberOfCharsWritten;
+            begin = end + 1;
+        }
+    if (!WriteConsoleOutputCharacterT(hConsoleOutput, lpCharacter + begin, nLength - begin, dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
+    NumberOfCharsWritten = GetPrintWidth(lpCharacter, begin, begin + NumberOfCharsWritten);
+    //dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, NumberOfCharsWritten);
+    *lpNumberOfCharsWritten += NumberOfCharsWritten;
+    return TRUE;
+}
+
+template <class C>
+inline DWORD StrFind(const C* lpStr, LPDWORD lpLength, DWORD offset, C ch)
+{
+    _ASSERTE(offset <= *lpLength);
+    while (offset < *lpLength && lpStr[offset] != ch)
+        ++offset;
+    return offset;
+}
+
+template <class C>
+inline DWORD StrNextChar(const C* lpStr, LPDWORD lpLength, DWORD offset)
+{
+    _ASSERTE(offset < *lpLength);
+    return NextChar(lpStr, *lpLength, offset);
+}
+
+template <class C>
+inline DWORD StrPrevChar(const C* lpStr, LPDWORD lpLength, DWORD offset)
+{
+    _ASSERTE(offset <= *lpLength);
+    _ASSERTE(offset > 0);
+    return PrevChar(lpStr, *lpLength, offset);
+}
+
+template <class C>
+inline void StrErase(C* lpStr, LPDWORD lpLength, DWORD offset, DWORD length)
+{
+    _ASSERTE(offset <= *lpLength);
+    _ASSERTE((offset + length) <= *lpLength);
+    std::char_traits<C>::move(lpStr + offset, BUFFER_X(lpStr, lpLength, offset + length));
+    *lpLength -= length;
+}
+
+template <class C>
+inline void StrInsert(C* lpStr, LPDWORD lpLength, DWORD offset, C ch)
+{
+    _ASSERTE(offset <= *lpLength);
+    std::char_traits<C>::move(lpStr + offset + 1, BUFFER_X(lpStr, lpLength, offset));
+    lpStr[offset] = ch;
+    ++(*lpLength);
+}
+
+template <class C>
+inline DWORD StrInsert(C* lpStr, LPDWORD lpLength, DWORD offset, const C* lpInsert)
+{
+    _ASSERTE(offset <= *lpLength);
+    const DWORD length = DWORD(std::char_traits<C>::length(lpInsert));
+    std::char_traits<C>::move(lpStr + offset + length, BUFFER_X(lpStr, lpLength, offset));
+    std::char_traits<C>::copy(lpStr + offset, lpInsert, length);
+    *lpLength += length;
+    return length;
+}
+
+template <class C>
+inline void StrOverwrite(C* lpStr, LPDWORD lpLength, DWORD offset, C ch)
+{
+    _ASSERTE(offset <= *lpLength);
+    lpStr[offset] = ch;
+    if (offset >= *lpLength)
+        *lpLength = offset + 1;
+}
+
+template <class C>
+inline void StrAppend(C* lpStr, LPDWORD lpLength, const C* text)
+{
+    int i = 0;
+    while (text[i] != C('\0'))
+        lpStr[(*lpLength)++] = text[i++];
+}
+
+template <class C>
+inline void StrCopy(C* lpStr, LPDWORD lpLength, const C* text, DWORD length)
+{
+    std::char_traits<C>::copy(lpStr, text, length);
+    *lpLength = length;
+}
+
+// Word movement skips spaces then a run of CharClass::WordBreak characters or a run of any others
+template <class C>
+inline DWORD StrFindPrev(const C* lpStr, DWORD offset)
+{
+    _ASSERTE(offset > 0);
+
+    while (offset > 0 && CharClass::Is(lpStr[offset - 1], CharClass::Space))
+        --offset;
 
-BOOL WriteHistoryANSI(_In_ HANDLE hOutput);
+    if (offset > 0 && CharClass::Is(lpStr[offset - 1], CharClass::WordBreak))
+    {
+        while (offset > 0 && CharClass::Is(lpStr[offset - 1], CharClass::WordBreak))
+            --offset;
+    }
+    else
+    {
+        while (offset > 0 && !CharClass::Is(lpStr[offset - 1], CharClass::Class(CharClass::Space | CharClass::WordBreak)))
+            --offset;
+    }
+    return offset;
+}
+
+template <class C>
+inline DWORD StrFindNext(const C* lpStr, LPDWORD lpLength, DWORD offset)
+{
+    _ASSERTE(offset <= *lpLength);
+
+    if (offset < *lpLength && CharClass::Is(lpStr[offset], CharClass::WordBreak))
+    {
+        while (offset < *lpLength && CharClass::Is(lpStr[offset], CharClass::WordBreak))
+            ++offset;
+    }
+    else
+    {
+        while (offset < *lpLength && !CharClass::Is(lpStr[offset], CharClass::Class(CharClass::Space | CharClass::WordBreak)))
+            ++offset;
+    }
+
+    while (offset < *lpLength && CharClass::Is(lpStr[offset], CharClass::Space))
+        ++offset;
+
+    return offset;
+}
+
+// Converts between the console code page and UTF-16, returns the number of characters written to lpOut or 0 if it doesn't fit
+inline int ConvertText(const UINT CodePage, const CHAR* lpText, const int length, WCHAR* lpOut, const int capacity)
+{
+    return MultiByteToWideChar(CodePage, 0, lpText, length, lpOut, capacity);
+}
+
+inline int ConvertText(const UINT CodePage, const WCHAR* lpText, const int length, CHAR* lpOut, const int capacity)
+{
+    return WideCharToMultiByte(CodePage, 0, lpText, length, lpOut, capacity, nullptr, nullptr);
+}
+
+// The text as To, the history and the completions are kept as TCHAR while the editor works on the callers character type.
+// Only text of the other type is converted, into buffer.
+template <class To, class From>
+std::basic_string_view<To> TextAs(const From* lpText, const size_t length, std::pmr::basic_string<To>& buffer)
+{
+    if constexpr (std::is_same<To, From>::value)
+        return std::basic_string_view<To>(lpText, length);
+    else
+    {
+        // Worst case is a 4 byte GB18030 sequence for each UTF-16 code unit
+        buffer.resize(sizeof(To) < sizeof(From) ? length * 4 : length);
+        buffer.resize(length > 0 ? ConvertText(g_code_page, lpText, int(length), &buffer[0], int(buffer.size())) : 0);
+        return buffer;
+    }
+}
+
+// As much of the text as fits in capacity characters, without splitting a character
+template <class C>
+std::basic_string_view<C> FitText(const std::basic_string_view<C> text, const DWORD capacity)
+{
+    if (text.length() <= capacity)
+        return text;
+    const DWORD length = DWORD(text.length());
+    DWORD end = capacity;
+    if (end > 0)
+    {
+        const DWORD prev = PrevChar(text.data(), length, end);
+        if (NextChar(text.data(), length, prev) != end)
+            end = prev;
+    }
+    return text.substr(0, end);
+}
+
+// Copies as much of the text as fits in lpBuffer, converted through the console code page for the other character type
+// without splitting a character. Returns the characters of lpText taken, 0 if not even one fits.
+template <class C>
+DWORD CopyText(LPCTSTR lpText, const DWORD length, C* lpBuffer, const DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead)
+{
+    if constexpr (std::is_same<C, TCHAR>::value)
+    {
+        const DWORD count = std::min(nNumberOfCharsToRead, length);
+        std::char_traits<TCHAR>::copy(lpBuffer, lpText, count);
+        *lpNumberOfCharsRead = count;
+        return count;
+    }
+    else
+    {
+        // A character can take more than one unit in C. Each TCHAR takes at least one so no more than
+        // nNumberOfCharsToRead are tried.
+        DWORD count = std::min(length, nNumberOfCharsToRead);
+        if (count > 0 && count < length)
+        {
+            const DWORD prev = PrevChar(lpText, length, count);
+            if (NextChar(lpText, length, prev) != count)
+                count = prev;
+        }
+        int converted = 0;
+        while (count > 0 && (converted = ConvertText(g_code_page, lpText, int(count), lpBuffer, int(nNumberOfCharsToRead))) == 0)
+            count = PrevChar(lpText, length, count);
+        *lpNumberOfCharsRead = DWORD(converted);
+        return count;
+    }
+}
+
+// The characters typed by each key, in the callers character type
+// A character taking two TCHAR, outside the BMP or a DBCS one, comes as two keys and is only converted once both are in
+template <class C>
+class KeyChars
+{
+public:
+    static const int MaxChars = 4;
+
+    KeyChars()
+        : m_lead(TEXT('\0'))
+    {
+    }
+
+    // Returns the number of characters written to text, followed by a null, 0 if the key doesn't type one yet
+    DWORD Convert(const TCHAR ch, C (&text)[MaxChars + 1])
+    {
+        if constexpr (std::is_same<C, TCHAR>::value)
+        {
+            text[0] = ch;
+            text[1] = C('\0');
+            return 1;
+        }
+        else
+        {
+            if (m_lead == TEXT('\0') && IsLead(ch))
+            {
+                m_lead = ch;
+                return 0;
+            }
+            const TCHAR chars[] = { m_lead, ch };
+            const bool pair = m_lead != TEXT('\0');
+            m_lead = TEXT('\0');
+            const int length = ConvertText(g_code_page, pair ? chars : chars + 1, pair ? 2 : 1, text, MaxChars);
+            text[length] = C('\0');
+            return DWORD(length);
+        }
+    }
+
+private:
+    static bool IsLead(const WCHAR ch) { return ch >= 0xD800 && ch < 0xDC00; }
+    static bool IsLead(const CHAR ch) { return IsDBCSLeadByteEx(g_code_page, BYTE(ch)) != FALSE; }
+
+    TCHAR m_lead;
+};
+
+// Writes a row of the line unless the screen already shows it
+template <class C>
+class ScreenRowWriter
+{
+public:
+    explicit ScreenRowWriter(std::pmr::memory_resource* resource)
+        : m_text(resource), m_screen(resource)
+    {
+    }
+
+    void Clear()
+    {
+        m_text.clear();
+    }
+
+    // Characters as RadWriteConsole shows them
+    void Append(const C* lpCharBuffer, const DWORD begin, const DWORD end)
+    {
+        if (IsDoubleWidth(lpCharBuffer[begin]))
+        {
+            m_text.push_back(C('^'));
+            m_text.push_back(C(C('A') + lpCharBuffer[begin] - 1));
+        }
+        else
+            m_text.append(lpCharBuffer + begin, end - begin);
+    }
+
+    // Shows the characters appended, from begin to end of lpCharBuffer, at pos and blanks the rest of the row
+    // Returns whether anything was written
+    bool Write(HANDLE hOutput, const COORD pos, const SHORT columns, const C* lpCharBuffer, const DWORD begin, const DWORD end)
+    {
+        const DWORD cells = DWORD(columns - pos.X);
+        if (m_text.length() < cells)
+            m_text.resize(cells, C(' '));
+        m_screen.resize(cells);
+        DWORD read = 0;
+        if (ReadConsoleOutputCharacterT(hOutput, m_screen.data(), cells, pos, &read)
+            && read == cells && m_text.compare(0, cells, m_screen.data(), cells) == 0)
+            return false;
+
+        DWORD used = 0;
+        if (end > begin)
+            WriteConsoleOutputText(hOutput, lpCharBuffer + begin, end - begin, pos, &used);
+        if (used < cells)
+        {
+            DWORD filled = 0;
+            FillConsoleOutputCharacter(hOutput, TEXT(' '), cells - used, Move(pos, used, columns), &filled);
+        }
+        return true;
+    }
+
+private:
+    std::pmr::basic_string<C> m_text;
+    std::pmr::vector<C> m_screen;
+};
+
+// Opt-in multi-line editing, set RAD_MULTILINE
+// Ctrl+Enter inserts a newline and each line starts on a row of its own.
+// An edit only lays out and draws the lines it touched, and the lines after them if the rows they start on moved.
+template <class C>
+class ScreenLines
+{
+public:
+    explicit ScreenLines(std::pmr::memory_resource* resource)
+        : m_enabled(false), m_columns(0), m_drawn(0), m_index(resource), m_rows(resource), m_counted(resource), m_row(resource)
+    {
+        m_anchor.X = m_anchor.Y = 0;
+    }
+
+    bool IsEnabled() const { return m_enabled; }
+    SHORT Columns() const { return m_columns; }
+    size_t Lines() const { return m_index.Lines(); }
+    size_t Line(const DWORD offset) const { return m_index.Find(offset); }
+    DWORD LineStart(const DWORD offset) const { return DWORD(m_index.Start(m_index.Find(offset))); }
+    DWORD LineEnd(const DWORD offset, const DWORD length) const { return DWORD(m_index.End(m_index.Find(offset), length)); }
+
+    // The cursor is at offset, the initial text before it is taken to be on the screen already
+    void Enable(HANDLE hOutput, const C* lpCharBuffer, const DWORD length, const DWORD offset)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        m_enabled = true;
+        m_columns = bi.dwSize.X;
+        m_anchor = Move(bi.dwCursorPosition, -LONG(GetPrintWidth(lpCharBuffer, 0, offset)), m_columns);
+        m_index.Reset(lpCharBuffer, length);
+        Layout(lpCharBuffer, length);
+        m_drawn = 0;
+        Draw(hOutput, lpCharBuffer, length, 0, m_index.Lines());
+        SetCursor(hOutput, lpCharBuffer, offset);
+    }
+
+    COORD Position(const C* lpCharBuffer, const DWORD offset) const
+    {
+        const size_t line = m_index.Find(offset);
+        const LONG cells = Origin(line) + LONG(GetPrintWidth(lpCharBuffer, DWORD(m_index.Start(line)), offset));
+        COORD pos;
+        pos.X = SHORT(cells % m_columns);
+        pos.Y = SHORT(m_anchor.Y + RowOf(line) + cells / m_columns);
+        return pos;
+    }
+
+    void SetCursor(HANDLE hOutput, const C* lpCharBuffer, const DWORD offset) const
+    {
+        SetConsoleCursorPosition(hOutput, Position(lpCharBuffer, offset));
+    }
+
+    // The offset in the line above or below closest to the same column, there must be such a line
+    DWORD Vertical(const C* lpCharBuffer, const DWORD length, const DWORD offset, const bool up) const
+    {
+        const size_t line = m_index.Find(offset);
+        _ASSERTE(up ? line > 0 : (line + 1) < m_index.Lines());
+        const size_t target = up ? line - 1 : line + 1;
+        const LONG column = Origin(line) + LONG(GetPrintWidth(lpCharBuffer, DWORD(m_index.Start(line)), offset));
+        const DWORD end = DWORD(m_index.End(target, length));
+        LONG cell = Origin(target);
+        DWORD i = DWORD(m_index.Start(target));
+        while (i < end)
+        {
+            const DWORD next = NextChar(lpCharBuffer, end, i);
+            cell += GetGraphemePrintWidth(lpCharBuffer, i, next);
+            if (cell > column)
+                break;
+            i = next;
+        }
+        return i;
+    }
+
+    // Call after the erased characters at offset have been replaced by the inserted ones
+    void Edit(HANDLE hOutput, const C* lpCharBuffer, const DWORD length, const DWORD offset, const DWORD erased, const DWORD inserted)
+    {
+        const size_t first = m_index.Find(offset);
+        const size_t last = m_index.Find(offset + erased);
+        const LONG before = m_rows.Sum(last + 1) - m_rows.Sum(first);
+
+        m_index.Erase(offset, erased);
+        m_index.Insert(offset, lpCharBuffer + offset, inserted);
+
+        const size_t newlast = m_index.Find(offset + inserted);
+        m_counted.clear();
+        for (size_t line = first; line <= newlast; ++line)
+            m_counted.push_back(CountRows(lpCharBuffer, length, line));
+        m_rows.Replace(first, last + 1, m_counted.data(), m_counted.size());
+        const LONG after = m_rows.Sum(newlast + 1) - m_rows.Sum(first);
+
+        Draw(hOutput, lpCharBuffer, length, first, after == before ? newlast + 1 : m_index.Lines());
+    }
+
+    // Lays the lines out again when the width of the console changes, returns whether anything was drawn
+    bool Reflow(HANDLE hOutput, const C* lpCharBuffer, const DWORD length, const DWORD offset, const DWORD extra)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        const SHORT columns = bi.dwSize.X;
+        if (columns == m_columns)
+            return false;
+
+        const COORD cursor = Position(lpCharBuffer, offset);
+        const bool moved = bi.dwCursorPosition.X != cursor.X || bi.dwCursorPosition.Y != cursor.Y;
+        const LONG drawn = m_drawn + (LONG(extra) + m_columns - 1) / m_columns;
+
+        // Either the console wrapped the old rows again or left them as they were
+        m_drawn = moved ? drawn * ((m_columns + columns - 1) / columns) : drawn;
+        m_anchor.X = moved ? SHORT(m_anchor.X % columns) : std::min(m_anchor.X, SHORT(columns - 1));
+        m_columns = columns;
+        Layout(lpCharBuffer, length);
+        if (moved)
+            m_anchor.Y = SHORT(m_anchor.Y + bi.dwCursorPosition.Y - Position(lpCharBuffer, offset).Y);
+
+        Draw(hOutput, lpCharBuffer, length, 0, m_index.Lines());
+        SetCursor(hOutput, lpCharBuffer, offset);
+        return true;
+    }
+
+private:
+    // Cells before the line on its first row
+    LONG Origin(const size_t line) const
+    {
+        return line == 0 ? m_anchor.X : 0;
+    }
+
+    // Rows from the anchor to the start of line
+    LONG RowOf(const size_t line) const
+    {
+        return m_rows.Sum(line);
+    }
+
+    LONG CountRows(const C* lpCharBuffer, const DWORD length, const size_t line) const
+    {
+        return (Origin(line) + LONG(GetPrintWidth(lpCharBuffer, DWORD(m_index.Start(line)), DWORD(m_index.End(line, length))))) / m_columns + 1;
+    }
+
+    void Layout(const C* lpCharBuffer, const DWORD length)
+    {
+        m_counted.clear();
+        for (size_t line = 0; line < m_index.Lines(); ++line)
+            m_counted.push_back(CountRows(lpCharBuffer, length, line));
+        m_rows.Assign(m_counted.data(), m_counted.size());
+    }
+
+    // Draws the lines from first up to end, after the last line blanks the rest of the rows drawn before
+    void Draw(HANDLE hOutput, const C* lpCharBuffer, const DWORD length, const size_t first, const size_t end)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        const LONG total = RowOf(m_index.Lines());
+        Scroll(hOutput, bi.dwSize.Y, total);
+
+        LONG row = RowOf(first);
+        for (size_t line = first; line < end; ++line)
+        {
+            // A character that doesn't fit at the end of a row pushes the start of the next one along
+            const DWORD lineend = DWORD(m_index.End(line, length));
+            DWORD i = DWORD(m_index.Start(line));
+            LONG cell = Origin(line);
+            for (LONG r = 0; r < m_rows[line]; ++r, ++row)
+            {
+                const LONG rowbegin = r * m_columns;
+                COORD pos;
+                pos.X = SHORT(std::max(cell, rowbegin) - rowbegin);
+                pos.Y = SHORT(m_anchor.Y + row);
+
+                const DWORD begin = i;
+                m_row.Clear();
+                while (i < lineend && cell < (rowbegin + m_columns))
+                {
+                    const DWORD next = NextChar(lpCharBuffer, lineend, i);
+                    m_row.Append(lpCharBuffer, i, next);
+                    cell += GetGraphemePrintWidth(lpCharBuffer, i, next);
+                    i = next;
+                }
+
+                if (pos.Y >= 0 && pos.Y < bi.dwSize.Y && pos.X < m_columns)
+                    m_row.Write(hOutput, pos, m_columns, lpCharBuffer, begin, i);
+            }
+        }
+
+        if (end == m_index.Lines())
+        {
+            for (; row < m_drawn; ++row)
+            {
+                COORD pos;
+                pos.X = row == 0 ? m_anchor.X : 0;
+                pos.Y = SHORT(m_anchor.Y + row);
+                m_row.Clear();
+                if (pos.Y >= 0 && pos.Y < bi.dwSize.Y)
+                    m_row.Write(hOutput, pos, m_columns, lpCharBuffer, 0, 0);
+            }
+            m_drawn = total;
+        }
+    }
+
+    // Scrolls the screen buffer up when the lines would run past the bottom of it
+    void Scroll(HANDLE hOutput, const SHORT height, const LONG rows)
+    {
+        const LONG over = LONG(m_anchor.Y) + rows - height;
+        if (over <= 0)
+            return;
+
+        COORD bottom;
+        bottom.X = 0;
+        bottom.Y = SHORT(height - 1);
+        SetConsoleCursorPosition(hOutput, bottom);
+        for (LONG i = 0; i < over; ++i)
+        {
+            DWORD written = 0;
+            WriteConsole(hOutput, TEXT("\n"), 1, &written, nullptr);
+        }
+        m_anchor.Y = SHORT(m_anchor.Y - over);
+    }
+
+    bool m_enabled;
+    SHORT m_columns;
+    COORD m_anchor;         // Screen position of the start of the buffer
+    LONG m_drawn;           // Rows from the anchor drawn last
+    LineIndex<C> m_index;
+    PrefixSums<LONG> m_rows;        // Rows taken by each line
+    std::pmr::vector<LONG> m_counted;
+    ScreenRowWriter<C> m_row;
+};
+
+template <class C>
+inline SHORT ScreenMoveCursor(HANDLE hOutput, const ScreenLines<C>& lines, const C* lpCharBuffer, LPDWORD poffset, const DWORD newoffset)
+{
+    if (lines.IsEnabled())
+    {
+        *poffset = newoffset;
+        lines.SetCursor(hOutput, lpCharBuffer, newoffset);
+        return 0;
+    }
+
+    const SHORT diff = newoffset < *poffset
+        ? -SHORT(GetPrintWidth(lpCharBuffer, newoffset, *poffset))
+        : SHORT(GetPrintWidth(lpCharBuffer, *poffset, newoffset));
+    const COORD pos = Move(hOutput, GetConsoleCursorPosition(hOutput), diff);
+    SetConsoleCursorPosition(hOutput, pos);
+    *poffset = newoffset;
+    return diff;
+}
+
+template <class C>
+inline void ScreenEraseBack(HANDLE hOutput, ScreenLines<C>& lines, C* lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, const DWORD length)
+{
+    Trace::Span span("ScreenEraseBack");
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+    _ASSERTE(length <= *poffset);
+    const DWORD newoffset = *poffset - length;
+    if (lines.IsEnabled())
+    {
+        StrErase(lpCharBuffer, lpNumberOfCharsRead, newoffset, length);
+        lines.Edit(hOutput, lpCharBuffer, *lpNumberOfCharsRead, newoffset, length, 0);
+        ScreenMoveCursor(hOutput, lines, lpCharBuffer, poffset, newoffset);
+        return;
+    }
+    const SHORT diff = ScreenMoveCursor(hOutput, lines, lpCharBuffer, poffset, newoffset);
+    StrErase(lpCharBuffer, lpNumberOfCharsRead, newoffset, length);
+    const COORD pos = GetConsoleCursorPosition(hOutput);
+    DWORD written = 0;
+    WriteConsoleOutputText(hOutput, lpCharBuffer + newoffset, *lpNumberOfCharsRead - newoffset, pos, &written);
+    FillConsoleOutputCharacter(hOutput, TEXT(' '), -diff, Move(hOutput, pos, SHORT(written)), &written);
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+}
+
+template <class C>
+inline void ScreenEraseForward(HANDLE hOutput, ScreenLines<C>& lines, C* lpCharBuffer, LPDWORD lpNumberOfCharsRead, const DWORD offset, const DWORD length)
+{
+    Trace::Span span("ScreenEraseForward");
+    _ASSERTE(offset <= *lpNumberOfCharsRead);
+    _ASSERTE(length <= (*lpNumberOfCharsRead  - offset));
+    if (lines.IsEnabled())
+    {
+        StrErase(lpCharBuffer, lpNumberOfCharsRead, offset, length);
+        lines.Edit(hOutput, lpCharBuffer, *lpNumberOfCharsRead, offset, length, 0);
+        lines.SetCursor(hOutput, lpCharBuffer, offset);
+        return;
+    }
+    const DWORD newoffset = offset + length;
+    const DWORD width = GetPrintWidth(lpCharBuffer, offset, newoffset);
+    StrErase(lpCharBuffer, lpNumberOfCharsRead, offset, length);
+    const COORD pos = GetConsoleCursorPosition(hOutput);
+    DWORD written = 0;
+    WriteConsoleOutputText(hOutput, lpCharBuffer + offset, *lpNumberOfCharsRead - offset, pos, &written);
+    FillConsoleOutputCharacter(hOutput, TEXT(' '), width, Move(hOutput, pos, SHORT(written)), &written);
+    _ASSERTE(offset <= *lpNumberOfCharsRead);
+}
+
+template <class C>
+inline void ScreenReplace(HANDLE hOutput, ScreenLines<C>& lines, C* lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, const C* lpText, const DWORD length)
+{
+    Trace::Span span("ScreenReplace");
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+    if (lines.IsEnabled())
+    {
+        const DWORD erased = *lpNumberOfCharsRead;
+        StrCopy(lpCharBuffer, lpNumberOfCharsRead, lpText, length);
+        lines.Edit(hOutput, lpCharBuffer, *lpNumberOfCharsRead, 0, erased, length);
+        ScreenMoveCursor(hOutput, lines, lpCharBuffer, poffset, *lpNumberOfCharsRead);
+        return;
+    }
+    const SHORT diff = SHORT(GetPrintWidth(lpCharBuffer, 0, *lpNumberOfCharsRead)) - SHORT(GetPrintWidth(lpText, 0, length));
+    ScreenMoveCursor(hOutput, lines, lpCharBuffer, poffset, 0);
+    StrCopy(lpCharBuffer, lpNumberOfCharsRead, lpText, length);
+    WriteConsoleText(hOutput, lpCharBuffer, *lpNumberOfCharsRead, nullptr, nullptr);
+    if (diff > 0)
+    {
+        DWORD written = 0;
+        FillConsoleOutputCharacter(hOutput, TEXT(' '), diff, GetConsoleCursorPosition(hOutput), &written);
+    }
+    *poffset = *lpNumberOfCharsRead;
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+}
+
+template <class C>
+inline void ScreenInsert(HANDLE hOutput, ScreenLines<C>& lines, C* lpCharBuffer, LPDWORD lpNumberOfCharsRead, LPDWORD poffset, const C* lpText)
+{
+    Trace::Span span("ScreenInsert");
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+    const DWORD length = StrInsert(lpCharBuffer, lpNumberOfCharsRead, *poffset, lpText);
+    if (lines.IsEnabled())
+    {
+        lines.Edit(hOutput, lpCharBuffer, *lpNumberOfCharsRead, *poffset, 0, length);
+        ScreenMoveCursor(hOutput, lines, lpCharBuffer, poffset, *poffset + length);
+        return;
+    }
+    WriteConsoleText(hOutput, lpText, length, nullptr, nullptr);
+    *poffset += length;
+
+    COORD pos = GetConsoleCursorPosition(hOutput);
+    WriteConsoleText(hOutput, BUFFER_X(lpCharBuffer, lpNumberOfCharsRead, *poffset), nullptr, nullptr);
+    pos.Y -= CalcScroll(hOutput, pos, (SHORT) GetPrintWidth(lpCharBuffer, *poffset, *lpNumberOfCharsRead));
+    SetConsoleCursorPosition(hOutput, pos);
+    _ASSERTE(*poffset <= *lpNumberOfCharsRead);
+}
+
+// Opt-in command line highlighting, set RAD_HIGHLIGHT
+// Only the token span affected by an edit is re-lexed and only cells whose attribute differs are written
+template <class C>
+class ScreenHighlight
+{
+public:
+    explicit ScreenHighlight(std::pmr::memory_resource* resource)
+        : m_enabled(false), m_base(0), m_invalid(0), m_highlighter(resource), m_want(resource), m_have(resource)
+    {
+    }
+
+    void Enable(HANDLE hOutput)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        m_base = bi.wAttributes;
+        m_enabled = true;
+    }
+
+    // Screen attributes from offset on were reset by writing the text again
+    void Invalidate(const DWORD offset)
+    {
+        m_invalid = std::min(m_invalid, offset);
+    }
+
+    // from is the first offset that may have been written to since the last call
+    void Paint(HANDLE hOutput, const ScreenLines<C>& lines, const C* lpCharBuffer, const DWORD length, const DWORD offset, DWORD from)
+    {
+        if (!m_enabled)
+            return;
+        Trace::Span span("Highlight");
+
+        from = std::min({ from, m_invalid, DWORD(m_highlighter.Update(lpCharBuffer, length)) });
+        m_invalid = MAXDWORD;
+        if (from >= length)
+            return;
+        if (from > 0)
+            from = PrevChar(lpCharBuffer, length, from + 1);
+
+        COORD pos;
+        SHORT columns = 0;      // Only with multiple lines, where a newline takes the rest of its row
+        if (lines.IsEnabled())
+        {
+            pos = lines.Position(lpCharBuffer, from);
+            columns = lines.Columns();
+        }
+        else
+        {
+            const SHORT diff = from < offset
+                ? -SHORT(GetPrintWidth(lpCharBuffer, from, offset))
+                : SHORT(GetPrintWidth(lpCharBuffer, offset, from));
+            pos = Move(hOutput, GetConsoleCursorPosition(hOutput), diff);
+        }
+
+        const typename Highlighter<C>::eToken* tokens = m_highlighter.Tokens();
+        m_want.clear();
+        SHORT column = pos.X;
+        for (DWORD i = from; i < length;)
+        {
+            const DWORD next = NextChar(lpCharBuffer, length, i);
+            const DWORD width = columns > 0 && lpCharBuffer[i] == C('\n')
+                ? DWORD(columns - column)
+                : GetGraphemePrintWidth(lpCharBuffer, i, next);
+            m_want.insert(m_want.end(), width, Attribute(tokens[i]));
+            if (columns > 0)
+                column = SHORT((column + width) % columns);
+            i = next;
+        }
+
+        m_have.resize(m_want.size());
+        DWORD read = 0;
+        if (!ReadConsoleOutputAttribute(hOutput, m_have.data(), DWORD(m_have.size()), pos, &read))
+            return;
+
+        for (DWORD i = 0; i < read;)
+        {
+            if (m_have[i] == m_want[i])
+            {
+                ++i;
+                continue;
+            }
+
+            DWORD end = i + 1;
+            while (end < read && m_have[end] != m_want[end])
+                ++end;
+            DWORD written = 0;
+            WriteConsoleOutputAttribute(hOutput, m_want.data() + i, end - i, Move(hOutput, pos, SHORT(i)), &written);
+            i = end;
+        }
+    }
+
+private:
+    WORD Attribute(const typename Highlighter<C>::eToken token) const
+    {
+        const WORD background = m_base & (BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED | BACKGROUND_INTENSITY);
+        switch (token)
+        {
+        case Highlighter<C>::COMMAND:   return background | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+        case Highlighter<C>::STRING:    return background | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+        case Highlighter<C>::REDIRECT:  return background | FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+        case Highlighter<C>::VARIABLE:  return background | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+        default:                            return m_base;
+        }
+    }
+
+    bool m_enabled;
+    WORD m_base;
+    DWORD m_invalid;
+    Highlighter<C> m_highlighter;
+    std::pmr::vector<WORD> m_want;
+    std::pmr::vector<WORD> m_have;
+};
+
+// Opt-in inline suggestion of the most recent history entry starting with the line, set RAD_AUTOSUGGEST
+// On an empty line it is the command predicted to follow the last ones run
+// Shown dimmed after the end of the line and accepted with Right or End
+template <class C>
+class ScreenSuggest
+{
+public:
+    explicit ScreenSuggest(std::pmr::memory_resource* resource)
+        : m_enabled(false), m_base(0), m_text(resource), m_width(0), m_line(resource), m_converted(resource)
+    {
+        m_pos.X = m_pos.Y = 0;
+    }
+
+    void Enable(HANDLE hOutput)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        m_base = bi.wAttributes;
+        m_enabled = true;
+    }
+
+    bool HasSuggestion() const { return !m_text.empty(); }
+    const std::pmr::basic_string<C>& Text() const { return m_text; }
+    DWORD Width() const { return m_width; }
+
+    // The screen was redrawn over the suggestion
+    void Discard()
+    {
+        m_text.clear();
+        m_width = 0;
+    }
+
+    void Update(HANDLE hOutput, const ScreenLines<C>& lines, const C* lpCharBuffer, const DWORD length, const DWORD offset, const DWORD capacity)
+    {
+        if (!m_enabled)
+            return;
+
+        // Found as TCHAR, the rest of the entry after the line is shown as C
+        std::basic_string_view<C> rest;
+        if (offset == length)
+        {
+            LPCTSTR lpEntry = nullptr;
+            size_t entrylength = 0;
+            const std::tstring_view line = TextAs<TCHAR>(lpCharBuffer, length, m_line);
+            if ((length > 0 ? g_history_index.Find(line.data(), line.length(), &lpEntry, &entrylength) : PredictCommand(&lpEntry, &entrylength))
+                && entrylength > line.length()
+                && std::find(lpEntry + line.length(), lpEntry + entrylength, TEXT('\n')) == (lpEntry + entrylength))
+                rest = TextAs<C>(lpEntry + line.length(), entrylength - line.length(), m_converted);
+        }
+
+        if (!rest.empty() && (length + rest.length()) < capacity)
+        {
+            const COORD pos = GetConsoleCursorPosition(hOutput);
+            if (m_width > 0 && pos.X == m_pos.X && pos.Y == m_pos.Y && m_text.compare(0, m_text.length(), rest.data(), rest.length()) == 0)
+                return;
+
+            Clear(hOutput, pos);
+            m_text.assign(rest.data(), rest.length());
+            m_pos = pos;
+            WriteConsoleOutputText(hOutput, m_text.data(), DWORD(m_text.length()), m_pos, &m_width);
+            DWORD written = 0;
+            FillConsoleOutputAttribute(hOutput, Attribute(), m_width, m_pos, &written);
+        }
+        else if (m_width > 0)
+        {
+            const COORD end = lines.IsEnabled()
+                ? lines.Position(lpCharBuffer, length)
+                : Move(hOutput, GetConsoleCursorPosition(hOutput), SHORT(GetPrintWidth(lpCharBuffer, offset, length)));
+            Clear(hOutput, end);
+        }
+    }
+
+    void Clear(HANDLE hOutput)
+    {
+        Clear(hOutput, m_pos);
+    }
+
+private:
+    WORD Attribute() const
+    {
+        return (m_base & (BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED | BACKGROUND_INTENSITY)) | FOREGROUND_INTENSITY;
+    }
+
+    // Erase the suggestion from the screen, except any part that is now covered by the line ending at end
+    void Clear(HANDLE hOutput, const COORD end)
+    {
+        if (m_width > 0)
+        {
+            CONSOLE_SCREEN_BUFFER_INFO bi = {};
+            GetConsoleScreenBufferInfo(hOutput, &bi);
+            const LONG begin = std::max(LONG(m_pos.Y) * bi.dwSize.X + m_pos.X, LONG(end.Y) * bi.dwSize.X + end.X);
+            const LONG last = LONG(m_pos.Y) * bi.dwSize.X + m_pos.X + LONG(m_width);
+            if (begin < last)
+            {
+                COORD pos;
+                pos.X = SHORT(begin % bi.dwSize.X);
+                pos.Y = SHORT(begin / bi.dwSize.X);
+                DWORD written = 0;
+                FillConsoleOutputCharacter(hOutput, TEXT(' '), DWORD(last - begin), pos, &written);
+                FillConsoleOutputAttribute(hOutput, m_base, DWORD(last - begin), pos, &written);
+            }
+        }
+        m_text.clear();
+        m_width = 0;
+    }
+
+    bool m_enabled;
+    WORD m_base;
+    std::pmr::basic_string<C> m_text;
+    COORD m_pos;
+    DWORD m_width;
+    std::pmr::tstring m_line;
+    std::pmr::basic_string<C> m_converted;
+};
+
+// Wrapped layout of the line on the screen, to reflow it when the console is resized
+template <class C>
+class ScreenLayout
+{
+public:
+    explicit ScreenLayout(std::pmr::memory_resource* resource)
+        : m_columns(0), m_row(resource)
+    {
+        m_cursor.X = m_cursor.Y = 0;
+    }
+
+    // Call after every change, records the layout a resize starts from
+    void Track(HANDLE hOutput)
+    {
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        m_columns = bi.dwSize.X;
+        m_cursor = bi.dwCursorPosition;
+    }
+
+    // Lays the line out again for the new width, extra is the number of cells shown after the line
+    // Only rows whose text on the screen differs are written, returns whether anything was written
+    bool Reflow(HANDLE hOutput, const C* lpCharBuffer, const DWORD length, const DWORD offset, const DWORD extra)
+    {
+        Trace::Span span("Reflow");
+        CONSOLE_SCREEN_BUFFER_INFO bi = {};
+        GetConsoleScreenBufferInfo(hOutput, &bi);
+        const SHORT columns = bi.dwSize.X;
+        if (columns == m_columns || m_columns == 0)
+        {
+            Track(hOutput);
+            return false;
+        }
+
+        const LONG before = GetPrintWidth(lpCharBuffer, 0, offset);
+        const LONG total = GetPrintWidth(lpCharBuffer, 0, length);
+        COORD start;
+        LONG stale;     // Cells from the start of the first row that may hold old text
+        if (bi.dwCursorPosition.X == m_cursor.X && bi.dwCursorPosition.Y == m_cursor.Y)
+        {
+            // The console didn't reflow its contents, the line is still laid out for the old width
+            start = Move(m_cursor, -before, m_columns);
+            const LONG rows = (start.X + total + LONG(extra) + m_columns - 1) / m_columns;
+            start.X = std::min(start.X, SHORT(columns - 1));
+            stale = rows * columns;
+        }
+        else
+        {
+            start = Move(bi.dwCursorPosition, -before, columns);
+            stale = start.X + total + LONG(extra);
+        }
+
+        const LONG rows = std::max(LONG(1), (std::max(stale, start.X + total) + columns - 1) / columns);
+        bool written = false;
+        LONG cell = 0;      // From the start of the line
+        DWORD i = 0;
+        for (LONG row = 0; row < rows; ++row)
+        {
+            // A character that doesn't fit at the end of a row pushes the start of the next one along
+            const LONG rowbegin = row * columns - start.X;
+            const LONG rowend = rowbegin + columns;
+            COORD pos;
+            pos.X = SHORT(std::max(cell, rowbegin) - rowbegin);
+            pos.Y = SHORT(start.Y + row);
+
+            const DWORD begin = i;
+            m_row.Clear();
+            while (i < length && cell < rowend)
+            {
+                const DWORD next = NextChar(lpCharBuffer, length, i);
+                m_row.Append(lpCharBuffer, i, next);
+                cell += GetGraphemePrintWidth(lpCharBuffer, i, next);
+                i = next;
+            }
+
+            if (pos.Y < 0 || pos.Y >= bi.dwSize.Y || pos.X >= columns)
+                continue;
+
+            if (m_row.Write(hOutput, pos, columns, lpCharBuffer, begin, i))
+                written = true;
+        }
+
+        SetConsoleCursorPosition(hOutput, Move(start, before, columns));
+        Track(hOutput);
+        return written;
+    }
+
+private:
+    SHORT m_columns;
+    COORD m_cursor;
+    ScreenRowWriter<C> m_row;
+};
+
+bool ReadFileBytes(LPCTSTR lpFileName, std::vector<uint8_t>& data)
+{
+    std::unique_ptr<HANDLE, HANDLE_Deleter> hFile(CreateFile(lpFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (hFile.get() == INVALID_HANDLE_VALUE)
+    {
+        hFile.release();
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(hFile.get(), &size) || size.HighPart != 0)
+        return false;
+    data.resize(size.LowPart);
+    DWORD read = 0;
+    return data.empty() || (ReadFile(hFile.get(), data.data(), DWORD(data.size()), &read, nullptr) && read == data.size());
+}
+
+// Written to a temporary file named for the process and renamed over the file, so another process
+// never reads half a file and two processes saving at once don't write to the same temporary file
+bool WriteFileBytes(LPCTSTR lpFileName, const std::vector<uint8_t>& data)
+{
+    TCHAR id[16] = TEXT("");
+    _ultot_s(GetCurrentProcessId(), id, 10);
+    const std::tstring temp = std::tstring(lpFileName) + TEXT('.') + id + TEXT(".tmp");
+    {
+        std::unique_ptr<HANDLE, HANDLE_Deleter> hFile(CreateFile(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (hFile.get() == INVALID_HANDLE_VALUE)
+        {
+            hFile.release();
+            return false;
+        }
+
+        DWORD written = 0;
+        if (!WriteFile(hFile.get(), data.data(), DWORD(data.size()), &written, nullptr) || written != data.size())
+        {
+            hFile.reset();
+            DeleteFile(temp.c_str());
+            return false;
+        }
+    }
+    if (!MoveFileEx(temp.c_str(), lpFileName, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Opt-in completion of the first word with Tab from PATH, PATHEXT and the console aliases, set RAD_COMMAND_INDEX
+// The executables are kept in a CommandIndex cached in %LOCALAPPDATA%\RadReadConsole and refreshed on a
+// background thread, so only directories whose modified time changed are listed again.
+// The thread shares ownership of the index and names, so it can outlive the completer at exit,
+// it is told to stop and then only finishes the directory it is listing and doesn't save the cache.
+class CommandCompleter
+{
+public:
+    static const ULONGLONG RefreshInterval = 60 * 1000;
+
+    CommandCompleter()
+        : m_state(std::make_shared<State>()), m_refreshed(0)
+    {
+    }
+
+    ~CommandCompleter()
+    {
+        InterlockedExchange(&m_state->stopped, 1);
+    }
+
+    // Starts a background refresh unless one is running or finished recently
+    void Refresh()
+    {
+        const ULONGLONG now = GetTickCount64();
+        if (m_refreshed != 0 && (now - m_refreshed) < RefreshInterval)
+            return;
+        if (InterlockedCompareExchange(&m_state->running, 1, 0) != 0)
+            return;
+
+        m_refreshed = now;
+        std::shared_ptr<State>* pState = new std::shared_ptr<State>(m_state);
+        const HANDLE hThread = CreateThread(nullptr, 0, RefreshThread, pState, 0, nullptr);
+        if (hThread)
+            CloseHandle(hThread);
+        else
+        {
+            delete pState;
+            InterlockedExchange(&m_state->running, 0);
+        }
+    }
+
+    // Commands and aliases starting with prefix
+    void Find(LPCTSTR lpPrefix, const DWORD length, CommandNames<TCHAR>& matches)
+    {
+        matches.clear();
+
+        std::shared_ptr<const CommandNames<TCHAR>> names;
+        AcquireSRWLockShared(&m_state->lock);
+        names = m_state->names;
+        ReleaseSRWLockShared(&m_state->lock);
+        if (names)
+        {
+            const std::pair<size_t, size_t> found = names->Find(lpPrefix, length);
+            for (size_t i = found.first; i < found.second; ++i)
+                matches.Add((*names)[i].data(), (*names)[i].length());
+        }
+
+        // Aliases are read each time as they can be changed at any time
+        const LPTSTR lpExeName = GetExeName();
+        const DWORD bytes = GetConsoleAliasesLength(lpExeName);
+        if (bytes > 0)
+        {
+            // Each alias is source=target and null terminated
+            m_aliases.assign(bytes / sizeof(TCHAR) + 1, TEXT('\0'));
+            if (!GetConsoleAliases(m_aliases.data(), bytes, lpExeName))
+                m_aliases.clear();
+            for (LPCTSTR p = m_aliases.data(); p < (m_aliases.data() + m_aliases.size()) && *p != TEXT('\0'); p += _tcslen(p) + 1)
+            {
+                const LPCTSTR lpEquals = _tcschr(p, TEXT('='));
+                const DWORD namelength = lpEquals != nullptr ? DWORD(lpEquals - p) : DWORD(_tcslen(p));
+                if (namelength >= length && CommandNames<TCHAR>::Compare(p, length, lpPrefix, length) == 0)
+                    matches.Add(p, namelength);
+            }
+        }
+
+        matches.Sort();
+    }
+
+private:
+    struct State
+    {
+        State()
+            : running(0), stopped(0), loaded(false)
+        {
+            InitializeSRWLock(&lock);
+        }
+
+        SRWLOCK lock;
+        std::shared_ptr<const CommandNames<TCHAR>> names;   // Guarded by lock
+        volatile LONG running;
+        volatile LONG stopped;
+        // Only used by the refresh thread
+        bool loaded;
+        CommandIndex<TCHAR> index;
+    };
+
+    static DWORD WINAPI RefreshThread(LPVOID lpParameter)
+    {
+        Trace::SetThreadName("CommandIndex");
+        const std::unique_ptr<std::shared_ptr<State>> pState(static_cast<std::shared_ptr<State>*>(lpParameter));
+        State& state = **pState;
+        {
+            Trace::Span span("RefreshCommands");
+            RefreshIndex(state);
+        }
+        InterlockedExchange(&state.running, 0);
+        return 0;
+    }
+
+    static bool GetCacheFileName(std::tstring& filename)
+    {
+        TCHAR dir[MAX_PATH] = TEXT("");
+        if (!GetEnvironmentVariable(TEXT("LOCALAPPDATA"), ARRAY_X(dir)))
+            return false;
+        filename = dir;
+        filename += TEXT("\\RadReadConsole");
+        CreateDirectory(filename.c_str(), nullptr);
+        filename += TEXT("\\commands.cache");
+        return true;
+    }
+
+    static std::vector<std::tstring> GetEnvironmentList(LPCTSTR lpName, LPCTSTR lpDefault)
+    {
+        std::tstring value(lpDefault);
+        const DWORD length = GetEnvironmentVariable(lpName, nullptr, 0);
+        if (length > 0)
+        {
+            value.resize(length);
+            value.resize(GetEnvironmentVariable(lpName, &value[0], length));
+        }
+
+        std::vector<std::tstring> list;
+        for (std::pmr::tstring& item : split(std::tstring_view(value), TEXT(';')))
+        {
+            item.erase(std::remove(item.begin(), item.end(), TEXT('"')), item.end());
+            if (!item.empty())
+                list.emplace_back(item.data(), item.length());
+        }
+        return list;
+    }
+
+    static bool GetDirectoryTime(const std::tstring& dir, uint64_t* pTime)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA data = {};
+        if (!GetFileAttributesEx(dir.c_str(), GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            return false;
+        *pTime = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    static bool ListDirectory(const std::tstring& dir, std::vector<std::tstring>& files)
+    {
+        std::tstring pattern(dir);
+        if (pattern.back() != TEXT('\\'))
+            pattern += TEXT('\\');
+        pattern += TEXT('*');
+
+        WIN32_FIND_DATA fd = {};
+        std::unique_ptr<HANDLE, FIND_Deleter> hFind(FindFirstFileEx(pattern.c_str(), FindExInfoBasic, &fd, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH));
+        if (hFind.get() == INVALID_HANDLE_VALUE)
+        {
+            hFind.release();
+            return false;
+        }
+
+        do
+        {
+            if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                files.push_back(fd.cFileName);
+        } while (FindNextFile(hFind.get(), &fd));
+        return true;
+    }
+
+    // Only ever runs on one thread at a time
+    static void RefreshIndex(State& state)
+    {
+        std::tstring filename;
+        const bool cached = GetCacheFileName(filename);
+
+        if (!state.loaded)
+        {
+            // Complete from the cache while directories are checked
+            std::vector<uint8_t> data;
+            if (cached && ReadFileBytes(filename.c_str(), data) && state.index.Load(data.data(), data.size()))
+                Publish(state);
+            state.loaded = true;
+        }
+
+        const std::vector<std::tstring> dirs = GetEnvironmentList(TEXT("PATH"), TEXT(""));
+        const std::vector<std::tstring> exts = GetEnvironmentList(TEXT("PATHEXT"), TEXT(".COM;.EXE;.BAT;.CMD"));
+        const auto list = [&state](const std::tstring& dir, std::vector<std::tstring>& files)
+            { return state.stopped == 0 && ListDirectory(dir, files); };
+        const bool changed = state.index.Refresh(dirs, exts, GetDirectoryTime, list);
+        if (state.stopped != 0)
+            return;     // Directories skipped after stopping would be saved as empty
+        if (changed || !state.names)
+        {
+            Publish(state);
+            if (cached)
+            {
+                std::vector<uint8_t> data;
+                state.index.Save(data);
+                WriteFileBytes(filename.c_str(), data);
+            }
+        }
+    }
+
+    static void Publish(State& state)
+    {
+        std::shared_ptr<CommandNames<TCHAR>> names = std::make_shared<CommandNames<TCHAR>>();
+        state.index.GetNames(*names);
+        AcquireSRWLockExclusive(&state.lock);
+        state.names = names;
+        ReleaseSRWLockExclusive(&state.lock);
+    }
+
+    const std::shared_ptr<State> m_state;
+    ULONGLONG m_refreshed;
+    // Only used by the editor
+    std::vector<TCHAR> m_aliases;
+};
+
+CommandCompleter g_commands;
+
+// Cycles through the commands starting with the first word on each Tab, Shift+Tab goes back
+class CommandCycle
+{
+public:
+    CommandCycle()
+        : m_active(false), m_index(0)
+    {
+    }
+
+    bool IsActive() const { return m_active; }
+    void Reset() { m_active = false; }
+
+    // Returns the command to replace the first word with, nullptr if there is none
+    const std::tstring* Next(LPCTSTR lpPrefix, const DWORD length, const bool back)
+    {
+        if (!m_active)
+        {
+            g_commands.Find(lpPrefix, length, m_matches);
+            if (m_matches.size() == 0)
+                return nullptr;
+            m_active = true;
+            m_index = back ? m_matches.size() - 1 : 0;
+        }
+        else if (back)
+            m_index = (m_index + m_matches.size() - 1) % m_matches.size();
+        else
+            m_index = (m_index + 1) % m_matches.size();
+        return &m_matches[m_index];
+    }
+
+private:
+    bool m_active;
+    size_t m_index;
+    CommandNames<TCHAR> m_matches;
+};
+
+// Input records for the editor, running posted work and timers while it waits for them
+// Set RAD_INPUT_THREAD to read the console on a separate thread in batches through a SpscQueue
+// The thread only runs during a read and stops taking records after an Enter until the editor asks for more, so
+// what is typed after the line stays on the console for whoever reads it next. Any records it took but the editor
+// didn't use go back to the console.
+class EditorInput
+{
+public:
+    static const size_t QueueSize = 1024;
+    static const DWORD BatchSize = 64;
+
+    EditorInput()
+        : m_hConsoleInput(NULL), m_queue(QueueSize), m_waiting(false), m_paused(false), m_failed(false)
+    {
+        InitializeSRWLock(&m_lock);
+        m_hWork.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+    }
+
+    ~EditorInput()
+    {
+        Stop();
+    }
+
+    void Start(HANDLE hConsoleInput, bool threaded)
+    {
+        m_hConsoleInput = hConsoleInput;
+        if (!threaded)
+            return;
+
+        m_hStop.reset(CreateEvent(nullptr, TRUE, FALSE, nullptr));
+        m_hAvailable.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+        m_hSpace.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+        m_hResume.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+        if (!m_hStop || !m_hAvailable || !m_hSpace || !m_hResume)
+        {
+            OutputDebugString(TEXT("Error CreateEvent\n"));
+            return;
+        }
+        m_failed = false;
+        m_hThread.reset(CreateThread(nullptr, 0, ReaderThread, this, 0, nullptr));
+        if (!m_hThread)
+            OutputDebugString(TEXT("Error CreateThread\n"));
+    }
+
+    void Stop()
+    {
+        if (!m_hThread)
+            return;
+
+        SetEvent(m_hStop.get());
+        WaitForSingleObject(m_hThread.get(), INFINITE);
+        m_hThread.reset();
+
+        INPUT_RECORD ir[BatchSize];
+        size_t count = 0;
+        while ((count = m_queue.Pop(ARRAY_X(ir))) > 0)
+        {
+            DWORD written = 0;
+            if (!WriteConsoleInput(m_hConsoleInput, ir, DWORD(count), &written))
+                OutputDebugString(TEXT("Error WriteConsoleInput\n"));
+        }
+    }
+
+    // Any thread, f runs on the editor thread while it waits for input
+    void Post(std::function<void()> f)
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        m_work.push_back(std::move(f));
+        ReleaseSRWLockExclusive(&m_lock);
+        SetEvent(m_hWork.get());
+    }
+
+    // Editor thread only, f runs every period milliseconds while waiting for input
+    void SetTimer(const ULONGLONG period, std::function<void()> f)
+    {
+        m_timers.push_back({ GetTickCount64() + period, period, std::move(f) });
+    }
+
+    BOOL Read(INPUT_RECORD* pir)
+    {
+        Trace::Span span("ReadInput");
+        while (true)
+        {
+            if (m_queue.Pop(pir, 1) == 1)
+            {
+                if (m_hThread && m_waiting.exchange(false))
+                    SetEvent(m_hSpace.get());
+                return TRUE;
+            }
+            if (m_hThread && m_failed)
+                return FALSE;
+            if (m_hThread && m_paused.exchange(false))
+                SetEvent(m_hResume.get());
+
+            RunWork();
+            const DWORD timeout = RunTimers();
+            const HANDLE handles[] = { m_hThread ? m_hAvailable.get() : m_hConsoleInput, m_hWork.get() };
+            const DWORD wait = WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, timeout);
+            if (wait == WAIT_FAILED)
+                return FALSE;
+            if (wait == WAIT_OBJECT_0 && !m_hThread)
+            {
+                DWORD read = 0;
+                return ReadConsoleInput(m_hConsoleInput, pir, 1, &read);
+            }
+        }
+    }
+
+    // Drops the records of type already waiting, without waiting for more
+    void Skip(const WORD type)
+    {
+        INPUT_RECORD ir = {};
+        while (Peek(&ir) && ir.EventType == type)
+            Read(&ir);
+    }
+
+private:
+    struct Timer
+    {
+        ULONGLONG due;
+        ULONGLONG period;
+        std::function<void()> f;
+    };
+
+    static bool IsEnter(const INPUT_RECORD& ir)
+    {
+        return ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown && ir.Event.KeyEvent.wVirtualKeyCode == VK_RETURN;
+    }
+
+    bool Peek(INPUT_RECORD* pir)
+    {
+        if (m_queue.Peek(pir, 1) == 1)
+            return true;
+        if (m_hThread)
+            return false;
+
+        DWORD read = 0;
+        return PeekConsoleInput(m_hConsoleInput, pir, 1, &read) && read == 1;
+    }
+
+    void RunWork()
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        m_running.swap(m_work);
+        ReleaseSRWLockExclusive(&m_lock);
+        for (const std::function<void()>& f : m_running)
+            f();
+        m_running.clear();
+    }
+
+    // Returns the time until the next timer is due
+    DWORD RunTimers()
+    {
+        DWORD timeout = INFINITE;
+        const ULONGLONG now = GetTickCount64();
+        for (Timer& t : m_timers)
+        {
+            if (t.due <= now)
+            {
+                t.f();
+                t.due = now + t.period;
+            }
+            timeout = std::min(timeout, DWORD(t.due - now));
+        }
+        return timeout;
+    }
+
+    DWORD Fail()
+    {
+        m_failed = true;
+        SetEvent(m_hAvailable.get());
+        return 0;
+    }
+
+    static DWORD WINAPI ReaderThread(LPVOID lpParameter)
+    {
+        Trace::SetThreadName("Input");
+        EditorInput* self = static_cast<EditorInput*>(lpParameter);
+        const HANDLE hStop = self->m_hStop.get();
+        INPUT_RECORD batch[BatchSize];
+        while (true)
+        {
+            // Only take records off the console once there is room for them
+            while (self->m_queue.Free() == 0)
+            {
+                self->m_waiting = true;
+                if (self->m_queue.Free() != 0)
+                    break;
+                const HANDLE handles[] = { hStop, self->m_hSpace.get() };
+                if (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != (WAIT_OBJECT_0 + 1))
+                    return 0;
+            }
+
+            const HANDLE handles[] = { hStop, self->m_hConsoleInput };
+            if (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != (WAIT_OBJECT_0 + 1))
+                return 0;
+
+            // Only up to the first Enter, it may end the line
+            Trace::Span span("ReadConsoleInput");
+            DWORD read = 0;
+            if (!PeekConsoleInput(self->m_hConsoleInput, batch, DWORD(std::min(self->m_queue.Free(), size_t(BatchSize))), &read))
+                return self->Fail();
+            const INPUT_RECORD* end = std::find_if(batch, batch + read, IsEnter);
+            const bool enter = end != batch + read;
+            if (read > 0 && !ReadConsoleInput(self->m_hConsoleInput, batch, DWORD(end - batch + enter), &read))
+                return self->Fail();
+            // Set before the Enter can be read, so the editor sees it once it wants more
+            self->m_paused = enter;
+            self->m_queue.Push(batch, read);
+            SetEvent(self->m_hAvailable.get());
+
+            if (enter)
+            {
+                const HANDLE handles[] = { hStop, self->m_hResume.get() };
+                if (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != (WAIT_OBJECT_0 + 1))
+                    return 0;
+            }
+        }
+    }
+
+    HANDLE m_hConsoleInput;
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hThread;
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hStop;
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hAvailable;   // Records pushed
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hSpace;       // Records popped while the reader waited for room
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hResume;      // The editor wants records after an Enter
+    SpscQueue<INPUT_RECORD> m_queue;
+    std::atomic<bool> m_waiting;
+    std::atomic<bool> m_paused;
+    std::atomic<bool> m_failed;
+
+    SRWLOCK m_lock;
+    std::vector<std::function<void()>> m_work;      // Guarded by m_lock
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hWork;
+    std::vector<std::function<void()>> m_running;
+    std::vector<Timer> m_timers;
+};
+
+// A history file has an entry on each line, a newline or carriage return in an entry is written as \n or \r.
+// A backslash is only doubled where it would otherwise be read as one of those, so paths look the same in the file.
+// Files written that way start with HistoryFileHeader on a line of its own, those without it are read as they are.
+const TCHAR HistoryFileHeader[] = TEXT("#RadReadConsole history 2");
+
+inline bool IsHistoryEscape(const TCHAR c)
+{
+    return c == TEXT('n') || c == TEXT('r') || c == TEXT('\\');
+}
+
+void EscapeHistoryEntry(const std::tstring& entry, std::tstring& line)
+{
+    line.clear();
+    for (size_t i = 0; i < entry.length(); ++i)
+    {
+        const TCHAR c = entry[i];
+        if (c == TEXT('\n'))
+            line += TEXT("\\n");
+        else if (c == TEXT('\r'))
+            line += TEXT("\\r");
+        else
+        {
+            line += c;
+            if (c == TEXT('\\') && (i + 1) < entry.length()
+                && (IsHistoryEscape(entry[i + 1]) || entry[i + 1] == TEXT('\n') || entry[i + 1] == TEXT('\r')))
+                line += c;
+        }
+    }
+    line += TEXT('\n');
+}
+
+// Appends the entry on the line of length characters at lpLine to text
+void UnescapeHistoryEntry(const TCHAR* lpLine, const size_t length, std::vector<TCHAR>& text)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        TCHAR c = lpLine[i];
+        if (c == TEXT('\\') && (i + 1) < length && IsHistoryEscape(lpLine[i + 1]))
+        {
+            c = lpLine[++i];
+            c = c == TEXT('n') ? TEXT('\n') : c == TEXT('r') ? TEXT('\r') : c;
+        }
+        text.push_back(c);
+    }
+}
+
+// Loads a history file written by WriteHistory for RadLoadHistory, on a thread of its own from the end of the file.
+// The thread only reads and splits the file, the editor thread adds each chunk of entries while a read waits for input,
+// as older than all the others so entries run while loading stay the most recent.
+class HistoryLoader
+{
+public:
+    // Characters read at a time, so also about the most added between two keys
+    static const DWORD ChunkSize = 16 * 1024;
+
+    HistoryLoader()
+        : m_input(nullptr), m_cursor(nullptr), m_posted(false), m_stop(false), m_time(0), m_rank(0)
+    {
+        InitializeSRWLock(&m_lock);
+    }
+
+    ~HistoryLoader()
+    {
+        m_stop = true;
+        Join();
+    }
+
+    // One file at a time
+    BOOL Start(LPCTSTR lpFileName)
+    {
+        if (m_hThread)
+        {
+            if (WaitForSingleObject(m_hThread.get(), 0) != WAIT_OBJECT_0)
+                return FALSE;
+            Join();
+        }
+
+        m_hFile.reset(CreateFile(lpFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (m_hFile.get() == INVALID_HANDLE_VALUE)
+        {
+            m_hFile.release();
+            return FALSE;
+        }
+
+        // The file has no times, the newest entry counts as run when the load started and each one before it a second earlier
+        m_time = GetTimeSeconds();
+        m_hThread.reset(CreateThread(nullptr, 0, LoadThread, this, 0, nullptr));
+        if (!m_hThread)
+        {
+            OutputDebugString(TEXT("Error CreateThread\n"));
+            m_hFile.reset();
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    // Editor thread, chunks are added while input waits, unless they would move the cursor
+    // nullptr when the read returns
+    void Attach(EditorInput* input, const HistoryCursor* cursor)
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        m_input = input;
+        m_cursor = cursor;
+        m_posted = false;
+        if (!m_chunks.empty())
+            PostAdd();
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    // Editor thread, once the cursor can take older entries again after AddNext left them
+    void Resume()
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        if (!m_chunks.empty())
+            PostAdd();
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    // Editor thread, waits for the rest of the file and adds it
+    void Finish()
+    {
+        Join();
+        Chunk chunk;
+        while (Pop(chunk))
+            Add(chunk);
+    }
+
+private:
+    struct Chunk
+    {
+        std::vector<TCHAR> text;    // The entries one after the other, oldest first
+        std::vector<DWORD> ends;    // End of each entry in text
+    };
+
+    void Join()
+    {
+        if (m_hThread)
+        {
+            WaitForSingleObject(m_hThread.get(), INFINITE);
+            m_hThread.reset();
+            m_hFile.reset();
+        }
+    }
+
+    bool Pop(Chunk& chunk)
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        const bool popped = !m_chunks.empty();
+        if (popped)
+        {
+            chunk = std::move(m_chunks.front());
+            m_chunks.pop_front();
+        }
+        ReleaseSRWLockExclusive(&m_lock);
+        return popped;
+    }
+
+    // m_lock held, one post at a time adds a single chunk and posts again while there are more
+    void PostAdd()
+    {
+        if (!m_posted && m_input != nullptr)
+        {
+            m_posted = true;
+            m_input->Post([this]() { AddNext(); });
+        }
+    }
+
+    void AddNext()
+    {
+        Chunk chunk;
+        bool popped = false;
+        AcquireSRWLockExclusive(&m_lock);
+        m_posted = false;
+        if (!m_chunks.empty() && (m_cursor == nullptr || m_cursor->CanAddOlder()))
+        {
+            chunk = std::move(m_chunks.front());
+            m_chunks.pop_front();
+            popped = true;
+            if (!m_chunks.empty())
+                PostAdd();
+        }
+        ReleaseSRWLockExclusive(&m_lock);
+        if (popped)
+            Add(chunk);
+    }
+
+    // Newest first, below the rank of every entry added with AddHistory
+    void Add(const Chunk& chunk)
+    {
+        Trace::Span span("HistoryLoadAdd", "entries", int64_t(chunk.ends.size()));
+        InitHistory();
+        for (size_t i = chunk.ends.size(); i-- > 0;)
+        {
+            const DWORD begin = i > 0 ? chunk.ends[i - 1] : 0;
+            const LPCTSTR lpStr = chunk.text.data() + begin;
+            const DWORD length = chunk.ends[i] - begin;
+            g_history.push_back(lpStr, length);
+            g_history_index.Insert(lpStr, length, --m_rank);
+            g_next_command.AddOlder(g_frecency.Update(lpStr, length, m_time--));
+        }
+    }
+
+    void Push(Chunk& chunk)
+    {
+        AcquireSRWLockExclusive(&m_lock);
+        m_chunks.push_back(std::move(chunk));
+        PostAdd();
+        ReleaseSRWLockExclusive(&m_lock);
+    }
+
+    static DWORD WINAPI LoadThread(LPVOID lpParameter)
+    {
+        Trace::SetThreadName("HistoryLoad");
+        static_cast<HistoryLoader*>(lpParameter)->Load();
+        return 0;
+    }
+
+    // Reads count characters from begin into text
+    bool ReadAt(const LONGLONG begin, const DWORD count, std::vector<TCHAR>& text)
+    {
+        text.resize(count);
+        LARGE_INTEGER pos;
+        pos.QuadPart = begin * sizeof(TCHAR);
+        DWORD read = 0;
+        if (!SetFilePointerEx(m_hFile.get(), pos, nullptr, FILE_BEGIN)
+            || !ReadFile(m_hFile.get(), text.data(), count * sizeof(TCHAR), &read, nullptr) || read != count * sizeof(TCHAR))
+        {
+            OutputDebugString(TEXT("Error reading history file\n"));
+            return false;
+        }
+        return true;
+    }
+
+    void Load()
+    {
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(m_hFile.get(), &size))
+            return;
+
+        std::vector<TCHAR> text;
+        LONGLONG end = size.QuadPart / sizeof(TCHAR);
+
+        // The header with its newline in place of the nul, the entries start after it
+        const DWORD header = ARRAYSIZE(HistoryFileHeader);
+        LONGLONG first = 0;
+        if (end >= header)
+        {
+            if (!ReadAt(0, header, text))
+                return;
+            if (std::equal(HistoryFileHeader, HistoryFileHeader + header - 1, text.begin()) && text[header - 1] == TEXT('\n'))
+                first = header;
+        }
+        const bool escaped = first > 0;
+
+        std::vector<TCHAR> tail;    // Start of the text read last, the end of an entry that starts before it
+        while (end > first && !m_stop)
+        {
+            Trace::Span span("HistoryLoadRead");
+            const LONGLONG begin = std::max(end - LONGLONG(ChunkSize), first);
+            if (!ReadAt(begin, DWORD(end - begin), text))
+                return;
+            text.insert(text.end(), tail.begin(), tail.end());
+            end = begin;
+
+            // Unless at the first entry the text up to the first newline is the end of an earlier entry
+            size_t start = 0;
+            if (begin > first)
+            {
+                start = size_t(std::find(text.begin(), text.end(), TEXT('\n')) - text.begin());
+                if (start == text.size())
+                {
+                    tail.swap(text);
+                    continue;
+                }
+                tail.assign(text.begin(), text.begin() + start);
+                ++start;
+            }
+            else
+                tail.clear();
+
+            Chunk chunk;
+            chunk.text.reserve(text.size() - start);
+            while (start < text.size())
+            {
+                const size_t next = size_t(std::find(text.begin() + start, text.end(), TEXT('\n')) - text.begin());
+                size_t length = next - start;
+                if (length > 0 && text[start + length - 1] == TEXT('\r'))
+                    --length;
+                if (length > 0)
+                {
+                    if (escaped)
+                        UnescapeHistoryEntry(text.data() + start, length, chunk.text);
+                    else
+                        chunk.text.insert(chunk.text.end(), text.begin() + start, text.begin() + start + length);
+                    chunk.ends.push_back(DWORD(chunk.text.size()));
+                }
+                start = next + 1;
+            }
+            if (!chunk.ends.empty())
+                Push(chunk);
+        }
+    }
+
+    SRWLOCK m_lock;
+    std::deque<Chunk> m_chunks;         // Guarded by m_lock
+    EditorInput* m_input;               // Guarded by m_lock
+    const HistoryCursor* m_cursor;      // Guarded by m_lock
+    bool m_posted;                      // Guarded by m_lock
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hThread;
+    std::unique_ptr<HANDLE, HANDLE_Deleter> m_hFile;
+    std::atomic<bool> m_stop;
+    int64_t m_time;
+    int64_t m_rank;
+};
+
+HistoryLoader g_history_loader;
+
+// Lets the history loader add entries while a read waits for input
+class AttachHistoryLoader
+{
+public:
+    AttachHistoryLoader(EditorInput& input, const HistoryCursor& cursor)
+    {
+        g_history_loader.Attach(&input, &cursor);
+    }
+
+    ~AttachHistoryLoader()
+    {
+        g_history_loader.Attach(nullptr, nullptr);
+    }
+};
+
+}
+
+extern "C" {
+
+BOOL WriteHistoryPipe(_In_ HANDLE hOutput, _In_ UINT CodePage);
+
+BOOL RadWriteConsoleA(
+    _In_ HANDLE hConsoleOutput,
+    _In_reads_(nNumberOfCharsToWrite) CONST VOID* lpBuffer,
+    _In_ DWORD nNumberOfCharsToWrite,
+    _Out_opt_ LPDWORD lpNumberOfCharsWritten,
+    _Reserved_ LPVOID lpReserved
+)
+{
+    return WriteConsoleText(hConsoleOutput, static_cast<LPCSTR>(lpBuffer), nNumberOfCharsToWrite, lpNumberOfCharsWritten, lpReserved);
+}
+
+BOOL RadWriteConsoleW(
+    _In_ HANDLE hConsoleOutput,
+    _In_reads_(nNumberOfCharsToWrite) CONST VOID* lpBuffer,
+    _In_ DWORD nNumberOfCharsToWrite,
+    _Out_opt_ LPDWORD lpNumberOfCharsWritten,
+    _Reserved_ LPVOID lpReserved
+)
+{
+    return WriteConsoleText(hConsoleOutput, static_cast<LPCWSTR>(lpBuffer), nNumberOfCharsToWrite, lpNumberOfCharsWritten, lpReserved);
+}
 
-BOOL RadWriteConsole(
+BOOL RadWriteConsoleOutputCharacterA(
     _In_ HANDLE hConsoleOutput,
-    _In_reads_(nNumberOfCharsToWrite) CONST VOID* lpBuffer,
-    _In_ DWORD nNumberOfCharsToWrite,
-    _Out_opt_ LPDWORD lpNumberOfCharsWritten,
-    _Reserved_ LPVOID lpReserved
+    _In_reads_(nLength) LPCSTR lpCharacter,
+    _In_ DWORD nLength,
+    _In_ COORD dwWriteCoord,
+    _Out_ LPDWORD lpNumberOfCharsWritten
 )
 {
-    LPCTSTR lpCharBuffer = (LPCTSTR) lpBuffer;
-    if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten = 0;
-    DWORD NumberOfCharsWritten;
-    DWORD begin = 0;
-    for (DWORD end = begin; end < nNumberOfCharsToWrite; ++end)
-        if (IsDoubleWidth(lpCharBuffer[end]))
-        {
-            if (!WriteConsole(hConsoleOutput, lpCharBuffer + begin, end - begin, &NumberOfCharsWritten, lpReserved)) return FALSE;
-            if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
-            const TCHAR chevron[] = { TEXT('^'), TCHAR(TEXT('A') + lpCharBuffer[end] - 1) };
-            if (!WriteConsole(hConsoleOutput, ARRAY_X(chevron), &NumberOfCharsWritten, lpReserved)) return FALSE;
-            if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
-            begin = end + 1;
-        }
-    if (!WriteConsole(hConsoleOutput, lpCharBuffer + begin, nNumberOfCharsToWrite - begin, &NumberOfCharsWritten, lpReserved)) return FALSE;
-    if (lpNumberOfCharsWritten) *lpNumberOfCharsWritten += NumberOfCharsWritten;
-    return TRUE;
+    return WriteConsoleOutputText(hConsoleOutput, lpCharacter, nLength, dwWriteCoord, lpNumberOfCharsWritten);
 }
 
-BOOL RadWriteConsoleOutputCharacter(
+BOOL RadWriteConsoleOutputCharacterW(
     _In_ HANDLE hConsoleOutput,
     _In_reads_(nLength) LPCWSTR lpCharacter,
     _In_ DWORD nLength,
@@ -435,102 +3042,90 @@ BOOL RadWriteConsoleOutputCharacter(
     _Out_ LPDWORD lpNumberOfCharsWritten
 )
 {
-    *lpNumberOfCharsWritten = 0;
-    DWORD NumberOfCharsWritten;
-    DWORD begin = 0;
-    for (DWORD end = begin; end < nLength; ++end)
-        if (IsDoubleWidth(lpCharacter[end]))
-        {
-            if (!WriteConsoleOutputCharacter(hConsoleOutput, lpCharacter + begin, end - begin, dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
-            dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, SHORT(NumberOfCharsWritten));
-            *lpNumberOfCharsWritten += NumberOfCharsWritten;
-            const TCHAR chevron[] = { TEXT('^'), TCHAR(TEXT('A') + lpCharacter[end] - 1) };
-            if (!WriteConsoleOutputCharacter(hConsoleOutput, ARRAY_X(chevron), dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
-            dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, SHORT(NumberOfCharsWritten));
-            *lpNumberOfCharsWritten += NumberOfCharsWritten;
-            begin = end + 1;
-        }
-    if (!WriteConsoleOutputCharacter(hConsoleOutput, lpCharacter + begin, nLength - begin, dwWriteCoord, &NumberOfCharsWritten)) return FALSE;
-    //dwWriteCoord = Move(hConsoleOutput, dwWriteCoord, NumberOfCharsWritten);
-    *lpNumberOfCharsWritten += NumberOfCharsWritten;
-    return TRUE;
+    return WriteConsoleOutputText(hConsoleOutput, lpCharacter, nLength, dwWriteCoord, lpNumberOfCharsWritten);
+}
+
 }
 
-void ExpandAlias(LPDWORD lpNumberOfCharsRead, LPTSTR lpCharBuffer, DWORD nNumberOfCharsToRead)
+namespace
+{
+
+template <class C>
+void ExpandAlias(LPDWORD lpNumberOfCharsRead, C* lpCharBuffer, DWORD nNumberOfCharsToRead)
 {
-    if (*lpNumberOfCharsRead <= 0 || lpCharBuffer[0] == TEXT(' '))
+    Trace::Span span("ExpandAlias");
+    if (*lpNumberOfCharsRead <= 0 || lpCharBuffer[0] == C(' '))
         return;
 
-    // Find alias
-    static LPTSTR lpExeName = nullptr;
-    if (lpExeName == nullptr)
-    {
-        static TCHAR filename[MAX_PATH] = TEXT("");
-        GetModuleFileName(NULL, ARRAY_X(filename));
-        lpExeName = PathFindFileName(filename);
-    }
+    // The words only live for the call, on the stack unless there are a lot of them
+    BYTE memory_buffer[2048];
+    std::pmr::monotonic_buffer_resource memory(memory_buffer, sizeof(memory_buffer), &g_memory);
+    const std::pmr::vector<std::pmr::basic_string<C>> args = split(std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead), C(' '), &memory);
 
-    const std::vector<std::tstring> args = split(std::tstring(lpCharBuffer, *lpNumberOfCharsRead), TEXT(' ')); // TODO Avoid copy of lpCharBuffer into temp buffer
+    // Find alias, the name is converted with its null
+    const LPCTSTR lpName = GetExeName();
+    std::pmr::basic_string<C> name(&memory);
+    C* const lpExeName = const_cast<C*>(TextAs<C>(lpName, _tcslen(lpName) + 1, name).data());
 
-    if (GetConsoleAlias(const_cast<LPTSTR>(args[0].c_str()), lpCharBuffer, nNumberOfCharsToRead, lpExeName))
+    if (GetConsoleAliasT(const_cast<C*>(args[0].c_str()), lpCharBuffer, nNumberOfCharsToRead * sizeof(C), lpExeName))
     {
-        *lpNumberOfCharsRead = DWORD(_tcslen(lpCharBuffer));
+        *lpNumberOfCharsRead = DWORD(std::char_traits<C>::length(lpCharBuffer));
 
         DWORD r = 0;
-        while ((r = StrFind(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('$'))) < *lpNumberOfCharsRead)
+        while ((r = StrFind(lpCharBuffer, lpNumberOfCharsRead, r, C('$'))) < *lpNumberOfCharsRead)
         {
             switch (lpCharBuffer[r + 1])
             {
-            case TEXT('G'): case TEXT('g'):
+            case C('G'): case C('g'):
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
-                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('>'));
+                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C('>'));
                 ++r;
                 break;
 
-            case TEXT('L'): case TEXT('l'):
+            case C('L'): case C('l'):
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
-                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('<'));
+                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C('<'));
                 ++r;
                 break;
 
-            case TEXT('B'): case TEXT('b'):
+            case C('B'): case C('b'):
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
-                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('|'));
+                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C('|'));
                 ++r;
                 break;
 
-            case TEXT('T'): case TEXT('t'):
+            case C('T'): case C('t'):
                 // TODO This is not correct behaviour - it should return here and then on the next call return the rest
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
-                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('&'));
+                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C('&'));
                 ++r;
                 break;
 
 #if 0 // Documentation claims this to be true, my tests show otherwise
-            case TEXT('$'):
+            case C('$'):
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
-                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT('$'));
+                StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C('$'));
                 ++r;
                 break;
 #endif
 
-            case TEXT('1'): case TEXT('2'): case TEXT('3'): case TEXT('4'): case TEXT('5'):
-            case TEXT('6'): case TEXT('7'): case TEXT('8'): case TEXT('9'):
+            case C('1'): case C('2'): case C('3'): case C('4'): case C('5'):
+            case C('6'): case C('7'): case C('8'): case C('9'):
             {
-                const unsigned int c = lpCharBuffer[r + 1] - TEXT('0');
+                const unsigned int c = lpCharBuffer[r + 1] - C('0');
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
                 if (c < args.size())
                     r += StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, args[c].c_str());
             }
             break;
 
-            case TEXT('*'):
+            case C('*'):
                 StrErase(lpCharBuffer, lpNumberOfCharsRead, r, 2);
                 for (size_t c = 1; c < args.size(); ++c)
                 {
                     if (c != 1)
                     {
-                        StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, TEXT(' '));
+                        StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, C(' '));
                         ++r;
                     }
                     r += StrInsert(lpCharBuffer, lpNumberOfCharsRead, r, args[c].c_str());
@@ -545,67 +3140,252 @@ void ExpandAlias(LPDWORD lpNumberOfCharsRead, LPTSTR lpCharBuffer, DWORD nNumber
     }
 }
 
+// Lines read from a pipe or file when the input isn't a console, a script of commands say.
+// The input is read in large chunks and split on the undecoded bytes with memchr, which the CRT vectorizes,
+// then each line is added to the history and has its alias expanded like a line entered at the console.
+// The alias names are read once for the stream, so only a line starting with one reaches GetConsoleAlias.
+// As ReadConsole the line is returned with "\r\n", and a line longer than the buffer over the following calls, converted
+// through the console code page for the other character type.
+class InputStream
+{
+public:
+    static const size_t ChunkSize = 64 * 1024;
+
+    InputStream()
+        : m_hInput(NULL), m_CodePage(CP_ACP), m_chunk(ChunkSize), m_begin(0), m_end(0), m_eof(false), m_start(true), m_text(LineCapacity), m_length(0), m_offset(0)
+    {
+    }
+
+    // *lpNumberOfCharsRead is 0 at the end of the input
+    template <class C>
+    BOOL Read(const HANDLE hInput, C* lpBuffer, const DWORD nNumberOfCharsToRead, LPDWORD lpNumberOfCharsRead)
+    {
+        *lpNumberOfCharsRead = 0;
+        if (hInput != m_hInput)
+            Reset(hInput);
+
+        if (m_offset >= m_length && !NextLine())
+            return FALSE;
+
+        // At the end of the input, so a handle opened later with the same value starts again
+        if (m_length == 0)
+            m_hInput = NULL;
+
+        const DWORD length = CopyText(m_text.data() + m_offset, m_length - m_offset, lpBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead);
+        if (length == 0 && m_length > 0)
+        {
+            SetLastError(ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+        m_offset += length;
+        return TRUE;
+    }
+
+private:
+    void Reset(const HANDLE hInput)
+    {
+        m_hInput = hInput;
+        m_CodePage = GetInputStreamCodePage();
+        m_begin = m_end = 0;
+        m_eof = false;
+        m_start = true;
+        m_length = m_offset = 0;
+
+        m_aliases.clear();
+        const LPTSTR lpExeName = GetExeName();
+        const DWORD bytes = GetConsoleAliasesLength(lpExeName);
+        if (bytes > 0)
+        {
+            // Each alias is source=target and null terminated
+            std::vector<TCHAR> aliases(bytes / sizeof(TCHAR) + 1, TEXT('\0'));
+            if (GetConsoleAliases(aliases.data(), bytes, lpExeName))
+            {
+                for (LPCTSTR p = aliases.data(); p < (aliases.data() + aliases.size()) && *p != TEXT('\0'); p += _tcslen(p) + 1)
+                {
+                    const LPCTSTR lpEquals = _tcschr(p, TEXT('='));
+                    m_aliases.Add(p, lpEquals != nullptr ? DWORD(lpEquals - p) : DWORD(_tcslen(p)));
+                }
+            }
+        }
+        m_aliases.Sort();
+    }
+
+    // Reads more input after m_end, first moving the unread bytes to the front or growing the chunk to make room
+    BOOL Fill()
+    {
+        if (m_begin > 0)
+        {
+            memmove(m_chunk.data(), m_chunk.data() + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if (m_end == m_chunk.size())
+            m_chunk.resize(m_chunk.size() * 2);
+
+        Trace::Span span("InputStreamRead");
+        DWORD read = 0;
+        if (!ReadFile(m_hInput, m_chunk.data() + m_end, DWORD(m_chunk.size() - m_end), &read, nullptr) && GetLastError() != ERROR_BROKEN_PIPE)
+            return FALSE;
+        if (read == 0)
+            m_eof = true;
+        m_end += read;
+        return TRUE;
+    }
+
+    // Leaves the next line in m_text, or nothing at the end of the input
+    BOOL NextLine()
+    {
+        m_length = m_offset = 0;
+
+        size_t scanned = 0;     // Bytes after m_begin known not to hold a newline
+        const CHAR* lpNewline = nullptr;
+        while ((lpNewline = static_cast<const CHAR*>(memchr(m_chunk.data() + m_begin + scanned, '\n', m_end - m_begin - scanned))) == nullptr && !m_eof)
+        {
+            scanned = m_end - m_begin;
+            if (!Fill())
+                return FALSE;
+        }
+
+        const size_t next = lpNewline != nullptr ? size_t(lpNewline - m_chunk.data()) + 1 : m_end;
+        if (next == m_begin)
+            return TRUE;
+
+        Trace::Span span("InputStreamLine");
+        size_t length = (lpNewline != nullptr ? next - 1 : next) - m_begin;
+        if (length > 0 && m_chunk[m_begin + length - 1] == '\r')
+            --length;
+
+        if (m_start)
+        {
+            m_start = false;
+            static const CHAR bom[] = { CHAR(0xEF), CHAR(0xBB), CHAR(0xBF) };
+            if (m_CodePage == CP_UTF8 && length >= ARRAYSIZE(bom) && memcmp(m_chunk.data() + m_begin, bom, ARRAYSIZE(bom)) == 0)
+            {
+                m_begin += ARRAYSIZE(bom);
+                length -= ARRAYSIZE(bom);
+            }
+        }
+
+        const size_t need = std::max(Utf::Utf16Size(length) + 4, size_t(LineCapacity));
+        if (m_text.size() < need)
+            m_text.resize(need);
+        DWORD chars = LineToText(m_CodePage, m_chunk.data() + m_begin, DWORD(length), m_text.data());
+        m_begin = next;
+
+        if (chars > 0)
+        {
+            AddHistory(m_text.data(), chars);
+            if (IsAlias(m_text.data(), chars))
+                ExpandAlias(&chars, m_text.data(), DWORD(m_text.size() - 2));
+        }
+
+        const TCHAR text[] = TEXT("\r\n");
+        StrAppend(m_text.data(), &chars, text);
+        m_length = chars;
+        return TRUE;
+    }
+
+    bool IsAlias(LPCTSTR lpStr, const DWORD length) const
+    {
+        if (m_aliases.size() == 0 || lpStr[0] == TEXT(' '))
+            return false;
+        DWORD end = length;
+        const DWORD word = StrFind(lpStr, &end, 0, TEXT(' '));
+        const std::pair<size_t, size_t> found = m_aliases.Find(lpStr, word);
+        return found.first < found.second && m_aliases[found.first].length() == word;
+    }
+
+    HANDLE m_hInput;
+    UINT m_CodePage;
+    std::vector<CHAR> m_chunk;
+    size_t m_begin;     // Unread bytes in m_chunk
+    size_t m_end;
+    bool m_eof;
+    bool m_start;
+    CommandNames<TCHAR> m_aliases;
+    std::vector<TCHAR> m_text;      // The current line
+    DWORD m_length;
+    DWORD m_offset;     // Returned so far
+};
+
+InputStream g_input_stream;
+
+template <class C>
 struct Undo
 {
+    typedef std::pmr::polymorphic_allocator<Undo> allocator_type;   // So the text is kept with the undo list
     enum eType { INSERT, ERASE_FORWARD, ERASE_BACKWARD, REPLACE };
+
+    Undo(const eType type, const DWORD offset, const std::basic_string_view<C> data, const allocator_type& alloc = {})
+        : type(type), offset(offset), data(data.data(), data.length(), alloc)
+    {
+    }
+
+    Undo(Undo&& other, const allocator_type& alloc)
+        : type(other.type), offset(other.offset), data(std::move(other.data), alloc)
+    {
+    }
+
     eType type;
     DWORD offset;
-    std::tstring data;
+    std::pmr::basic_string<C> data;
 };
 
-BOOL RadReadConsole(
+// The editor, for either character type straight in the callers buffer. CHAR text is in the console code page and the
+// cursor steps over its characters, the history and the completions are converted to and from TCHAR.
+template <class C>
+BOOL ReadLine(
     _In_ HANDLE hConsoleInput,
-    _Inout_updates_bytes_to_(nNumberOfCharsToRead * sizeof(TCHAR), *lpNumberOfCharsRead * sizeof(TCHAR%)) LPVOID lpBuffer,
+    _Inout_updates_bytes_to_(nNumberOfCharsToRead * sizeof(C), *lpNumberOfCharsRead * sizeof(C)) C* lpCharBuffer,
     _In_ DWORD nNumberOfCharsToRead,
     _Out_ _Deref_out_range_(<= , nNumberOfCharsToRead) LPDWORD lpNumberOfCharsRead,
     _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
 )
 {
     *lpNumberOfCharsRead = 0;
+    Trace::SetThreadName("Editor");
+    if (std::is_same<C, CHAR>::value || !std::is_same<C, TCHAR>::value)
+        g_code_page = GetConsoleCP();
 
-    DWORD mode_input;
-    if (!GetConsoleMode(hConsoleInput, &mode_input))
-        OutputDebugString(TEXT("Error GetConsoleMode hConsoleInput\n"));
+    switch (g_session.Begin(hConsoleInput))
+    {
+    case ConsoleSession::NotConsole:
+        return g_input_stream.Read(hConsoleInput, lpCharBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead);
+    case ConsoleSession::NotLineMode:
+        return ReadConsoleT(hConsoleInput, lpCharBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+    case ConsoleSession::Ready:
+        break;
+    }
+    EndConsoleSession end_session(g_session);
 
-    if ((mode_input & (ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT)) == 0)
+    // Room for the "\r\n" ending the line
+    if (nNumberOfCharsToRead < 2)
     {
-        OutputDebugString(TEXT("Error Invalid input console mode reverting to default\n"));
-        return ReadConsole(hConsoleInput, lpBuffer, nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
     }
+    const DWORD capacity = nNumberOfCharsToRead - 2;
 
-    mode_input |= ENABLE_INSERT_MODE;
+    DWORD mode_input = g_session.InputMode() | ENABLE_INSERT_MODE;
 
     // TODO Original only return max nNumberOfCharsToRead to buffer even though it accepts the whole line before returning. Next call returns the next characters.
     // TODO If nNumberOfCharsToRead is less than 128 seems to use an internal buffer of 128
     // TODO Original seems to use an internal buffer that is not copied to until returning
-    // TODO Check for nNumberOfCharsToRead when inserting
-
-    const HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-    SaveConsoleMode save_mode_output(hOutput);
-
-    {
-        DWORD mode_output = save_mode_output.mode();
 
-        // ENABLE_VIRTUAL_TERMINAL_PROCESSING stops ENABLE_WRAP_AT_EOL_OUTPUT from working
-        mode_output &= ~ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-        mode_output |= ENABLE_WRAP_AT_EOL_OUTPUT;
-        if (!SetConsoleMode(hOutput, mode_output))
-            OutputDebugString(TEXT("Error SetConsoleMode hOutput\n"));
+    const HANDLE hOutput = g_session.Output();
+    const CONSOLE_CURSOR_INFO cursor = g_session.Cursor();
+    const EditorOptions& options = g_session.Options();
 
-        DWORD mode_output_check;
-        if (!GetConsoleMode(hOutput, &mode_output_check))
-            OutputDebugString(TEXT("Error GetConsoleMode hOutput\n"));
+    InitHistory(options.history_utf8);
 
-        if (mode_output_check != mode_output)
-            OutputDebugString(TEXT("Error setting output console mode\n"));
-    }
+    if (!g_shared_history.IsOpen() && options.history_shared[0] != TEXT('\0'))
+        g_shared_history.Open(options.history_shared);
+    SyncSharedHistory();
 
-    CONSOLE_CURSOR_INFO cursor = {};
-    GetConsoleCursorInfo(hOutput, &cursor);
+    std::pmr::monotonic_buffer_resource memory(g_read_memory, sizeof(g_read_memory), &g_memory);
 
-    LPTSTR lpCharBuffer = (LPTSTR) lpBuffer;
     DWORD offset = 0;
-    std::vector<Undo> undo;
+    std::pmr::vector<Undo<C>> undo(&memory);
 
     if (pInputControl != nullptr)
     {
@@ -619,13 +3399,47 @@ BOOL RadReadConsole(
     }
 
     //lpCharBuffer[*lpNumberOfCharsRead] = TEXT('\0');
-    LPCTSTR wordbreak = TEXT("/\\=[]{}()");
 
-    auto g_history_it = g_history.end();
+    HistoryCursor history(options.history_ranked);
+    std::pmr::tstring history_entry(&memory);
+    std::pmr::tstring line_text(&memory);               // The line as TCHAR, only for the other character type
+    std::pmr::basic_string<C> converted(&memory);       // Text from TCHAR, only for the other character type
+    KeyChars<C> keys;
+
+    ScreenLines<C> lines(&memory);
+    if (options.multiline)
+        lines.Enable(hOutput, lpCharBuffer, *lpNumberOfCharsRead, offset);
+
+    ScreenHighlight<C> highlight(&memory);
+    if (options.highlight)
+    {
+        highlight.Enable(hOutput);
+        highlight.Paint(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, 0);
+    }
+
+    ScreenSuggest<C> suggest(&memory);
+    if (options.autosuggest)
+    {
+        suggest.Enable(hOutput);
+        suggest.Update(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, capacity);
+    }
+
+    ScreenLayout<C> layout(&memory);
+    layout.Track(hOutput);
+
+    const bool complete_commands = options.command_index;
+    if (complete_commands)
+        g_commands.Refresh();
+    CommandCycle commands;
+
+    EditorInput input;
+    input.Start(hConsoleInput, options.input_thread);
+    if (g_shared_history.IsOpen())
+        input.SetTimer(SharedHistorySyncPeriod, [&history]() { if (!history.IsActive()) SyncSharedHistory(); });
+    AttachHistoryLoader attach_loader(input, history);
 
     INPUT_RECORD ir = {};
-    DWORD read = 0;
-    while (ReadConsoleInput(hConsoleInput, &ir, 1, &read))
+    while (input.Read(&ir))
     {
         _ASSERTE(*lpNumberOfCharsRead >= offset);
         _ASSERTE(*lpNumberOfCharsRead <= nNumberOfCharsToRead);
@@ -633,6 +3447,22 @@ BOOL RadReadConsole(
         {
         case KEY_EVENT:
         {
+            Trace::Span span("Key", "vk", ir.Event.KeyEvent.wVirtualKeyCode);
+            const DWORD start = offset;
+            switch (ir.Event.KeyEvent.wVirtualKeyCode)
+            {
+            case VK_SHIFT:
+            case VK_CONTROL:
+            case VK_MENU:
+            case VK_TAB:
+                break;
+
+            default:
+                if (ir.Event.KeyEvent.bKeyDown)
+                    commands.Reset();
+                break;
+            }
+
             switch (ir.Event.KeyEvent.wVirtualKeyCode)
             {
             case VK_SHIFT:
@@ -645,12 +3475,12 @@ BOOL RadReadConsole(
                 {
                     if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
                     {
-                        const DWORD newoffset = StrFindPrev(lpCharBuffer, lpNumberOfCharsRead, offset, wordbreak);
-                        ScreenMoveCursor(hOutput, lpCharBuffer, &offset, newoffset);
+                        const DWORD newoffset = StrFindPrev(lpCharBuffer, offset);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, newoffset);
                     }
                     else
                     {
-                        ScreenMoveCursor(hOutput, lpCharBuffer, &offset, offset - 1);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, StrPrevChar(lpCharBuffer, lpNumberOfCharsRead, offset));
                     }
                 }
                 break;
@@ -660,65 +3490,84 @@ BOOL RadReadConsole(
                 {
                     if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
                     {
-                        const DWORD newoffset = StrFindNext(lpCharBuffer, lpNumberOfCharsRead, offset, wordbreak);
-                        ScreenMoveCursor(hOutput, lpCharBuffer, &offset, newoffset);
+                        const DWORD newoffset = StrFindNext(lpCharBuffer, lpNumberOfCharsRead, offset);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, newoffset);
                     }
                     else
                     {
-                        ScreenMoveCursor(hOutput, lpCharBuffer, &offset, offset + 1);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, StrNextChar(lpCharBuffer, lpNumberOfCharsRead, offset));
                     }
                 }
+                else if (ir.Event.KeyEvent.bKeyDown && suggest.HasSuggestion())
+                {
+                    undo.emplace_back(Undo<C>::INSERT, offset, suggest.Text());
+                    ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, suggest.Text().c_str());
+                }
                 break;
 
             case VK_UP:
+                if (ir.Event.KeyEvent.bKeyDown && lines.IsEnabled() && lines.Line(offset) > 0)
+                {
+                    ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, lines.Vertical(lpCharBuffer, *lpNumberOfCharsRead, offset, true));
+                    break;
+                }
+                if (ir.Event.KeyEvent.bKeyDown && !history.IsActive())
+                    SyncSharedHistory();
                 if (ir.Event.KeyEvent.bKeyDown
-                    && (g_history_it == g_history.end() || std::next(g_history_it) != g_history.end())
-                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0))
+                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0)
+                    && history.Up(history_entry))
                 {
-                    if (g_history_it == g_history.end())
-                        g_history_it = g_history.begin();
-                    else
-                        ++g_history_it;
-                    if (g_history_it != g_history.end())
-                    {
-                        if (*lpNumberOfCharsRead > 0 && (undo.empty() || undo.back().type != Undo::REPLACE))
-                            undo.push_back({ Undo::REPLACE, offset, std::tstring(lpCharBuffer, *lpNumberOfCharsRead) });
-                        ScreenReplace(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, g_history_it->data(), DWORD(g_history_it->size()));
-                    }
+                    if (*lpNumberOfCharsRead > 0 && (undo.empty() || undo.back().type != Undo<C>::REPLACE))
+                        undo.emplace_back(Undo<C>::REPLACE, offset, std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead));
+                    const std::basic_string_view<C> entry = FitText(TextAs<C>(history_entry.data(), history_entry.size(), converted), capacity);
+                    ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, entry.data(), DWORD(entry.length()));
+                    highlight.Invalidate(0);
                 }
                 break;
 
             case VK_DOWN:
+                if (ir.Event.KeyEvent.bKeyDown && lines.IsEnabled() && (lines.Line(offset) + 1) < lines.Lines())
+                {
+                    ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, lines.Vertical(lpCharBuffer, *lpNumberOfCharsRead, offset, false));
+                    break;
+                }
                 if (ir.Event.KeyEvent.bKeyDown
-                    && g_history_it != g_history.end() && g_history_it != g_history.begin()
-                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0))
+                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0)
+                    && history.Down(history_entry))
                 {
-                    --g_history_it;
-                    if (*lpNumberOfCharsRead > 0 && (undo.empty() || undo.back().type != Undo::REPLACE))
-                        undo.push_back({ Undo::REPLACE, offset, std::tstring(lpCharBuffer, *lpNumberOfCharsRead) });
-                    ScreenReplace(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, g_history_it->data(), DWORD(g_history_it->size()));
+                    if (*lpNumberOfCharsRead > 0 && (undo.empty() || undo.back().type != Undo<C>::REPLACE))
+                        undo.emplace_back(Undo<C>::REPLACE, offset, std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead));
+                    const std::basic_string_view<C> entry = FitText(TextAs<C>(history_entry.data(), history_entry.size(), converted), capacity);
+                    ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, entry.data(), DWORD(entry.length()));
+                    highlight.Invalidate(0);
                 }
                 break;
 
             case VK_HOME:
                 if (ir.Event.KeyEvent.bKeyDown && offset > 0)
                 {
-                    ScreenMoveCursor(hOutput, lpCharBuffer, &offset, 0);
+                    ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, lines.IsEnabled() ? lines.LineStart(offset) : 0);
                 }
                 else if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED) && offset > 0)
                 {
-                    ScreenEraseBack(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, offset);
+                    ScreenEraseBack(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, offset);
                 }
                 break;
 
             case VK_END:
                 if (ir.Event.KeyEvent.bKeyDown && offset < *lpNumberOfCharsRead)
                 {
-                    ScreenMoveCursor(hOutput, lpCharBuffer, &offset, *lpNumberOfCharsRead);
+                    ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, lines.IsEnabled() ? lines.LineEnd(offset, *lpNumberOfCharsRead) : *lpNumberOfCharsRead);
+                }
+                else if (ir.Event.KeyEvent.bKeyDown && suggest.HasSuggestion()
+                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0))
+                {
+                    undo.emplace_back(Undo<C>::INSERT, offset, suggest.Text());
+                    ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, suggest.Text().c_str());
                 }
                 else if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED) && offset > 0)
                 {
-                    ScreenEraseForward(hOutput, lpCharBuffer, lpNumberOfCharsRead, offset, *lpNumberOfCharsRead - offset);
+                    ScreenEraseForward(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, offset, *lpNumberOfCharsRead - offset);
                 }
                 break;
 
@@ -736,8 +3585,9 @@ BOOL RadReadConsole(
             case VK_ESCAPE:
                 if (ir.Event.KeyEvent.bKeyDown && *lpNumberOfCharsRead > 0)
                 {
-                    undo.push_back({ Undo::REPLACE, offset, std::tstring(lpCharBuffer, *lpNumberOfCharsRead) });
-                    ScreenReplace(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, TEXT(""), 0);
+                    undo.emplace_back(Undo<C>::REPLACE, offset, std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead));
+                    ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, lpCharBuffer, 0);
+                    highlight.Invalidate(0);
                 }
                 break;
 
@@ -746,15 +3596,16 @@ BOOL RadReadConsole(
                 {
                     if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
                     {
-                        const DWORD newoffset = StrFindPrev(lpCharBuffer, lpNumberOfCharsRead, offset, wordbreak);
+                        const DWORD newoffset = StrFindPrev(lpCharBuffer, offset);
                         const DWORD length = offset - newoffset;
-                        undo.push_back({ Undo::ERASE_BACKWARD, offset, std::tstring(lpCharBuffer + offset - length, length) });
-                        ScreenEraseBack(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, length);
+                        undo.emplace_back(Undo<C>::ERASE_BACKWARD, offset, std::basic_string_view<C>(lpCharBuffer + offset - length, length));
+                        ScreenEraseBack(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, length);
                     }
                     else
                     {
-                        undo.push_back({ Undo::ERASE_BACKWARD, offset, std::tstring(lpCharBuffer + offset - 1, 1) });
-                        ScreenEraseBack(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, 1);
+                        const DWORD length = offset - StrPrevChar(lpCharBuffer, lpNumberOfCharsRead, offset);
+                        undo.emplace_back(Undo<C>::ERASE_BACKWARD, offset, std::basic_string_view<C>(lpCharBuffer + offset - length, length));
+                        ScreenEraseBack(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, length);
                     }
                 }
                 break;
@@ -764,15 +3615,16 @@ BOOL RadReadConsole(
                 {
                     if (ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
                     {
-                        const DWORD newoffset = StrFindNext(lpCharBuffer, lpNumberOfCharsRead, offset, wordbreak);
+                        const DWORD newoffset = StrFindNext(lpCharBuffer, lpNumberOfCharsRead, offset);
                         const DWORD length = newoffset - offset;
-                        undo.push_back({ Undo::ERASE_FORWARD, offset, std::tstring(lpCharBuffer + offset, length) });
-                        ScreenEraseForward(hOutput, lpCharBuffer, lpNumberOfCharsRead, offset, newoffset - offset);
+                        undo.emplace_back(Undo<C>::ERASE_FORWARD, offset, std::basic_string_view<C>(lpCharBuffer + offset, length));
+                        ScreenEraseForward(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, offset, newoffset - offset);
                     }
                     else
                     {
-                        undo.push_back({ Undo::ERASE_FORWARD, offset, std::tstring(lpCharBuffer + offset, 1) });
-                        ScreenEraseForward(hOutput, lpCharBuffer, lpNumberOfCharsRead, offset, 1);
+                        const DWORD length = StrNextChar(lpCharBuffer, lpNumberOfCharsRead, offset) - offset;
+                        undo.emplace_back(Undo<C>::ERASE_FORWARD, offset, std::basic_string_view<C>(lpCharBuffer + offset, length));
+                        ScreenEraseForward(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, offset, length);
                     }
                 }
                 break;
@@ -784,14 +3636,20 @@ BOOL RadReadConsole(
 
                     if (GetEnvironmentVariable(TEXT("RAD_HISTORY_PIPE"), command, ARRAYSIZE(command)))
                     {
+                        Trace::Span span_pipe("HistoryPipe");
                         const COORD pos = GetConsoleCursorPosition(hOutput);
-                        const TCHAR text[] = TEXT("\r\n");
-                        RadWriteConsole(hOutput, ARRAY_X(text) - 1, nullptr, nullptr);
+                        const C text[] = { C('\r'), C('\n') };
+                        WriteConsoleText(hOutput, ARRAY_X(text), nullptr, nullptr);
 
                         std::unique_ptr<HANDLE, HANDLE_Deleter> hInputWritePipe;
                         std::unique_ptr<HANDLE, HANDLE_Deleter> hOutputReadPipe;
                         PROCESS_INFORMATION pi = {};
-                        if (!CreateProcess(command, &pi, &hInputWritePipe, &hOutputReadPipe))
+                        BOOL created = FALSE;
+                        {
+                            Trace::Span span_spawn("HistoryPipeSpawn");
+                            created = CreateProcess(command, &pi, &hInputWritePipe, &hOutputReadPipe);
+                        }
+                        if (!created)
                         {
                             COORD resetpos = GetConsoleCursorPosition(hOutput);
                             --resetpos.Y;
@@ -803,11 +3661,15 @@ BOOL RadReadConsole(
                         std::unique_ptr<HANDLE, HANDLE_Deleter> hThread(pi.hThread);
                         std::unique_ptr<HANDLE, HANDLE_Deleter> hProcess(pi.hProcess);
 
-                        if (!WriteHistoryANSI(hInputWritePipe.get()))
+                        const UINT CodePage = GetHistoryPipeCodePage();
+                        if (!WriteHistoryPipe(hInputWritePipe.get(), CodePage))
                             break;
                         hInputWritePipe.reset();
 
-                        WaitForSingleObject(hProcess.get(), INFINITE);
+                        {
+                            Trace::Span span_wait("HistoryPipeWait");
+                            WaitForSingleObject(hProcess.get(), INFINITE);
+                        }
 
                         {
                             COORD resetpos = GetConsoleCursorPosition(hOutput);
@@ -816,18 +3678,20 @@ BOOL RadReadConsole(
                             SetConsoleCursorPosition(hOutput, resetpos);
                         }
 
-                        TCHAR buffer[1024];
-                        DWORD chars = 0;
-
-                        if (!ReadFileANSI(hOutputReadPipe.get(), buffer, ARRAYSIZE(buffer) - 1, &chars))
+                        std::tstring result;
+                        if (!ReadFileText(hOutputReadPipe.get(), CodePage, result))
                             break;
-                        buffer[--chars] = TEXT('\0');
                         hOutputReadPipe.reset();
 
-                        if (chars > 0)
+                        while (!result.empty() && (result.back() == TEXT('\n') || result.back() == TEXT('\r')))
+                            result.pop_back();
+                        const std::basic_string_view<C> text_result = FitText(TextAs<C>(result.data(), result.length(), converted), capacity);
+
+                        if (!text_result.empty())
                         {
-                            undo.push_back({ Undo::REPLACE, offset, std::tstring(lpCharBuffer, *lpNumberOfCharsRead) });
-                            ScreenReplace(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, buffer, chars);
+                            undo.emplace_back(Undo<C>::REPLACE, offset, std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead));
+                            ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, text_result.data(), DWORD(text_result.length()));
+                            highlight.Invalidate(0);
                         }
                     }
                 }
@@ -836,22 +3700,59 @@ BOOL RadReadConsole(
             case VK_RETURN:
                 if (ir.Event.KeyEvent.bKeyDown && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0))
                 {
+                    suggest.Clear(hOutput);
                     if (offset < *lpNumberOfCharsRead)
-                        ScreenMoveCursor(hOutput, lpCharBuffer, &offset, *lpNumberOfCharsRead);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, *lpNumberOfCharsRead);
 
                     if (*lpNumberOfCharsRead > 0)
-                        g_history.push_front(std::tstring(lpCharBuffer, *lpNumberOfCharsRead));
+                    {
+                        const std::tstring_view line = TextAs<TCHAR>(lpCharBuffer, *lpNumberOfCharsRead, line_text);
+                        AddHistory(line.data(), DWORD(line.length()));
+                    }
 
-                    ExpandAlias(lpNumberOfCharsRead, lpCharBuffer, nNumberOfCharsToRead);
+                    ExpandAlias(lpNumberOfCharsRead, lpCharBuffer, capacity);
 
-                    const TCHAR text[] = TEXT("\r\n");
+                    const C text[] = { C('\r'), C('\n'), C('\0') };
                     StrAppend(lpCharBuffer, lpNumberOfCharsRead, text);
-                    RadWriteConsole(hOutput, ARRAY_X(text) - 1, nullptr, nullptr);
+                    WriteConsoleText(hOutput, ARRAY_X(text) - 1, nullptr, nullptr);
                     SetConsoleCursorInfo(hOutput, &cursor);
                     return TRUE;
                 }
+                else if (ir.Event.KeyEvent.bKeyDown && lines.IsEnabled() && *lpNumberOfCharsRead < capacity)
+                {
+                    const C newline[] = { C('\n'), C('\0') };
+                    undo.emplace_back(Undo<C>::INSERT, offset, newline);
+                    ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, newline);
+                }
                 break;
 
+            case VK_TAB:
+                if (ir.Event.KeyEvent.bKeyDown && complete_commands
+                    && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) == 0))
+                {
+                    const DWORD wordend = StrFind(lpCharBuffer, lpNumberOfCharsRead, 0, C(' '));
+                    const bool cycling = commands.IsActive();
+                    const std::tstring_view prefix = TextAs<TCHAR>(lpCharBuffer, offset, line_text);
+                    const std::tstring* command = offset > 0 && offset <= wordend
+                        ? commands.Next(prefix.data(), DWORD(prefix.length()), (ir.Event.KeyEvent.dwControlKeyState & SHIFT_PRESSED) != 0)
+                        : nullptr;
+                    const std::basic_string_view<C> name = command != nullptr
+                        ? TextAs<C>(command->data(), command->length(), converted) : std::basic_string_view<C>();
+                    if (command != nullptr && (name.length() + *lpNumberOfCharsRead - wordend) <= capacity)
+                    {
+                        if (!cycling)
+                            undo.emplace_back(Undo<C>::REPLACE, offset, std::basic_string_view<C>(lpCharBuffer, *lpNumberOfCharsRead));
+                        std::pmr::basic_string<C> line(name, &memory);
+                        line.append(lpCharBuffer + wordend, *lpNumberOfCharsRead - wordend);
+                        ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, line.data(), DWORD(line.length()));
+                        highlight.Invalidate(0);
+                        ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, DWORD(name.length()));
+                        break;
+                    }
+                }
+                // Not a command to complete, goes to the wakeup mask like any other key
+                [[fallthrough]];
+
             default:
                 if (ir.Event.KeyEvent.bKeyDown)
                 {
@@ -860,11 +3761,13 @@ BOOL RadReadConsole(
                         && (pInputControl->dwCtrlWakeupMask & (1 << ir.Event.KeyEvent.uChar.tChar)))
                     {
                         // BUG in original ConsoleInput doesn't properly insert the character
-                        StrAppend(lpCharBuffer, lpNumberOfCharsRead, TEXT(" "));
-                        lpCharBuffer[offset] = ir.Event.KeyEvent.uChar.tChar;
+                        suggest.Clear(hOutput);
+                        const C space[] = { C(' '), C('\0') };
+                        StrAppend(lpCharBuffer, lpNumberOfCharsRead, space);
+                        lpCharBuffer[offset] = C(ir.Event.KeyEvent.uChar.tChar);
                         return TRUE;
                     }
-                    else if (ir.Event.KeyEvent.wVirtualKeyCode == TEXT('V') && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0))
+                    else if (ir.Event.KeyEvent.wVirtualKeyCode == 'V' && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0))
                     {
                         const HWND hWnd = ::GetConsoleWindow();
                         int retry = 10;
@@ -878,38 +3781,43 @@ BOOL RadReadConsole(
                         if (pClip)
                         {
                             // TODO if (mode_input & ENABLE_INSERT_MODE)
-                            undo.push_back({ Undo::INSERT, offset, pClip });
-                            ScreenInsert(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, pClip);
+                            std::pmr::basic_string<C> clip(TextAs<C>(pClip, wcslen(pClip), converted), &memory);
                             GlobalUnlock(hData);
+                            if (!clip.empty() && (*lpNumberOfCharsRead + clip.length()) <= capacity)
+                            {
+                                undo.emplace_back(Undo<C>::INSERT, offset, clip);
+                                ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, clip.c_str());
+                            }
                         }
 
                         CloseClipboard();
                     }
-                    else if (ir.Event.KeyEvent.wVirtualKeyCode == TEXT('Z') && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0))
+                    else if (ir.Event.KeyEvent.wVirtualKeyCode == 'Z' && ((ir.Event.KeyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0))
                     {
                         if (!undo.empty())
                         {
-                            const Undo& u = undo.back();
+                            const Undo<C>& u = undo.back();
                             switch (u.type)
                             {
-                            case Undo::INSERT:
-                                ScreenMoveCursor(hOutput, lpCharBuffer, &offset, u.offset);
-                                ScreenEraseForward(hOutput, lpCharBuffer, lpNumberOfCharsRead, offset, (DWORD) u.data.length());
+                            case Undo<C>::INSERT:
+                                ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, u.offset);
+                                ScreenEraseForward(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, offset, (DWORD) u.data.length());
                                 break;
 
-                            case Undo::ERASE_FORWARD:
-                                ScreenMoveCursor(hOutput, lpCharBuffer, &offset, u.offset);
-                                ScreenInsert(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str());
-                                ScreenMoveCursor(hOutput, lpCharBuffer, &offset, offset - ((DWORD) u.data.length()));
+                            case Undo<C>::ERASE_FORWARD:
+                                ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, u.offset);
+                                ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str());
+                                ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, offset - ((DWORD) u.data.length()));
                                 break;
 
-                            case Undo::ERASE_BACKWARD:
-                                ScreenInsert(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str());
+                            case Undo<C>::ERASE_BACKWARD:
+                                ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str());
                                 break;
 
-                            case Undo::REPLACE:
-                                ScreenReplace(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str(), (DWORD) u.data.length());
-                                ScreenMoveCursor(hOutput, lpCharBuffer, &offset, u.offset);
+                            case Undo<C>::REPLACE:
+                                ScreenReplace(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, u.data.c_str(), (DWORD) u.data.length());
+                                highlight.Invalidate(0);
+                                ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, u.offset);
                                 break;
 
                             default:
@@ -921,23 +3829,40 @@ BOOL RadReadConsole(
                     }
                     else if (ir.Event.KeyEvent.uChar.tChar != TEXT('\0'))
                     {
-                        if (mode_input & ENABLE_INSERT_MODE)
+                        C typed[KeyChars<C>::MaxChars + 1];
+                        const DWORD length = keys.Convert(ir.Event.KeyEvent.uChar.tChar, typed);
+                        if (length == 0)
+                            break;
+                        if ((mode_input & ENABLE_INSERT_MODE) || length > 1)
                         {
-                            TCHAR buffer[] = TEXT("_");
-                            buffer[0] = ir.Event.KeyEvent.uChar.tChar;
-                            undo.push_back({ Undo::INSERT, offset, buffer });
-                            ScreenInsert(hOutput, lpCharBuffer, lpNumberOfCharsRead, &offset, buffer);
+                            if ((*lpNumberOfCharsRead + length) > capacity)
+                                break;
+                            undo.emplace_back(Undo<C>::INSERT, offset, typed);
+                            ScreenInsert(hOutput, lines, lpCharBuffer, lpNumberOfCharsRead, &offset, typed);
                         }
                         else
                         {
-                            // TODO undo.push_back({ Undo::OVERWRITE, offset, buffer });
-                            StrOverwrite(lpCharBuffer, lpNumberOfCharsRead, offset++, ir.Event.KeyEvent.uChar.tChar);
-                            RadWriteConsole(hOutput, &ir.Event.KeyEvent.uChar.tChar, 1, nullptr, nullptr);
-                            if (IsDoubleWidth(ir.Event.KeyEvent.uChar.tChar))
+                            if (offset == *lpNumberOfCharsRead && *lpNumberOfCharsRead >= capacity)
+                                break;
+                            // TODO undo.emplace_back(Undo::OVERWRITE, offset, buffer);
+                            if (lines.IsEnabled())
+                            {
+                                const DWORD erased = offset < *lpNumberOfCharsRead ? 1 : 0;
+                                StrOverwrite(lpCharBuffer, lpNumberOfCharsRead, offset, typed[0]);
+                                lines.Edit(hOutput, lpCharBuffer, *lpNumberOfCharsRead, offset, erased, 1);
+                                ScreenMoveCursor(hOutput, lines, lpCharBuffer, &offset, offset + 1);
+                                break;
+                            }
+                            // Anything but printable ASCII replacing printable ASCII may change the width of the rest of the line
+                            const bool redraw = !IsPrintableAscii(typed[0])
+                                || (offset < *lpNumberOfCharsRead && !IsPrintableAscii(lpCharBuffer[offset]));
+                            StrOverwrite(lpCharBuffer, lpNumberOfCharsRead, offset++, typed[0]);
+                            WriteConsoleText(hOutput, typed, 1, nullptr, nullptr);
+                            if (redraw)
                             {
                                 COORD pos = GetConsoleCursorPosition(hOutput);
-                                RadWriteConsole(hOutput, BUFFER_X(lpCharBuffer, lpNumberOfCharsRead, offset), nullptr, nullptr);
-                                pos.Y -= CalcScroll(hOutput, pos, (SHORT) (*lpNumberOfCharsRead - offset));
+                                WriteConsoleText(hOutput, BUFFER_X(lpCharBuffer, lpNumberOfCharsRead, offset), nullptr, nullptr);
+                                pos.Y -= CalcScroll(hOutput, pos, (SHORT) GetPrintWidth(lpCharBuffer, offset, *lpNumberOfCharsRead));
                                 SetConsoleCursorPosition(hOutput, pos);
                             }
                         }
@@ -946,6 +3871,29 @@ BOOL RadReadConsole(
                 break;
             }
 
+            if (history.IsActive() && history.Leave(TextAs<TCHAR>(lpCharBuffer, *lpNumberOfCharsRead, line_text), history_entry))
+                g_history_loader.Resume();
+
+            highlight.Paint(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, std::min(start, offset));
+            suggest.Update(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, capacity);
+            layout.Track(hOutput);
+            break;
+        }
+
+        case WINDOW_BUFFER_SIZE_EVENT:
+        {
+            Trace::Span span("Resize");
+            input.Skip(WINDOW_BUFFER_SIZE_EVENT);
+            if (lines.IsEnabled()
+                ? lines.Reflow(hOutput, lpCharBuffer, *lpNumberOfCharsRead, offset, suggest.Width())
+                : layout.Reflow(hOutput, lpCharBuffer, *lpNumberOfCharsRead, offset, suggest.Width()))
+            {
+                suggest.Discard();
+                highlight.Invalidate(0);
+                highlight.Paint(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, offset);
+                suggest.Update(hOutput, lines, lpCharBuffer, *lpNumberOfCharsRead, offset, capacity);
+                layout.Track(hOutput);
+            }
             break;
         }
         }
@@ -954,38 +3902,169 @@ BOOL RadReadConsole(
     return TRUE;
 }
 
-BOOL WriteHistory(_In_ HANDLE hOutput)
+}
+
+extern "C" {
+
+BOOL RadReadConsoleA(
+    _In_ HANDLE hConsoleInput,
+    _Inout_updates_bytes_to_(nNumberOfCharsToRead, *lpNumberOfCharsRead) LPVOID lpBuffer,
+    _In_ DWORD nNumberOfCharsToRead,
+    _Out_ _Deref_out_range_(<= , nNumberOfCharsToRead) LPDWORD lpNumberOfCharsRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+)
+{
+    return ReadLine(hConsoleInput, static_cast<LPSTR>(lpBuffer), nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+}
+
+BOOL RadReadConsoleW(
+    _In_ HANDLE hConsoleInput,
+    _Inout_updates_bytes_to_(nNumberOfCharsToRead * sizeof(WCHAR), *lpNumberOfCharsRead * sizeof(WCHAR)) LPVOID lpBuffer,
+    _In_ DWORD nNumberOfCharsToRead,
+    _Out_ _Deref_out_range_(<= , nNumberOfCharsToRead) LPDWORD lpNumberOfCharsRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+)
+{
+    return ReadLine(hConsoleInput, static_cast<LPWSTR>(lpBuffer), nNumberOfCharsToRead, lpNumberOfCharsRead, pInputControl);
+}
+
+BOOL RadReadConsoleView(
+    _In_ HANDLE hConsoleInput,
+    _Outptr_result_buffer_(*lpNumberOfCharsRead) LPCTSTR* lplpBuffer,
+    _Out_ LPDWORD lpNumberOfCharsRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+)
+{
+    *lplpBuffer = g_line;
+    return ReadLine(hConsoleInput, g_line, LineCapacity, lpNumberOfCharsRead, pInputControl);
+}
+
+BOOL RadReadConsoleUtf8(
+    _In_ HANDLE hConsoleInput,
+    _Inout_updates_bytes_to_(nNumberOfBytesToRead, *lpNumberOfBytesRead) LPSTR lpBuffer,
+    _In_ DWORD nNumberOfBytesToRead,
+    _Out_ _Deref_out_range_(<= , nNumberOfBytesToRead) LPDWORD lpNumberOfBytesRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+)
 {
-    for (auto it = g_history.rbegin(); it != g_history.rend(); ++it)
+    *lpNumberOfBytesRead = 0;
+    uint8_t* const lpBytes = reinterpret_cast<uint8_t*>(lpBuffer);
+    PendingLine& pending = GetPendingLine(hConsoleInput);
+
+    if (pending.offset >= pending.text.length())
     {
-        const auto& s = *it;
-        const DWORD cbBytesToWrite = DWORD(s.length() * sizeof(TCHAR));
-        DWORD cbBytesWritten;
-        BOOL fSuccess = WriteFile(hOutput, s.data(), cbBytesToWrite, &cbBytesWritten, nullptr);
-        if (!fSuccess || cbBytesToWrite != cbBytesWritten)
-            return FALSE;
+        // The line is read into the pending text of the handle, only what doesn't fit the callers buffer stays there
+        pending.text.resize(LineCapacity);
+        pending.offset = 0;
+        CONSOLE_READCONSOLE_CONTROL control = {};
+        if (pInputControl != nullptr)
+        {
+            control = *pInputControl;
+            control.nInitialChars = Utf8ToText(lpBytes, std::min(pInputControl->nInitialChars, nNumberOfBytesToRead), &pending.text[0], LineCapacity);
+        }
 
-        fSuccess = WriteFile(hOutput, TEXT("\n"), sizeof(TCHAR), &cbBytesWritten, nullptr);
-        if (!fSuccess || sizeof(TCHAR) != cbBytesWritten)
+        DWORD read = 0;
+        const BOOL fSuccess = ReadLine(hConsoleInput, &pending.text[0], LineCapacity, &read, pInputControl != nullptr ? &control : nullptr);
+        pending.text.resize(fSuccess ? read : 0);
+        if (!fSuccess)
             return FALSE;
     }
+
+    // Like ReadConsole the rest of a line that doesn't fit is returned by the next calls, as many grapheme clusters as
+    // fit are transcoded straight into the callers buffer
+    const LPCTSTR lpText = pending.text.data() + pending.offset;
+    const DWORD remaining = DWORD(pending.text.length() - pending.offset);
+    DWORD count = remaining;
+    if ((Utf::Utf8Size(remaining) + 3) > nNumberOfBytesToRead)
+    {
+        size_t bytes = 0;
+        for (count = 0; count < remaining;)
+        {
+            const DWORD next = DWORD(Unicode::NextGrapheme(lpText, remaining, count));
+            bytes += Utf8Length(lpText + count, next - count);
+            if (bytes > nNumberOfBytesToRead)
+                break;
+            count = next;
+        }
+    }
+    if (count == 0 && remaining > 0)
+    {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+    *lpNumberOfBytesRead = DWORD(TextToUtf8(lpText, count, lpBytes));
+    pending.offset += count;
     return TRUE;
 }
 
-BOOL WriteHistoryANSI(_In_ HANDLE hOutput)
+BOOL WriteHistory(_In_ HANDLE hOutput)
 {
-    for (auto it = g_history.rbegin(); it != g_history.rend(); ++it)
+    g_history_loader.Finish();
+    std::tstring s;
+    std::tstring line(HistoryFileHeader);
+    line += TEXT('\n');
+    DWORD cbBytesWritten;
+    if (!WriteFile(hOutput, line.data(), DWORD(line.length() * sizeof(TCHAR)), &cbBytesWritten, nullptr) || cbBytesWritten != line.length() * sizeof(TCHAR))
+        return FALSE;
+
+    for (size_t i = g_history.size(); i-- > 0;)
     {
-        const auto& s = *it;
-        BOOL fSuccess = WriteFileANSI(hOutput, s.data(), static_cast<int>(s.length()));
-        if (!fSuccess)
+        g_history.Get(i, s);
+        EscapeHistoryEntry(s, line);
+        const DWORD cbBytesToWrite = DWORD(line.length() * sizeof(TCHAR));
+        const BOOL fSuccess = WriteFile(hOutput, line.data(), cbBytesToWrite, &cbBytesWritten, nullptr);
+        if (!fSuccess || cbBytesToWrite != cbBytesWritten)
             return FALSE;
+    }
+    return TRUE;
+}
 
-        fSuccess = WriteFileANSI(hOutput, TEXT("\n"), 1);
-        if (!fSuccess)
+// Each distinct command once, lowest frecency first so the best match is last like the most recent is in WriteHistory
+BOOL WriteHistoryPipe(_In_ HANDLE hOutput, _In_ UINT CodePage)
+{
+    Trace::Span span("HistoryPipeWrite");
+    FileWriter writer(hOutput, CodePage);
+    const TCHAR newline[] = TEXT("\n");
+    for (auto it = g_frecency.end(); it != g_frecency.begin();)
+    {
+        const std::pmr::tstring& s = g_frecency.Text(--it);
+        if (!writer.Write(s.data(), DWORD(s.length())) || !writer.Write(ARRAY_X(newline) - 1))
             return FALSE;
     }
+    return writer.Flush();
+}
+
+void RadBeginSession(void)
+{
+    g_session.SetPersistent(true);
+}
+
+void RadEndSession(void)
+{
+    g_session.SetPersistent(false);
+}
+
+BOOL RadLoadHistory(_In_ LPCTSTR lpFileName)
+{
+    return g_history_loader.Start(lpFileName);
+}
+
+BOOL RadSetAllocator(_In_opt_ RadAllocFn pAlloc, _In_opt_ RadFreeFn pFree, _In_opt_ LPVOID lpContext)
+{
+    if ((pAlloc == nullptr) != (pFree == nullptr))
+        return FALSE;
+    g_memory.Set(pAlloc, pFree, lpContext);
     return TRUE;
 }
 
+void RadEnableTrace(_In_ BOOL bEnable)
+{
+    Trace::Enable(bEnable != FALSE);
+}
+
+BOOL RadWriteTrace(_In_ HANDLE hOutput)
+{
+    return WriteTrace(hOutput);
+}
+
 }
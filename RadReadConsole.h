@@ -4,7 +4,8 @@
 extern "C" {
 #endif
 
-BOOL RadWriteConsole(
+// Both the A and W variants are in every build, like the Windows functions the plain names follow UNICODE
+BOOL RadWriteConsoleA(
     _In_ HANDLE hConsoleOutput,
     _In_reads_(nNumberOfCharsToWrite) CONST VOID* lpBuffer,
     _In_ DWORD nNumberOfCharsToWrite,
@@ -12,26 +13,107 @@ BOOL RadWriteConsole(
     _Reserved_ LPVOID lpReserved
 );
 
-BOOL RadWriteConsoleOutputCharacter(
+BOOL RadWriteConsoleW(
+    _In_ HANDLE hConsoleOutput,
+    _In_reads_(nNumberOfCharsToWrite) CONST VOID* lpBuffer,
+    _In_ DWORD nNumberOfCharsToWrite,
+    _Out_opt_ LPDWORD lpNumberOfCharsWritten,   // Could be more than nNumberOfCharsToWrite due to double-width characters
+    _Reserved_ LPVOID lpReserved
+);
+
+BOOL RadWriteConsoleOutputCharacterA(
+    _In_ HANDLE hConsoleOutput,
+    _In_reads_(nLength) LPCSTR lpCharacter,
+    _In_ DWORD nLength,
+    _In_ COORD dwWriteCoord,
+    _Out_ LPDWORD lpNumberOfCharsWritten        // Cells written, one for each byte except controls
+);
+
+BOOL RadWriteConsoleOutputCharacterW(
     _In_ HANDLE hConsoleOutput,
     _In_reads_(nLength) LPCWSTR lpCharacter,
     _In_ DWORD nLength,
     _In_ COORD dwWriteCoord,
-    _Out_ LPDWORD lpNumberOfCharsWritten        // Could be more than nNumberOfCharsToWrite due to double-width characters
+    _Out_ LPDWORD lpNumberOfCharsWritten        // Cells written, can differ from nLength due to double-width characters and grapheme clusters
 );
 
 void ExpandAlias(LPDWORD lpNumberOfCharsRead, LPTSTR lpCharBuffer, DWORD nNumberOfCharsToRead);
 
-BOOL RadReadConsole(
+// The editor works in TCHAR, the other variant converts the finished line through the console input code page
+// Input that isn't a console is read as a stream of lines, in the console input code page or UTF-8 with RAD_INPUT_ENCODING
+BOOL RadReadConsoleA(
+    _In_ HANDLE hConsoleInput,
+    _Inout_updates_bytes_to_(nNumberOfCharsToRead, *lpNumberOfCharsRead) LPVOID lpBuffer,
+    _In_ DWORD nNumberOfCharsToRead,
+    _Out_ _Deref_out_range_(<= , nNumberOfCharsToRead) LPDWORD lpNumberOfCharsRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+);
+
+BOOL RadReadConsoleW(
     _In_ HANDLE hConsoleInput,
-    _Inout_updates_bytes_to_(nNumberOfCharsToRead * sizeof(TCHAR), *lpNumberOfCharsRead * sizeof(TCHAR%)) LPVOID lpBuffer,
+    _Inout_updates_bytes_to_(nNumberOfCharsToRead * sizeof(WCHAR), *lpNumberOfCharsRead * sizeof(WCHAR)) LPVOID lpBuffer,
     _In_ DWORD nNumberOfCharsToRead,
     _Out_ _Deref_out_range_(<= , nNumberOfCharsToRead) LPDWORD lpNumberOfCharsRead,
     _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
 );
 
+#ifdef UNICODE
+#define RadWriteConsole RadWriteConsoleW
+#define RadWriteConsoleOutputCharacter RadWriteConsoleOutputCharacterW
+#define RadReadConsole RadReadConsoleW
+#else
+#define RadWriteConsole RadWriteConsoleA
+#define RadWriteConsoleOutputCharacter RadWriteConsoleOutputCharacterA
+#define RadReadConsole RadReadConsoleA
+#endif
+
+// Reads into a line buffer kept by the library, *lplpBuffer is valid until the next call
+// With pInputControl the first nInitialChars of the previous line are kept as the initial text
+BOOL RadReadConsoleView(
+    _In_ HANDLE hConsoleInput,
+    _Outptr_result_buffer_(*lpNumberOfCharsRead) LPCTSTR* lplpBuffer,
+    _Out_ LPDWORD lpNumberOfCharsRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+);
+
+// As RadReadConsole but returns UTF-8, pInputControl->nInitialChars is in bytes
+// A line longer than the buffer is returned over the following calls
+BOOL RadReadConsoleUtf8(
+    _In_ HANDLE hConsoleInput,
+    _Inout_updates_bytes_to_(nNumberOfBytesToRead, *lpNumberOfBytesRead) LPSTR lpBuffer,
+    _In_ DWORD nNumberOfBytesToRead,
+    _Out_ _Deref_out_range_(<= , nNumberOfBytesToRead) LPDWORD lpNumberOfBytesRead,
+    _In_opt_ PCONSOLE_READCONSOLE_CONTROL pInputControl
+);
+
+// Writes a version line then the history oldest first, each entry on a line with a newline in it written as \n,
+// waiting for any file still loading
 BOOL WriteHistory(_In_ HANDLE hOutput);
 
+// Loads a file written by WriteHistory on a background thread, from its newest entries, as older than the history already there
+// Reads add the entries as they arrive while waiting for input, so Up works on whatever has loaded
+// A file without the version line is read as it is, each line an entry
+BOOL RadLoadHistory(_In_ LPCTSTR lpFileName);
+
+// Keeps the console modes and the RAD_ environment variables worked out once until RadEndSession, for hosts reading many lines
+// Each read still sets the modes up and restores the callers when it returns, only checking the modes weren't changed
+void RadBeginSession(void);
+void RadEndSession(void);
+
+// Memory for the history and for the editor while reading a line, alignment is a power of 2
+typedef LPVOID (*RadAllocFn)(_In_ SIZE_T nBytes, _In_ SIZE_T nAlignment, _In_opt_ LPVOID lpContext);
+typedef void (*RadFreeFn)(_In_ LPVOID lpMemory, _In_ SIZE_T nBytes, _In_ SIZE_T nAlignment, _In_opt_ LPVOID lpContext);
+
+// Takes the memory from the host, nullptr for both goes back to the C++ heap
+// Memory already taken is returned to the functions that gave it, so it may be called whenever no read is in progress
+BOOL RadSetAllocator(_In_opt_ RadAllocFn pAlloc, _In_opt_ RadFreeFn pFree, _In_opt_ LPVOID lpContext);
+
+// Records timed spans of the editor, also enabled by setting RAD_TRACE to a file to write them to at exit
+void RadEnableTrace(_In_ BOOL bEnable);
+
+// Writes the spans recorded so far as Chrome trace_event JSON
+BOOL RadWriteTrace(_In_ HANDLE hOutput);
+
 #ifdef __cplusplus
 }
 #endif
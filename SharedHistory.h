@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+// History ring laid out in a block of memory shared between processes.
+// Only uses std::atomic so the same code works on a Windows file mapping or a POSIX shm segment.
+//
+// Appending is lock-free: the writer claims a sequence number from the header and publishes the
+// slot with a stamp (seqlock style), readers check the stamp before and after copying.
+// A writer that dies mid-append leaves its slot stamped as busy, readers skip that sequence number
+// and the slot is reused when the ring wraps. A writer that only stalls that long can still copy over the
+// newer entry once it is published, so each entry also carries a check that readers verify.
+template <class C>
+class SharedHistoryRing
+{
+public:
+    static const uint32_t Magic = 0x52484953;   // 'RHIS'
+    static const uint32_t Initialising = 1;     // In the low byte of the magic, a generation in the rest
+    static const uint32_t Version = 2;
+
+    // Longer than initialising the header ever takes, after that the process doing it is taken to have died
+    static constexpr std::chrono::milliseconds InitialiseTimeout = std::chrono::milliseconds(500);
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory requires lock-free atomics");
+
+    SharedHistoryRing()
+        : m_header(nullptr)
+    {
+    }
+
+    static size_t Size(uint32_t slot_count, uint32_t slot_chars)
+    {
+        return HeaderSize() + size_t(slot_count) * Stride(slot_chars);
+    }
+
+    // p must be zero filled the first time any process opens it
+    // Waits while another process initialises the header, taking over if it doesn't finish within InitialiseTimeout
+    // Returns false if the layout doesn't match
+    bool Open(void* p, size_t size, uint32_t slot_count, uint32_t slot_chars)
+    {
+        if (Size(slot_count, slot_chars) > size)
+            return false;
+
+        Header* header = static_cast<Header*>(p);
+        uint32_t magic = header->magic.load(std::memory_order_acquire);
+        uint32_t waited = magic;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (magic != Magic)
+        {
+            if (magic != 0 && (magic & 0xFF) != Initialising)
+                return false;
+
+            if (magic != waited)
+            {
+                waited = magic;
+                start = std::chrono::steady_clock::now();
+            }
+            if (magic != 0 && (std::chrono::steady_clock::now() - start) < InitialiseTimeout)
+            {
+                std::this_thread::yield();
+                magic = header->magic.load(std::memory_order_acquire);
+                continue;
+            }
+
+            // The next generation, so only one of the processes that found it stuck takes it over
+            const uint32_t initialising = (((magic >> 8) + 1) << 8) | Initialising;
+            if (!header->magic.compare_exchange_strong(magic, initialising, std::memory_order_acquire))
+                continue;
+            header->version = Version;
+            header->char_size = sizeof(C);
+            header->slot_count = slot_count;
+            header->slot_chars = slot_chars;
+            header->next.store(0, std::memory_order_relaxed);
+            magic = initialising;
+            // Fails if this process was itself so slow it was taken over, magic is then the newer generation
+            if (header->magic.compare_exchange_strong(magic, Magic, std::memory_order_release, std::memory_order_acquire))
+                magic = Magic;
+        }
+
+        if (header->version != Version || header->char_size != sizeof(C)
+            || header->slot_count == 0 || Size(header->slot_count, header->slot_chars) > size)
+            return false;
+
+        m_header = header;
+        return true;
+    }
+
+    bool IsOpen() const { return m_header != nullptr; }
+    uint32_t SlotCount() const { return m_header->slot_count; }
+    uint32_t SlotChars() const { return m_header->slot_chars; }
+
+    // One past the last claimed sequence number
+    uint64_t Head() const
+    {
+        return m_header->next.load(std::memory_order_acquire);
+    }
+
+    // Oldest sequence number that may still be in the ring
+    uint64_t Tail() const
+    {
+        const uint64_t head = Head();
+        return head > m_header->slot_count ? head - m_header->slot_count : 0;
+    }
+
+    bool Append(uint32_t owner, const C* text, size_t length)
+    {
+        if (length > m_header->slot_chars)
+            return false;
+
+        const uint64_t seq = m_header->next.fetch_add(1, std::memory_order_acq_rel);
+        Slot* slot = GetSlot(seq);
+
+        // Only claim the slot if no newer writer has (only possible if the ring wraps during this append)
+        const uint64_t busy = seq * 2 + 1;
+        uint64_t stamp = slot->stamp.load(std::memory_order_relaxed);
+        do
+        {
+            if (stamp >= busy)
+                return false;
+        } while (!slot->stamp.compare_exchange_weak(stamp, busy, std::memory_order_acquire, std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->length = uint32_t(length);
+        slot->owner = owner;
+        slot->check = Check(seq, uint32_t(length), owner, text);
+        memcpy(GetData(slot), text, length * sizeof(C));
+
+        uint64_t expected = busy;
+        return slot->stamp.compare_exchange_strong(expected, busy + 1, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    // seq has been claimed but not published, either still being written or abandoned by a crashed writer
+    bool IsPending(uint64_t seq) const
+    {
+        return GetSlot(seq)->stamp.load(std::memory_order_acquire) < seq * 2 + 2;
+    }
+
+    // text must hold SlotChars() characters
+    // Returns false if seq was overwritten, is still being written or was abandoned by its writer
+    bool Read(uint64_t seq, C* text, uint32_t* length, uint32_t* owner) const
+    {
+        const Slot* slot = GetSlot(seq);
+        const uint64_t published = seq * 2 + 2;
+        if (slot->stamp.load(std::memory_order_acquire) != published)
+            return false;
+
+        const uint32_t l = slot->length;
+        if (l > m_header->slot_chars)
+            return false;
+        const uint32_t o = slot->owner;
+        const uint32_t check = slot->check;
+        memcpy(text, GetData(slot), l * sizeof(C));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->stamp.load(std::memory_order_relaxed) != published)
+            return false;
+        if (check != Check(seq, l, o, text))
+            return false;
+
+        *length = l;
+        *owner = o;
+        return true;
+    }
+
+private:
+    struct Header
+    {
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint32_t char_size;
+        uint32_t slot_count;
+        uint32_t slot_chars;
+        uint32_t reserved;
+        std::atomic<uint64_t> next;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> stamp;    // seq * 2 + 1 while writing, seq * 2 + 2 once published
+        uint32_t length;
+        uint32_t owner;
+        uint32_t check;                 // Of the seq and the entry
+        uint32_t reserved;
+        // C data[slot_chars] follows
+    };
+
+    // FNV-1a
+    static uint32_t Hash(uint32_t h, const void* p, size_t size)
+    {
+        const unsigned char* b = static_cast<const unsigned char*>(p);
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ b[i]) * 16777619u;
+        return h;
+    }
+
+    static uint32_t Check(uint64_t seq, uint32_t length, uint32_t owner, const C* text)
+    {
+        uint32_t h = 2166136261u;
+        h = Hash(h, &seq, sizeof(seq));
+        h = Hash(h, &length, sizeof(length));
+        h = Hash(h, &owner, sizeof(owner));
+        return Hash(h, text, length * sizeof(C));
+    }
+
+    static size_t Align(size_t s) { return (s + 7) & ~size_t(7); }
+    static size_t HeaderSize() { return Align(sizeof(Header)); }
+    static size_t Stride(uint32_t slot_chars) { return Align(sizeof(Slot) + slot_chars * sizeof(C)); }
+
+    Slot* GetSlot(uint64_t seq) const
+    {
+        char* base = reinterpret_cast<char*>(m_header) + HeaderSize();
+        return reinterpret_cast<Slot*>(base + size_t(seq % m_header->slot_count) * Stride(m_header->slot_chars));
+    }
+
+    static C* GetData(Slot* slot) { return reinterpret_cast<C*>(slot + 1); }
+    static const C* GetData(const Slot* slot) { return reinterpret_cast<const C*>(slot + 1); }
+
+    Header* m_header;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each side owns one index and keeps a copy of the other's last seen value on its own cache line,
+// so the shared lines are only touched when the copy says the queue looks full or empty.
+template <class T>
+class SpscQueue
+{
+public:
+    // capacity is rounded up to a power of 2
+    explicit SpscQueue(const size_t capacity)
+        : m_capacity(RoundUp(capacity)), m_items(new T[m_capacity])
+    {
+        m_producer.tail.store(0, std::memory_order_relaxed);
+        m_producer.head = 0;
+        m_consumer.head.store(0, std::memory_order_relaxed);
+        m_consumer.tail = 0;
+    }
+
+    size_t Capacity() const { return m_capacity; }
+
+    // Producer only, returns the number of items pushed
+    size_t Push(const T* items, const size_t count)
+    {
+        const size_t tail = m_producer.tail.load(std::memory_order_relaxed);
+        if ((m_capacity - (tail - m_producer.head)) < count)
+            m_producer.head = m_consumer.head.load(std::memory_order_acquire);
+        const size_t n = std::min(count, m_capacity - (tail - m_producer.head));
+        for (size_t i = 0; i < n; ++i)
+            m_items[(tail + i) & (m_capacity - 1)] = items[i];
+        m_producer.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Producer only, the number of items that can be pushed
+    size_t Free()
+    {
+        m_producer.head = m_consumer.head.load(std::memory_order_acquire);
+        return m_capacity - (m_producer.tail.load(std::memory_order_relaxed) - m_producer.head);
+    }
+
+    // Consumer only, returns the number of items popped
+    size_t Pop(T* items, const size_t count)
+    {
+        const size_t n = Peek(items, count);
+        m_consumer.head.store(m_consumer.head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer only, as Pop but leaves the items in the queue
+    size_t Peek(T* items, const size_t count)
+    {
+        const size_t head = m_consumer.head.load(std::memory_order_relaxed);
+        if ((m_consumer.tail - head) < count)
+            m_consumer.tail = m_producer.tail.load(std::memory_order_acquire);
+        const size_t n = std::min(count, m_consumer.tail - head);
+        for (size_t i = 0; i < n; ++i)
+            items[i] = m_items[(head + i) & (m_capacity - 1)];
+        return n;
+    }
+
+    // Consumer only
+    bool Empty()
+    {
+        const size_t head = m_consumer.head.load(std::memory_order_relaxed);
+        if (m_consumer.tail == head)
+            m_consumer.tail = m_producer.tail.load(std::memory_order_acquire);
+        return m_consumer.tail == head;
+    }
+
+private:
+    static const size_t CacheLine = 64;
+
+    static size_t RoundUp(const size_t n)
+    {
+        size_t c = 1;
+        while (c < n)
+            c <<= 1;
+        return c;
+    }
+
+    struct alignas(CacheLine) Producer
+    {
+        std::atomic<size_t> tail;   // Next slot to push
+        size_t head;                // Last seen m_consumer.head
+    };
+
+    struct alignas(CacheLine) Consumer
+    {
+        std::atomic<size_t> head;   // Next slot to pop
+        size_t tail;                // Last seen m_producer.tail
+    };
+
+    Producer m_producer;
+    Consumer m_consumer;
+    const size_t m_capacity;
+    std::unique_ptr<T[]> m_items;
+};
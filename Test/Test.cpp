@@ -26,12 +26,79 @@ inline BOOL AddConsoleAlias(
     return AddConsoleAlias(const_cast<LPTSTR>(Source), const_cast<LPTSTR>(Target), const_cast<LPTSTR>(ExeName));
 }
 
+inline void WriteConsoleKey(const HANDLE h, const WORD wVirtualKeyCode, const WCHAR ch)
+{
+    INPUT_RECORD ir[2] = {};
+    for (INPUT_RECORD& r : ir)
+    {
+        r.EventType = KEY_EVENT;
+        r.Event.KeyEvent.wRepeatCount = 1;
+        r.Event.KeyEvent.wVirtualKeyCode = wVirtualKeyCode;
+        r.Event.KeyEvent.uChar.UnicodeChar = ch;
+    }
+    ir[0].Event.KeyEvent.bKeyDown = TRUE;
+    DWORD written = 0;
+    WriteConsoleInputW(h, ARRAY_X(ir), &written);
+}
+
+// Prompt to prompt time of lines fed through the input queue, setting up the console for each read and kept for a session
+// Run in a process of its own so the lines it enters go to a scratch history, not this one or the shared history
+void Bench(const HANDLE hInput)
+{
+    SetEnvironmentVariable(TEXT("RAD_HISTORY_SHARED"), nullptr);
+    const int Prompts = 200;
+    LARGE_INTEGER freq = {};
+    QueryPerformanceFrequency(&freq);
+    for (int session = 0; session < 2; ++session)
+    {
+        if (session)
+            RadBeginSession();
+        LARGE_INTEGER begin = {}, end = {};
+        QueryPerformanceCounter(&begin);
+        for (int i = 0; i < Prompts; ++i)
+        {
+            WriteConsoleKey(hInput, 'X', L'x');
+            WriteConsoleKey(hInput, VK_RETURN, L'\r');
+            TCHAR line[128];
+            DWORD lineread = 0;
+            RadReadConsole(hInput, ARRAY_X(line), &lineread, nullptr);
+        }
+        QueryPerformanceCounter(&end);
+        if (session)
+            RadEndSession();
+        printf("%s: %.1f us per prompt\n", session ? "Session" : "Each read", (end.QuadPart - begin.QuadPart) * 1000000.0 / freq.QuadPart / Prompts);
+    }
+}
+
+void RunBench()
+{
+    TCHAR path[MAX_PATH];
+    TCHAR cmd[MAX_PATH + 16];
+    GetModuleFileName(NULL, ARRAY_X(path));
+    _stprintf_s(cmd, TEXT("\"%s\" bench"), path);
+    STARTUPINFO si = { sizeof(STARTUPINFO) };
+    PROCESS_INFORMATION pi = {};
+    if (!CreateProcess(nullptr, cmd, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+    {
+        fprintf(stderr, "Error CreateProcess: %08X\n", GetLastError());
+        return;
+    }
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+}
 
 int _tmain(const int argc, const TCHAR* const argv[])
 {
     const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
     const HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
 
+    if (argc > 1 && _tcscmp(argv[1], TEXT("bench")) == 0)
+    {
+        Bench(hInput);
+        return EXIT_SUCCESS;
+    }
+
     LPCTSTR strExeName = PathFindFileName(argv[0]);
     AddConsoleAlias(TEXT("x"), TEXT("exit"), strExeName);
     AddConsoleAlias(TEXT("test1"), TEXT("--- [$1] [$2] [$3] [$4] [$5] [$6] [$7] [$8] [$9]"), strExeName);
@@ -51,6 +118,7 @@ int _tmain(const int argc, const TCHAR* const argv[])
 
     ReadConsoleT pReadConsole = RadReadConsole;
     LPCTSTR prompt = TEXT("R> ");
+    bool tracing = false;
 
     while (true)
     {
@@ -84,6 +152,28 @@ int _tmain(const int argc, const TCHAR* const argv[])
                 prompt = TEXT("R> ");
             }
         }
+        else if (_tcsncmp(buffer, TEXT("trace"), 5) == 0)
+        {
+            // The first starts tracing, the next writes what was traced since and stops
+            if (!tracing)
+            {
+                RadEnableTrace(TRUE);
+                printf("Tracing, enter trace again to write trace.json\n");
+            }
+            else
+            {
+                RadEnableTrace(FALSE);
+                const HANDLE hFile = CreateFile(TEXT("trace.json"), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (hFile != INVALID_HANDLE_VALUE)
+                {
+                    RadWriteTrace(hFile);
+                    CloseHandle(hFile);
+                }
+            }
+            tracing = !tracing;
+        }
+        else if (_tcsncmp(buffer, TEXT("bench"), 5) == 0)
+            RunBench();
         else
         {
             const WORD wAttributes = GetConsoleTextAttribute(hOutput);
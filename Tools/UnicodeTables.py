@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+# Generates UnicodeTables.h from the Unicode character database.
+#
+# Usage: UnicodeTables.py <ucd directory> [output]
+#
+# The directory needs EastAsianWidth.txt, GraphemeBreakProperty.txt (from auxiliary/)
+# and emoji-data.txt (from emoji/) all from the same Unicode version.
+
+import os
+import re
+import sys
+
+MAX_CODE_POINT = 0x110000
+
+# Order is the value of the GraphemeBreak enum
+GRAPHEME_BREAK = [
+    "Other", "CR", "LF", "Control", "Extend", "ZWJ", "Regional_Indicator", "Prepend",
+    "SpacingMark", "L", "V", "T", "LV", "LVT",
+]
+
+# Code points not listed in EastAsianWidth.txt default to N, except these unassigned ranges
+WIDE_DEFAULTS = [
+    (0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF),
+    (0x20000, 0x2FFFD), (0x30000, 0x3FFFD),
+]
+
+# Don't take up a cell of their own, the base character they follow does
+ZERO_WIDTH = {"Extend", "ZWJ", "V", "T", "Control", "CR", "LF"}
+
+WIDTH_SHIFT = 5
+PICTOGRAPHIC = 0x10
+
+
+def parse(path):
+    version = None
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            if version is None:
+                m = re.search(r"-(\d+\.\d+\.\d+)\.txt", line)
+                if m:
+                    version = m.group(1)
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            cps, value = [s.strip() for s in line.split(";")[:2]]
+            lo, _, hi = cps.partition("..")
+            yield version, int(lo, 16), int(hi or lo, 16), value
+
+
+def load(directory):
+    versions = set()
+    width = [1] * MAX_CODE_POINT
+    for lo, hi in WIDE_DEFAULTS:
+        width[lo:hi + 1] = [2] * (hi - lo + 1)
+    for version, lo, hi, value in parse(os.path.join(directory, "EastAsianWidth.txt")):
+        versions.add(version)
+        width[lo:hi + 1] = [2 if value in ("W", "F") else 1] * (hi - lo + 1)
+
+    props = [0] * MAX_CODE_POINT
+    for version, lo, hi, value in parse(os.path.join(directory, "GraphemeBreakProperty.txt")):
+        versions.add(version)
+        gcb = GRAPHEME_BREAK.index(value)
+        props[lo:hi + 1] = [gcb] * (hi - lo + 1)
+        if value in ZERO_WIDTH:
+            width[lo:hi + 1] = [0] * (hi - lo + 1)
+
+    for version, lo, hi, value in parse(os.path.join(directory, "emoji-data.txt")):
+        if value == "Extended_Pictographic":
+            versions.add(version)
+            for c in range(lo, hi + 1):
+                props[c] |= PICTOGRAPHIC
+
+    versions.discard(None)
+    if len(versions) != 1:
+        sys.exit("Mismatched or missing Unicode versions: %s" % sorted(versions))
+
+    return versions.pop(), [p | (w << WIDTH_SHIFT) for p, w in zip(props, width)]
+
+
+def split(values, shift):
+    block = 1 << shift
+    blocks = {}
+    stage1 = []
+    stage2 = []
+    for i in range(0, len(values), block):
+        key = tuple(values[i:i + block])
+        if key not in blocks:
+            blocks[key] = len(blocks)
+            stage2.extend(key)
+        stage1.append(blocks[key])
+    return stage1, stage2
+
+
+def smallest(values):
+    best = None
+    for shift in range(4, 11):
+        stage1, stage2 = split(values, shift)
+        size = len(stage1) * (1 if max(stage1) < 256 else 2) + len(stage2)
+        if best is None or size < best[0]:
+            best = (size, shift, stage1, stage2)
+    return best[1:]
+
+
+def array(name, type, values):
+    lines = ["        inline constexpr %s %s[] = {" % (type, name)]
+    for i in range(0, len(values), 16):
+        lines.append("            " + " ".join("%d," % v for v in values[i:i + 16]))
+    lines.append("        };")
+    return lines
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("Usage: UnicodeTables.py <ucd directory> [output]")
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "UnicodeTables.h")
+
+    version, values = load(sys.argv[1])
+    shift, stage1, stage2 = smallest(values)
+    stage1type = "uint8_t" if max(stage1) < 256 else "uint16_t"
+
+    lines = [
+        "// Generated by Tools/UnicodeTables.py from the Unicode %s character database, do not edit" % version,
+        "#pragma once",
+        "",
+        "#include <cstdint>",
+        "",
+        "namespace Unicode",
+        "{",
+        "    inline constexpr char Version[] = \"%s\";" % version,
+        "",
+        "    enum GraphemeBreak : uint8_t",
+        "    {",
+    ]
+    lines += ["        GB_%s," % v for v in GRAPHEME_BREAK]
+    lines += [
+        "    };",
+        "",
+        "    namespace Tables",
+        "    {",
+        "        // Each code point is a byte, bits 0-3 GraphemeBreak, bit 4 Extended_Pictographic, bits 5-6 cell width",
+        "        inline constexpr unsigned int Shift = %d;" % shift,
+        "        inline constexpr uint8_t GraphemeBreakMask = 0x0F;",
+        "        inline constexpr uint8_t Pictographic = 0x%02X;" % PICTOGRAPHIC,
+        "        inline constexpr unsigned int WidthShift = %d;" % WIDTH_SHIFT,
+        "",
+    ]
+    lines += array("Stage1", stage1type, stage1)
+    lines.append("")
+    lines += array("Stage2", "uint8_t", stage2)
+    lines += [
+        "    }",
+        "",
+        "    constexpr uint8_t GetProperties(const char32_t c)",
+        "    {",
+        "        return c < 0x%X ? Tables::Stage2[(unsigned(Tables::Stage1[c >> Tables::Shift]) << Tables::Shift) | (c & ((1u << Tables::Shift) - 1))] : uint8_t(GB_Control);" % MAX_CODE_POINT,
+        "    }",
+        "}",
+        "",
+    ]
+
+    with open(output, "w", newline="\n") as f:
+        f.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timed spans to see where a single keystroke spent its time, written as Chrome trace_event JSON
+// for chrome://tracing or ui.perfetto.dev.
+// Each thread records into its own ring without locking, when it wraps the oldest spans are lost.
+// The rings are read seqlock style, a span overwritten while being copied is dropped.
+// While disabled a Span costs a relaxed load.
+namespace Trace
+{
+    struct Event
+    {
+        const char* name;       // Only the pointer is kept, use string literals
+        const char* argname;    // nullptr for no argument
+        int64_t arg;
+        int64_t begin;          // Nanoseconds
+        int64_t end;
+    };
+
+    class Ring
+    {
+    public:
+        static const size_t Size = 4096;
+
+        explicit Ring(const uint32_t tid)
+            : m_tid(tid), m_name(nullptr), m_count(0), m_events(new Event[Size])
+        {
+        }
+
+        uint32_t Tid() const { return m_tid; }
+        const char* Name() const { return m_name.load(std::memory_order_relaxed); }
+        void SetName(const char* name) { m_name.store(name, std::memory_order_relaxed); }
+
+        // Owning thread only
+        void Add(const Event& e)
+        {
+            const size_t count = m_count.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_events[count & (Size - 1)] = e;
+            m_count.store(count + 1, std::memory_order_release);
+        }
+
+        // Any thread
+        void Copy(std::vector<Event>& events) const
+        {
+            const size_t end = m_count.load(std::memory_order_acquire);
+            const size_t begin = end > Size ? end - Size : 0;
+            const size_t first = events.size();
+            for (size_t i = begin; i < end; ++i)
+                events.push_back(m_events[i & (Size - 1)]);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // The writer may be part way into the slot of the event after the last it published
+            const size_t after = m_count.load(std::memory_order_relaxed);
+            const size_t valid = (after + 1) > Size ? (after + 1) - Size : 0;
+            if (valid > begin)
+                events.erase(events.begin() + first, events.begin() + first + std::min(valid - begin, end - begin));
+        }
+
+    private:
+        const uint32_t m_tid;
+        std::atomic<const char*> m_name;
+        std::atomic<size_t> m_count;
+        std::unique_ptr<Event[]> m_events;
+    };
+
+    class Recorder
+    {
+    public:
+        Recorder()
+            : m_enabled(false)
+        {
+        }
+
+        bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+        void Enable(const bool enable) { m_enabled.store(enable, std::memory_order_relaxed); }
+
+        // The ring for the calling thread, created on first use
+        Ring* GetRing()
+        {
+            thread_local Ring* ring = nullptr;
+            if (ring == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_rings.emplace_back(new Ring(uint32_t(m_rings.size() + 1)));
+                ring = m_rings.back().get();
+            }
+            return ring;
+        }
+
+        void Add(const Event& e)
+        {
+            GetRing()->Add(e);
+        }
+
+        // Appends the spans recorded so far as a JSON object
+        void Write(std::string& json, const uint32_t pid)
+        {
+            std::vector<Event> events;
+            char line[512];
+            json += "{\"traceEvents\":[\n";
+            bool first = true;
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (const std::unique_ptr<Ring>& ring : m_rings)
+            {
+                const char* name = ring->Name();
+                if (name != nullptr)
+                {
+                    snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"",
+                        first ? "" : ",\n", pid, ring->Tid());
+                    json += line;
+                    Escape(json, name);
+                    json += "\"}}";
+                    first = false;
+                }
+
+                events.clear();
+                ring->Copy(events);
+                for (const Event& e : events)
+                {
+                    snprintf(line, sizeof(line), "%s{\"name\":\"", first ? "" : ",\n");
+                    json += line;
+                    Escape(json, e.name);
+                    snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u",
+                        e.begin / 1000.0, (e.end - e.begin) / 1000.0, pid, ring->Tid());
+                    json += line;
+                    if (e.argname != nullptr)
+                    {
+                        json += ",\"args\":{\"";
+                        Escape(json, e.argname);
+                        snprintf(line, sizeof(line), "\":%lld}", static_cast<long long>(e.arg));
+                        json += line;
+                    }
+                    json += "}";
+                    first = false;
+                }
+            }
+            json += "\n]}\n";
+        }
+
+    private:
+        static void Escape(std::string& json, const char* s)
+        {
+            for (; *s != '\0'; ++s)
+            {
+                if (*s == '"' || *s == '\\')
+                    json += '\\';
+                if (uint8_t(*s) >= ' ')
+                    json += *s;
+            }
+        }
+
+        std::atomic<bool> m_enabled;
+        std::mutex m_lock;
+        std::vector<std::unique_ptr<Ring>> m_rings;     // Guarded by m_lock, kept after their thread exits
+    };
+
+    inline Recorder g_recorder;
+
+    inline int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline bool IsEnabled() { return g_recorder.IsEnabled(); }
+    inline void Enable(const bool enable) { g_recorder.Enable(enable); }
+
+    // Names the calling thread in the trace, name must be a string literal
+    inline void SetThreadName(const char* name)
+    {
+        if (IsEnabled())
+            g_recorder.GetRing()->SetName(name);
+    }
+
+    // Records the time from construction to destruction
+    class Span
+    {
+    public:
+        explicit Span(const char* name, const char* argname = nullptr, const int64_t arg = 0)
+            : m_enabled(IsEnabled())
+        {
+            if (m_enabled)
+                m_event = { name, argname, arg, Now(), 0 };
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        ~Span()
+        {
+            if (m_enabled)
+            {
+                m_event.end = Now();
+                g_recorder.Add(m_event);
+            }
+        }
+
+    private:
+        const bool m_enabled;
+        Event m_event;
+    };
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "UnicodeTables.h"
+
+// Cell widths and extended grapheme clusters (UAX #29) for text held as UTF-16,
+// or for 8 and 32 bit characters as one code point per character.
+// Every property is a single lookup in the tables generated by Tools/UnicodeTables.py.
+namespace Unicode
+{
+    inline GraphemeBreak GetGraphemeBreak(const char32_t c) { return GraphemeBreak(GetProperties(c) & Tables::GraphemeBreakMask); }
+    inline bool IsExtendedPictographic(const char32_t c) { return (GetProperties(c) & Tables::Pictographic) != 0; }
+
+    // 0 for marks and controls, 2 for East Asian Wide and Fullwidth
+    inline int GetWidth(const char32_t c) { return GetProperties(c) >> Tables::WidthShift; }
+
+    // Returns the code point starting at i, *pNext is the index after it
+    // Unpaired surrogates are returned as is
+    template <class C>
+    char32_t Decode(const C* s, const size_t length, const size_t i, size_t* pNext)
+    {
+        const char32_t c = sizeof(C) == 1 ? uint8_t(s[i]) : sizeof(C) == 2 ? uint16_t(s[i]) : char32_t(s[i]);
+        *pNext = i + 1;
+        if (sizeof(C) == 2 && c >= 0xD800 && c < 0xDC00 && (i + 1) < length)
+        {
+            const char32_t low = uint16_t(s[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                *pNext = i + 2;
+                return 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            }
+        }
+        return c;
+    }
+
+    // Returns the code point ending before i, *pPrev is the index it starts at
+    template <class C>
+    char32_t DecodeBack(const C* s, const size_t i, size_t* pPrev)
+    {
+        size_t prev = i - 1;
+        if (sizeof(C) == 2 && prev > 0)
+        {
+            const char32_t low = uint16_t(s[prev]);
+            const char32_t high = uint16_t(s[prev - 1]);
+            if (low >= 0xDC00 && low < 0xE000 && high >= 0xD800 && high < 0xDC00)
+                --prev;
+        }
+        *pPrev = prev;
+        size_t next = 0;
+        return Decode(s, i, prev, &next);
+    }
+
+    // Feed code points in order, reports the boundaries between them
+    class GraphemeBreaker
+    {
+    public:
+        GraphemeBreaker()
+            : m_prev(GB_Control), m_emoji(NoEmoji), m_ri_odd(false), m_started(false)
+        {
+        }
+
+        // Returns whether there is a boundary before c, always true for the first code point
+        bool Next(const char32_t c)
+        {
+            const uint8_t p = GetProperties(c);
+            const GraphemeBreak gb = GraphemeBreak(p & Tables::GraphemeBreakMask);
+            const bool pictographic = (p & Tables::Pictographic) != 0;
+            const bool boundary = !m_started || IsBoundary(gb, pictographic);
+
+            if (gb == GB_Regional_Indicator)
+                m_ri_odd = m_prev == GB_Regional_Indicator && !boundary ? !m_ri_odd : true;
+            else
+                m_ri_odd = false;
+
+            if (pictographic)
+                m_emoji = Emoji;
+            else if (gb == GB_Extend && m_emoji == Emoji)
+                m_emoji = Emoji;
+            else if (gb == GB_ZWJ && m_emoji == Emoji)
+                m_emoji = EmojiZWJ;
+            else
+                m_emoji = NoEmoji;
+
+            m_prev = gb;
+            m_started = true;
+            return boundary;
+        }
+
+    private:
+        // Progress through GB11, ExtPict Extend* ZWJ x ExtPict
+        enum eEmoji : uint8_t { NoEmoji, Emoji, EmojiZWJ };
+
+        bool IsBoundary(const GraphemeBreak gb, const bool pictographic) const
+        {
+            if (m_prev == GB_CR && gb == GB_LF)                                             // GB3
+                return false;
+            if (m_prev == GB_Control || m_prev == GB_CR || m_prev == GB_LF)                 // GB4
+                return true;
+            if (gb == GB_Control || gb == GB_CR || gb == GB_LF)                             // GB5
+                return true;
+            if (m_prev == GB_L && (gb == GB_L || gb == GB_V || gb == GB_LV || gb == GB_LVT)) // GB6
+                return false;
+            if ((m_prev == GB_LV || m_prev == GB_V) && (gb == GB_V || gb == GB_T))          // GB7
+                return false;
+            if ((m_prev == GB_LVT || m_prev == GB_T) && gb == GB_T)                         // GB8
+                return false;
+            if (gb == GB_Extend || gb == GB_ZWJ || gb == GB_SpacingMark)                    // GB9, GB9a
+                return false;
+            if (m_prev == GB_Prepend)                                                       // GB9b
+                return false;
+            if (m_emoji == EmojiZWJ && pictographic)                                        // GB11
+                return false;
+            if (m_prev == GB_Regional_Indicator && gb == GB_Regional_Indicator && m_ri_odd) // GB12, GB13
+                return false;
+            return true;                                                                    // GB999
+        }
+
+        GraphemeBreak m_prev;
+        eEmoji m_emoji;
+        bool m_ri_odd;      // Odd number of regional indicators in a row up to m_prev
+        bool m_started;
+    };
+
+    // Returns the end of the grapheme cluster starting at i
+    template <class C>
+    size_t NextGrapheme(const C* s, const size_t length, size_t i)
+    {
+        if (i >= length)
+            return length;
+        GraphemeBreaker breaker;
+        breaker.Next(Decode(s, length, i, &i));
+        while (i < length)
+        {
+            size_t next = 0;
+            if (breaker.Next(Decode(s, length, i, &next)))
+                break;
+            i = next;
+        }
+        return i;
+    }
+
+    // Returns the start of the grapheme cluster ending at i
+    // Only scans back as far as the last code point the break rules don't need any context before
+    template <class C>
+    size_t PrevGrapheme(const C* s, const size_t length, const size_t i)
+    {
+        size_t end = i;
+        while (end > 0)
+        {
+            // After any code point but these the breaker state doesn't depend on what came before it
+            size_t start = end;
+            GraphemeBreak gb;
+            do
+                gb = GetGraphemeBreak(DecodeBack(s, start, &start));
+            while (start > 0 && (gb == GB_Extend || gb == GB_ZWJ || gb == GB_Regional_Indicator));
+
+            // start isn't known to be a boundary, but every boundary found after it is correct
+            GraphemeBreaker breaker;
+            size_t last = start;
+            for (size_t j = start; j < i;)
+            {
+                size_t next = 0;
+                if (breaker.Next(Decode(s, length, j, &next)))
+                    last = j;
+                j = next;
+            }
+            if (last > start || start == 0)
+                return last;
+            end = start;
+        }
+        return 0;
+    }
+
+    // Cells taken by a single grapheme cluster, the width of its base character
+    // except emoji presentation and flags which are always two cells
+    template <class C>
+    int GetGraphemeWidth(const C* s, const size_t length)
+    {
+        if (length == 0)
+            return 0;
+        size_t i = 0;
+        const char32_t base = Decode(s, length, i, &i);
+        int width = GetWidth(base);
+        if (width < 2 && i < length)
+        {
+            size_t next = 0;
+            const char32_t c = Decode(s, length, i, &next);
+            if ((c == 0xFE0F && IsExtendedPictographic(base))
+                || (GetGraphemeBreak(base) == GB_Regional_Indicator && GetGraphemeBreak(c) == GB_Regional_Indicator))
+                width = 2;
+        }
+        return width;
+    }
+}
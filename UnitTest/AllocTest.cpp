@@ -0,0 +1,132 @@
+#include "FakeConsole.h"
+#include "RadReadConsole.h"
+#include "UnitTest.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+// Counts the heap allocations made while a read takes keys, through operator new and an allocator given with
+// RadSetAllocator, and checks typing and editing a line makes none. Setting up the read and adding the line to the
+// history when it returns may allocate.
+
+const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+
+// Only allocations on the thread reading are counted, not those of the emulated console taking the keys
+thread_local bool t_counting = false;
+std::atomic<long> g_allocations(0);
+
+void* Allocate(const size_t size, const size_t alignment)
+{
+    if (t_counting)
+        ++g_allocations;
+    void* p = alignment <= alignof(std::max_align_t) ? malloc(size) : aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(const size_t size) { return Allocate(size, alignof(std::max_align_t)); }
+void* operator new(const size_t size, const std::align_val_t alignment) { return Allocate(size, size_t(alignment)); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+LPVOID HostAlloc(const SIZE_T nBytes, const SIZE_T nAlignment, LPVOID lpContext)
+{
+    ++*static_cast<long*>(lpContext);
+    return Allocate(nBytes, nAlignment);
+}
+
+void HostFree(const LPVOID lpMemory, SIZE_T, SIZE_T, LPVOID)
+{
+    free(lpMemory);
+}
+
+// The keys for one character of the line, typing it and editing around it
+void Keys(const WCHAR c)
+{
+    FakeConsole::Key(WORD(c - L'a' + 'A'), c);
+    FakeConsole::Key(VK_LEFT, 0);
+    FakeConsole::Key(VK_RIGHT, 0);
+    FakeConsole::Key(WORD('X'), L'x');
+    FakeConsole::Key(VK_BACK, L'\b');
+    FakeConsole::Key(VK_HOME, 0);
+    FakeConsole::Key(VK_END, 0);
+}
+
+// Sends the keys for c once the previous ones have been taken and drawn
+void SendKeys(const WCHAR c)
+{
+    while (FakeConsole::Pending() > 0)
+        std::this_thread::yield();
+    const long writes = FakeConsole::GetCounters().screen_writes;
+    Keys(c);
+    CHECK(FakeConsole::WaitForWrite(writes, 10 * 1000));
+    while (FakeConsole::Pending() > 0)
+        std::this_thread::yield();
+}
+
+// The allocations while reading a line of length characters, from after the keys for the first to before the Enter
+long KeyAllocations(const size_t length)
+{
+    std::wstring line;
+    for (size_t i = 0; i < length; ++i)
+        line += WCHAR(L'a' + i % 26);
+
+    std::thread reader([&line]()
+        {
+            static WCHAR buffer[1024];
+            DWORD read = 0;
+            t_counting = true;
+            CHECK(RadReadConsole(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+            t_counting = false;
+            CHECK(std::wstring(buffer, read) == line + L"\r\n");
+        });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+
+    SendKeys(line[0]);
+    const long start = g_allocations;
+    for (size_t i = 1; i < length; ++i)
+        SendKeys(line[i]);
+    const long allocations = g_allocations - start;
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+    return allocations;
+}
+
+void TestKeys(LPCWSTR lpName)
+{
+    FakeConsole::Reset(80, 25);
+    if (lpName != nullptr)
+        FakeConsole::SetEnvironment(lpName, L"1");
+
+    // The first read loads the history
+    KeyAllocations(4);
+    const long allocations = KeyAllocations(64);
+    std::string name;
+    for (LPCWSTR c = lpName; c != nullptr && *c != L'\0'; ++c)
+        name += char(*c);
+    printf("%-16s %12ld\n", name.c_str(), allocations);
+    CHECK(allocations == 0);
+}
+
+int main()
+{
+    printf("%-16s %12s\n", "", "allocations");
+    LPCWSTR options[] = { nullptr, L"RAD_HIGHLIGHT", L"RAD_AUTOSUGGEST", L"RAD_MULTILINE" };
+    for (const LPCWSTR name : options)
+        TestKeys(name);
+
+    long host = 0;
+    CHECK(RadSetAllocator(HostAlloc, HostFree, &host));
+    TestKeys(L"RAD_AUTOSUGGEST");
+    CHECK(host > 0);
+    CHECK(RadSetAllocator(nullptr, nullptr, nullptr));
+
+    return g_failures;
+}
@@ -0,0 +1,219 @@
+#include "CommandIndex.h"
+#include "UnitTest.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Runs Refresh against a fake tree of directories with modified times, and checks an index saved and
+// loaded again is the same, and that truncated or corrupt data is rejected.
+
+typedef std::u16string String;
+typedef CommandIndex<char16_t> Index;
+
+struct FakeTree
+{
+    struct Directory
+    {
+        uint64_t time;
+        std::vector<String> files;
+    };
+
+    std::map<String, Directory> dirs;
+    std::vector<String> listed;
+
+    // A directory in the tree can be found with a different case, as on Windows
+    const Directory* Find(const String& path) const
+    {
+        for (const auto& d : dirs)
+            if (CommandNames<char16_t>::Compare(d.first.data(), d.first.length(), path.data(), path.length()) == 0)
+                return &d.second;
+        return nullptr;
+    }
+
+    bool Refresh(Index& index, const std::vector<String>& path)
+    {
+        const std::vector<String> exts = { u".EXE", u".CMD" };
+        listed.clear();
+        return index.Refresh(path, exts,
+            [this](const String& dir, uint64_t* pTime)
+            {
+                const Directory* d = Find(dir);
+                if (d != nullptr)
+                    *pTime = d->time;
+                return d != nullptr;
+            },
+            [this](const String& dir, std::vector<String>& files)
+            {
+                listed.push_back(dir);
+                const Directory* d = Find(dir);
+                if (d != nullptr)
+                    files.insert(files.end(), d->files.begin(), d->files.end());
+                return d != nullptr;
+            });
+    }
+};
+
+std::vector<String> Names(const Index& index)
+{
+    CommandNames<char16_t> names;
+    index.GetNames(names);
+    std::vector<String> v;
+    for (size_t i = 0; i < names.size(); ++i)
+        v.push_back(names[i]);
+    return v;
+}
+
+std::vector<String> Find(const Index& index, const String& prefix)
+{
+    CommandNames<char16_t> names;
+    index.GetNames(names);
+    const std::pair<size_t, size_t> found = names.Find(prefix.data(), prefix.length());
+    std::vector<String> v;
+    for (size_t i = found.first; i < found.second; ++i)
+        v.push_back(names[i]);
+    return v;
+}
+
+FakeTree MakeTree()
+{
+    FakeTree tree;
+    tree.dirs[u"C:\\Windows"] = { 1, { u"notepad.exe", u"explorer.exe", u"win.ini", u"system.dll" } };
+    tree.dirs[u"C:\\Windows\\System32"] = { 2, { u"cmd.exe", u"NOTEPAD.EXE", u"where.exe", u"help.cmd", u"kernel32.dll" } };
+    tree.dirs[u"C:\\Tools"] = { 3, { u"git.exe", u"gitk.cmd", u".exe", u"readme.txt" } };
+    return tree;
+}
+
+const std::vector<String> Path = { u"C:\\Windows\\System32", u"C:\\Windows", u"C:\\Tools", u"C:\\Missing", u"c:\\windows" };
+
+void TestRefresh()
+{
+    FakeTree tree = MakeTree();
+    Index index;
+
+    CHECK(tree.Refresh(index, Path));
+    CHECK(tree.listed.size() == 3);     // Not the missing directory or the same one again in another case
+    // Only executables, sorted ignoring case, of names differing in case the first in PATH is kept
+    const std::vector<String> all = { u"cmd.exe", u"explorer.exe", u"git.exe", u"gitk.cmd", u"help.cmd", u"NOTEPAD.EXE", u"where.exe" };
+    CHECK(Names(index) == all);
+    CHECK(Find(index, u"GI") == std::vector<String>({ u"git.exe", u"gitk.cmd" }));
+    CHECK(Find(index, u"z").empty());
+
+    // Nothing changed, nothing is listed again
+    CHECK(!tree.Refresh(index, Path));
+    CHECK(tree.listed.empty());
+    CHECK(Names(index) == all);
+
+    // Only the changed directory is listed again
+    tree.dirs[u"C:\\Tools"] = { 4, { u"git.exe", u"rg.exe" } };
+    CHECK(tree.Refresh(index, Path));
+    CHECK(tree.listed == std::vector<String>({ u"C:\\Tools" }));
+    CHECK(Find(index, u"r") == std::vector<String>({ u"rg.exe" }));
+    CHECK(Find(index, u"gitk").empty());
+
+    // A directory appearing in PATH
+    tree.dirs[u"C:\\Missing"] = { 5, { u"new.exe" } };
+    CHECK(tree.Refresh(index, Path));
+    CHECK(tree.listed == std::vector<String>({ u"C:\\Missing" }));
+    CHECK(Find(index, u"new") == std::vector<String>({ u"new.exe" }));
+
+    // PATH reordered changes which of notepad.exe and NOTEPAD.EXE is kept, without listing anything
+    CHECK(tree.Refresh(index, { u"C:\\Windows", u"C:\\Windows\\System32", u"C:\\Tools", u"C:\\Missing" }));
+    CHECK(tree.listed.empty());
+    CHECK(Find(index, u"note") == std::vector<String>({ u"notepad.exe" }));
+
+    // A directory removed from PATH and one removed from the tree
+    tree.dirs.erase(u"C:\\Missing");
+    CHECK(tree.Refresh(index, { u"C:\\Windows", u"C:\\Tools", u"C:\\Missing" }));
+    CHECK(tree.listed.empty());
+    CHECK(Find(index, u"cmd").empty());
+    CHECK(Find(index, u"new").empty());
+    CHECK(Names(index) == std::vector<String>({ u"explorer.exe", u"git.exe", u"notepad.exe", u"rg.exe" }));
+
+    CHECK(tree.Refresh(index, {}));
+    CHECK(Names(index).empty());
+}
+
+void TestSaveLoad()
+{
+    FakeTree tree = MakeTree();
+    Index index;
+    tree.Refresh(index, Path);
+    std::vector<uint8_t> data;
+    index.Save(data);
+
+    // Another process loads the cache and only lists what changed since
+    Index loaded;
+    CHECK(loaded.Load(data.data(), data.size()));
+    CHECK(Names(loaded) == Names(index));
+    CHECK(!tree.Refresh(loaded, Path));
+    CHECK(tree.listed.empty());
+    tree.dirs[u"C:\\Windows"].time = 10;
+    CHECK(tree.Refresh(loaded, Path));
+    CHECK(tree.listed == std::vector<String>({ u"C:\\Windows" }));
+    CHECK(Names(loaded) == Names(index));
+
+    std::vector<uint8_t> saved;
+    loaded.Save(saved);
+    CHECK(saved.size() == data.size());
+
+    // An empty index round trips
+    Index empty;
+    empty.Save(saved);
+    CHECK(loaded.Load(saved.data(), saved.size()));
+    CHECK(Names(loaded).empty());
+}
+
+// The cache is written by other processes and versions and can be cut short, it is never trusted
+void TestCorrupt()
+{
+    FakeTree tree = MakeTree();
+    Index index;
+    tree.Refresh(index, Path);
+    std::vector<uint8_t> data;
+    index.Save(data);
+
+    Index loaded;
+    for (size_t size = 0; size < data.size(); ++size)
+    {
+        loaded.Load(data.data(), data.size());
+        CHECK(!loaded.Load(data.data(), size));
+        CHECK(Names(loaded).empty());
+    }
+
+    // Magic, version and character size
+    for (const size_t offset : { 0, 4, 8 })
+    {
+        std::vector<uint8_t> bad(data);
+        bad[offset] ^= 1;
+        CHECK(!loaded.Load(bad.data(), bad.size()));
+        CHECK(Names(loaded).empty());
+    }
+    CommandIndex<char> narrow;
+    CHECK(!narrow.Load(data.data(), data.size()));
+
+    // Counts larger than the data are rejected without allocating for them
+    std::vector<uint8_t> huge(data.begin(), data.begin() + 12);
+    const uint8_t counts[][4] = { { 1, 0, 0, 0 }, { 0xFF, 0xFF, 0xFF, 0xFF } };
+    huge.insert(huge.end(), counts[0], counts[0] + 4);          // One directory
+    huge.insert(huge.end(), { 1, 0, 0, 0, 'a', 0 });            // Path
+    huge.insert(huge.end(), 8, 0);                              // Time
+    huge.insert(huge.end(), counts[1], counts[1] + 4);          // Names
+    huge.insert(huge.end(), { 1, 0, 0, 0, 'b', 0 });
+    CHECK(!loaded.Load(huge.data(), huge.size()));
+    huge[12] = 0xFF;
+    huge[13] = 0xFF;
+    CHECK(!loaded.Load(huge.data(), huge.size()));
+    huge.resize(16);
+    huge.insert(huge.end(), { 0xFF, 0xFF, 0xFF, 0x7F });        // Path length
+    CHECK(!loaded.Load(huge.data(), huge.size()));
+    CHECK(Names(loaded).empty());
+}
+
+int main()
+{
+    TestRefresh();
+    TestSaveLoad();
+    TestCorrupt();
+    return g_failures;
+}
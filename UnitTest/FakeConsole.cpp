@@ -0,0 +1,1324 @@
+#include "FakeConsole.h"
+#include "Utf.h"
+
+#include <shlwapi.h>
+#include <tchar.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The Windows functions the library calls, the console is emulated, files, pipes and threads go to POSIX.
+// Every object that can be waited on is guarded by one lock and one condition variable.
+
+namespace
+{
+    enum class Kind
+    {
+        ConsoleInput,
+        ConsoleOutput,
+        File,
+        Find,
+        Event,
+        Thread,
+    };
+
+    struct Object
+    {
+        explicit Object(const Kind kind)
+            : kind(kind)
+        {
+        }
+
+        virtual ~Object() {}
+
+        const Kind kind;
+    };
+
+    struct File : Object
+    {
+        File(const int fd, const bool pipe)
+            : Object(Kind::File), fd(fd), pipe(pipe)
+        {
+        }
+
+        ~File() override { close(fd); }
+
+        const int fd;
+        const bool pipe;
+    };
+
+    struct Find : Object
+    {
+        Find(DIR* dir, const std::string& path)
+            : Object(Kind::Find), dir(dir), path(path)
+        {
+        }
+
+        ~Find() override { closedir(dir); }
+
+        DIR* const dir;
+        const std::string path;
+    };
+
+    struct Event : Object
+    {
+        Event(const bool manual, const bool signaled)
+            : Object(Kind::Event), manual(manual), signaled(signaled)
+        {
+        }
+
+        const bool manual;
+        bool signaled;      // Guarded by g_lock
+    };
+
+    // Released by both the handle and the thread
+    struct Thread : Object
+    {
+        Thread()
+            : Object(Kind::Thread), done(false), refs(2)
+        {
+        }
+
+        bool done;          // Guarded by g_lock
+        int refs;           // Guarded by g_lock
+    };
+
+    // Waits that would be INFINITE fail the test instead of hanging it
+    const DWORD Watchdog = 60 * 1000;
+
+    std::mutex g_lock;
+    std::condition_variable g_changed;
+
+    Object g_input(Kind::ConsoleInput);
+    Object g_output(Kind::ConsoleOutput);
+
+    const DWORD DefaultInputMode = ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT | ENABLE_INSERT_MODE;
+    const DWORD DefaultOutputMode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+
+    // Guarded by g_lock
+    struct Console
+    {
+        SHORT width = 80;
+        SHORT height = 25;
+        std::vector<WCHAR> cells = std::vector<WCHAR>(80 * 25, L' ');
+        std::vector<WORD> attrs = std::vector<WORD>(80 * 25, 7);
+        COORD cursor = { 0, 0 };
+        CONSOLE_CURSOR_INFO cursor_info = { 25, TRUE };
+        DWORD input_mode = DefaultInputMode;
+        DWORD output_mode = DefaultOutputMode;
+        UINT code_page = 437;
+        std::deque<INPUT_RECORD> input;
+        std::map<std::wstring, std::wstring> environment;
+        FakeConsole::Counters counters = {};
+    } g_console;
+
+    thread_local DWORD t_error = ERROR_SUCCESS;
+
+    const std::chrono::steady_clock::time_point g_start = std::chrono::steady_clock::now();
+
+    DWORD Fail(const DWORD error)
+    {
+        t_error = error;
+        return FALSE;
+    }
+
+    File* AsFile(const HANDLE h)
+    {
+        Object* o = static_cast<Object*>(h);
+        return o != nullptr && h != INVALID_HANDLE_VALUE && o->kind == Kind::File ? static_cast<File*>(o) : nullptr;
+    }
+
+    bool IsConsole(const HANDLE h, const Kind kind)
+    {
+        return h == &g_input ? kind == Kind::ConsoleInput : h == &g_output ? kind == Kind::ConsoleOutput : false;
+    }
+
+    std::string Narrow(LPCWSTR s)
+    {
+        const size_t length = _tcslen(s);
+        std::string out(Utf::Utf8Size(length) + 3, '\0');
+        Utf::Utf16ToUtf8<WCHAR> utf8;
+        size_t bytes = utf8.Convert(s, length, reinterpret_cast<uint8_t*>(&out[0]));
+        bytes += utf8.Finish(reinterpret_cast<uint8_t*>(&out[bytes]));
+        out.resize(bytes);
+        return out;
+    }
+
+    std::wstring Widen(const char* s, const size_t length)
+    {
+        std::wstring out(Utf::Utf16Size(length) + 4, L'\0');
+        Utf::Utf8ToUtf16<WCHAR> utf16;
+        size_t chars = utf16.Convert(reinterpret_cast<const uint8_t*>(s), length, &out[0]);
+        chars += utf16.Finish(&out[chars]);
+        out.resize(chars);
+        return out;
+    }
+
+    // Windows paths as POSIX paths
+    std::string PathName(LPCWSTR lpFileName)
+    {
+        std::string path = Narrow(lpFileName);
+        std::replace(path.begin(), path.end(), '\\', '/');
+        return path;
+    }
+
+    FILETIME ToFileTime(const timespec& ts)
+    {
+        const ULONGLONG t = ULONGLONG(ts.tv_sec) * 10000000 + ULONGLONG(ts.tv_nsec) / 100 + 116444736000000000ULL;
+        FILETIME ft = { DWORD(t), DWORD(t >> 32) };
+        return ft;
+    }
+
+    bool IsReady(Object* o)
+    {
+        if (o == &g_input)
+            return !g_console.input.empty();
+        switch (o->kind)
+        {
+        case Kind::Event: return static_cast<Event*>(o)->signaled;
+        case Kind::Thread: return static_cast<Thread*>(o)->done;
+        default: return true;
+        }
+    }
+
+    void Acquired(Object* o)
+    {
+        if (o->kind == Kind::Event && !static_cast<Event*>(o)->manual)
+            static_cast<Event*>(o)->signaled = false;
+    }
+
+    void Release(Thread* t)
+    {
+        if (--t->refs == 0)
+            delete t;
+    }
+
+    void Changed()
+    {
+        g_changed.notify_all();
+    }
+
+    // Screen, g_lock held
+    WCHAR& Cell(const long i) { return g_console.cells[size_t(i)]; }
+    long CellCount() { return long(g_console.width) * g_console.height; }
+    long CellIndex(const COORD c) { return long(c.Y) * g_console.width + c.X; }
+
+    bool IsInside(const COORD c)
+    {
+        return c.X >= 0 && c.Y >= 0 && c.X < g_console.width && c.Y < g_console.height;
+    }
+
+    void ScrollUp()
+    {
+        std::move(g_console.cells.begin() + g_console.width, g_console.cells.end(), g_console.cells.begin());
+        std::move(g_console.attrs.begin() + g_console.width, g_console.attrs.end(), g_console.attrs.begin());
+        std::fill(g_console.cells.end() - g_console.width, g_console.cells.end(), L' ');
+        std::fill(g_console.attrs.end() - g_console.width, g_console.attrs.end(), WORD(7));
+    }
+
+    void NewLine()
+    {
+        g_console.cursor.X = 0;
+        if (++g_console.cursor.Y == g_console.height)
+        {
+            ScrollUp();
+            --g_console.cursor.Y;
+        }
+    }
+
+    // As WriteConsole with processed output, a character written in the last column wraps the cursor
+    void Put(const WCHAR c)
+    {
+        COORD& cursor = g_console.cursor;
+        switch (c)
+        {
+        case L'\r':
+            cursor.X = 0;
+            break;
+        case L'\n':
+            NewLine();
+            break;
+        case L'\b':
+            if (cursor.X > 0)
+                --cursor.X;
+            break;
+        case L'\a':
+            break;
+        default:
+            Cell(CellIndex(cursor)) = c;
+            g_console.attrs[size_t(CellIndex(cursor))] = 7;
+            if (++cursor.X == g_console.width)
+            {
+                if (g_console.output_mode & ENABLE_WRAP_AT_EOL_OUTPUT)
+                    NewLine();
+                else
+                    --cursor.X;
+            }
+            break;
+        }
+    }
+
+    template <class F>
+    DWORD ForCells(const COORD c, const DWORD length, F f)
+    {
+        if (!IsInside(c))
+            return 0;
+        const long start = CellIndex(c);
+        const DWORD n = DWORD(std::min(long(length), CellCount() - start));
+        for (DWORD i = 0; i < n; ++i)
+            f(start + long(i), i);
+        return n;
+    }
+
+    // The text of the A functions is in the console code page
+    std::wstring Decode(const char* s, const DWORD length)
+    {
+        std::wstring wide(length, L'\0');
+        wide.resize(length > 0 ? size_t(MultiByteToWideChar(g_console.code_page, 0, s, int(length), &wide[0], int(length))) : 0);
+        return wide;
+    }
+
+    std::string Encode(const WCHAR* s, const DWORD length)
+    {
+        std::string bytes(size_t(length) * 4, '\0');
+        bytes.resize(length > 0 ? size_t(WideCharToMultiByte(g_console.code_page, 0, s, int(length), &bytes[0], int(bytes.size()), nullptr, nullptr)) : 0);
+        return bytes;
+    }
+
+    void Wrote()
+    {
+        ++g_console.counters.screen_writes;
+        Changed();
+    }
+
+    void QueueKey(const WORD vk, const WCHAR c, const DWORD control)
+    {
+        INPUT_RECORD ir = {};
+        ir.EventType = KEY_EVENT;
+        ir.Event.KeyEvent.bKeyDown = TRUE;
+        ir.Event.KeyEvent.wRepeatCount = 1;
+        ir.Event.KeyEvent.wVirtualKeyCode = vk;
+        ir.Event.KeyEvent.uChar.UnicodeChar = c;
+        ir.Event.KeyEvent.dwControlKeyState = control;
+        g_console.input.push_back(ir);
+        ir.Event.KeyEvent.bKeyDown = FALSE;
+        g_console.input.push_back(ir);
+    }
+
+    // As a US keyboard
+    WORD VirtualKey(const WCHAR c, DWORD* pControl)
+    {
+        *pControl = 0;
+        if (c >= L'a' && c <= L'z')
+            return WORD(c - L'a' + 'A');
+        if (c >= L'A' && c <= L'Z')
+        {
+            *pControl = SHIFT_PRESSED;
+            return WORD(c);
+        }
+        if (c >= L'0' && c <= L'9')
+            return WORD(c);
+        switch (c)
+        {
+        case L'\r': return VK_RETURN;
+        case L'\t': return VK_TAB;
+        case L'\b': return VK_BACK;
+        case L'\x1B': return VK_ESCAPE;
+        case L' ': return WORD(' ');
+        default: return 0;
+        }
+    }
+
+    int CompareFold(LPCWSTR a, LPCWSTR b)
+    {
+        for (;; ++a, ++b)
+        {
+            const WCHAR fa = *a >= L'A' && *a <= L'Z' ? WCHAR(*a - L'A' + L'a') : *a;
+            const WCHAR fb = *b >= L'A' && *b <= L'Z' ? WCHAR(*b - L'A' + L'a') : *b;
+            if (fa != fb)
+                return fa < fb ? -1 : 1;
+            if (fa == L'\0')
+                return 0;
+        }
+    }
+
+    bool FindNext(Find* f, LPWIN32_FIND_DATAW lpFindFileData)
+    {
+        const dirent* entry = readdir(f->dir);
+        if (entry == nullptr)
+            return false;
+
+        *lpFindFileData = {};
+        struct stat st = {};
+        if (stat((f->path + "/" + entry->d_name).c_str(), &st) == 0)
+        {
+            lpFindFileData->dwFileAttributes = S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+            lpFindFileData->ftLastWriteTime = ToFileTime(st.st_mtim);
+            lpFindFileData->nFileSizeLow = DWORD(st.st_size);
+            lpFindFileData->nFileSizeHigh = DWORD(uint64_t(st.st_size) >> 32);
+        }
+        const std::wstring name = Widen(entry->d_name, strlen(entry->d_name));
+        const size_t length = std::min(name.length(), size_t(MAX_PATH - 1));
+        std::char_traits<WCHAR>::copy(lpFindFileData->cFileName, name.data(), length);
+        lpFindFileData->cFileName[length] = L'\0';
+        return true;
+    }
+}
+
+// char_traits<wchar_t> calls these, the C library's assume 4 byte wchar_t
+extern "C"
+{
+    size_t wcslen(const wchar_t* s)
+    {
+        return _tcslen(s);
+    }
+
+    // <cwchar> declares the C++ overloads of this one under the same name
+    wchar_t* FakeWmemchr(const wchar_t* s, wchar_t c, size_t n) __asm__("wmemchr");
+
+    wchar_t* FakeWmemchr(const wchar_t* s, const wchar_t c, size_t n)
+    {
+        for (; n > 0; --n, ++s)
+            if (*s == c)
+                return const_cast<wchar_t*>(s);
+        return nullptr;
+    }
+
+    int wmemcmp(const wchar_t* a, const wchar_t* b, size_t n)
+    {
+        for (; n > 0; --n, ++a, ++b)
+            if (*a != *b)
+                return uint16_t(*a) < uint16_t(*b) ? -1 : 1;
+        return 0;
+    }
+
+    wchar_t* wmemcpy(wchar_t* d, const wchar_t* s, const size_t n)
+    {
+        return static_cast<wchar_t*>(memcpy(d, s, n * sizeof(wchar_t)));
+    }
+
+    wchar_t* wmemmove(wchar_t* d, const wchar_t* s, const size_t n)
+    {
+        return static_cast<wchar_t*>(memmove(d, s, n * sizeof(wchar_t)));
+    }
+
+    wchar_t* wmemset(wchar_t* d, const wchar_t c, const size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            d[i] = c;
+        return d;
+    }
+}
+
+namespace FakeConsole
+{
+    void Reset(const SHORT width, const SHORT height)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        g_console = Console();
+        g_console.width = width;
+        g_console.height = height;
+        g_console.cells.assign(size_t(width) * height, L' ');
+        g_console.attrs.assign(size_t(width) * height, 7);
+        Changed();
+    }
+
+    void Resize(const SHORT width, const SHORT height)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        std::vector<WCHAR> cells(size_t(width) * height, L' ');
+        std::vector<WORD> attrs(size_t(width) * height, 7);
+        for (SHORT y = 0; y < std::min(height, g_console.height); ++y)
+            for (SHORT x = 0; x < std::min(width, g_console.width); ++x)
+            {
+                cells[size_t(y) * width + x] = g_console.cells[size_t(y) * g_console.width + x];
+                attrs[size_t(y) * width + x] = g_console.attrs[size_t(y) * g_console.width + x];
+            }
+        g_console.width = width;
+        g_console.height = height;
+        g_console.cells.swap(cells);
+        g_console.attrs.swap(attrs);
+        g_console.cursor.X = std::min(g_console.cursor.X, SHORT(width - 1));
+        g_console.cursor.Y = std::min(g_console.cursor.Y, SHORT(height - 1));
+
+        if (g_console.input_mode & ENABLE_WINDOW_INPUT)
+        {
+            INPUT_RECORD ir = {};
+            ir.EventType = WINDOW_BUFFER_SIZE_EVENT;
+            ir.Event.WindowBufferSizeEvent.dwSize = { width, height };
+            g_console.input.push_back(ir);
+        }
+        Changed();
+    }
+
+    void Key(const WORD wVirtualKeyCode, const WCHAR c, const DWORD dwControlKeyState)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        QueueKey(wVirtualKeyCode, c, dwControlKeyState);
+        Changed();
+    }
+
+    void Type(const std::wstring& text)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        for (const WCHAR c : text)
+        {
+            DWORD control = 0;
+            const WORD vk = VirtualKey(c, &control);
+            QueueKey(vk, c, control);
+        }
+        Changed();
+    }
+
+    size_t Pending()
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        return g_console.input.size();
+    }
+
+    std::wstring Row(const SHORT y)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        std::wstring row(g_console.cells.begin() + long(y) * g_console.width, g_console.cells.begin() + long(y + 1) * g_console.width);
+        row.erase(row.find_last_not_of(L' ') + 1);
+        return row;
+    }
+
+    COORD Cursor()
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        return g_console.cursor;
+    }
+
+    DWORD InputMode()
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        return g_console.input_mode;
+    }
+
+    DWORD OutputMode()
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        return g_console.output_mode;
+    }
+
+    void SetCodePage(const UINT CodePage)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        g_console.code_page = CodePage;
+    }
+
+    void SetEnvironment(LPCWSTR lpName, LPCWSTR lpValue)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        if (lpValue != nullptr)
+            g_console.environment[lpName] = lpValue;
+        else
+            g_console.environment.erase(lpName);
+    }
+
+    Counters GetCounters()
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        return g_console.counters;
+    }
+
+    bool WaitForWrite(const long screen_writes, const DWORD dwMilliseconds)
+    {
+        std::unique_lock<std::mutex> lock(g_lock);
+        return g_changed.wait_for(lock, std::chrono::milliseconds(dwMilliseconds), [screen_writes]() { return g_console.counters.screen_writes > screen_writes; });
+    }
+}
+
+// Console
+
+HANDLE GetStdHandle(const DWORD nStdHandle)
+{
+    return nStdHandle == STD_INPUT_HANDLE ? &g_input : &g_output;
+}
+
+BOOL GetConsoleMode(const HANDLE hConsoleHandle, const LPDWORD lpMode)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    ++g_console.counters.mode_calls;
+    if (IsConsole(hConsoleHandle, Kind::ConsoleInput))
+        *lpMode = g_console.input_mode;
+    else if (IsConsole(hConsoleHandle, Kind::ConsoleOutput))
+        *lpMode = g_console.output_mode;
+    else
+        return Fail(ERROR_INVALID_HANDLE);
+    return TRUE;
+}
+
+BOOL SetConsoleMode(const HANDLE hConsoleHandle, const DWORD dwMode)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    ++g_console.counters.mode_calls;
+    if (IsConsole(hConsoleHandle, Kind::ConsoleInput))
+        g_console.input_mode = dwMode;
+    else if (IsConsole(hConsoleHandle, Kind::ConsoleOutput))
+        g_console.output_mode = dwMode;
+    else
+        return Fail(ERROR_INVALID_HANDLE);
+    return TRUE;
+}
+
+UINT GetConsoleCP()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    return g_console.code_page;
+}
+
+HWND GetConsoleWindow()
+{
+    return nullptr;
+}
+
+BOOL GetConsoleScreenBufferInfo(const HANDLE hConsoleOutput, const PCONSOLE_SCREEN_BUFFER_INFO lpConsoleScreenBufferInfo)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    lpConsoleScreenBufferInfo->dwSize = { g_console.width, g_console.height };
+    lpConsoleScreenBufferInfo->dwCursorPosition = g_console.cursor;
+    lpConsoleScreenBufferInfo->wAttributes = 7;
+    lpConsoleScreenBufferInfo->srWindow = { 0, 0, SHORT(g_console.width - 1), SHORT(g_console.height - 1) };
+    lpConsoleScreenBufferInfo->dwMaximumWindowSize = lpConsoleScreenBufferInfo->dwSize;
+    return TRUE;
+}
+
+BOOL GetConsoleCursorInfo(const HANDLE hConsoleOutput, CONSOLE_CURSOR_INFO* const lpConsoleCursorInfo)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpConsoleCursorInfo = g_console.cursor_info;
+    return TRUE;
+}
+
+BOOL SetConsoleCursorInfo(const HANDLE hConsoleOutput, const CONSOLE_CURSOR_INFO* const lpConsoleCursorInfo)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_console.cursor_info = *lpConsoleCursorInfo;
+    return TRUE;
+}
+
+BOOL SetConsoleCursorPosition(const HANDLE hConsoleOutput, const COORD dwCursorPosition)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    if (!IsInside(dwCursorPosition))
+        return Fail(ERROR_INSUFFICIENT_BUFFER);
+    g_console.cursor = dwCursorPosition;
+    Changed();
+    return TRUE;
+}
+
+BOOL WriteConsoleA(const HANDLE hConsoleOutput, const void* const lpBuffer, const DWORD nNumberOfCharsToWrite, const LPDWORD lpNumberOfCharsWritten, LPVOID)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    for (const WCHAR c : Decode(static_cast<const char*>(lpBuffer), nNumberOfCharsToWrite))
+        Put(c);
+    if (lpNumberOfCharsWritten != nullptr)
+        *lpNumberOfCharsWritten = nNumberOfCharsToWrite;
+    Wrote();
+    return TRUE;
+}
+
+BOOL WriteConsoleW(const HANDLE hConsoleOutput, const void* const lpBuffer, const DWORD nNumberOfCharsToWrite, const LPDWORD lpNumberOfCharsWritten, LPVOID)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    const WCHAR* s = static_cast<const WCHAR*>(lpBuffer);
+    for (DWORD i = 0; i < nNumberOfCharsToWrite; ++i)
+        Put(s[i]);
+    if (lpNumberOfCharsWritten != nullptr)
+        *lpNumberOfCharsWritten = nNumberOfCharsToWrite;
+    Wrote();
+    return TRUE;
+}
+
+BOOL WriteConsoleOutputCharacterA(const HANDLE hConsoleOutput, const LPCSTR lpCharacter, const DWORD nLength, const COORD dwWriteCoord, const LPDWORD lpNumberOfCharsWritten)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    const std::wstring text = Decode(lpCharacter, nLength);
+    const DWORD n = ForCells(dwWriteCoord, DWORD(text.length()), [&text](const long p, const DWORD i) { Cell(p) = text[i]; });
+    *lpNumberOfCharsWritten = n == text.length() ? nLength : DWORD(Encode(text.data(), n).length());
+    Wrote();
+    return TRUE;
+}
+
+BOOL WriteConsoleOutputCharacterW(const HANDLE hConsoleOutput, const LPCWSTR lpCharacter, const DWORD nLength, const COORD dwWriteCoord, const LPDWORD lpNumberOfCharsWritten)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfCharsWritten = ForCells(dwWriteCoord, nLength, [lpCharacter](const long p, const DWORD i) { Cell(p) = lpCharacter[i]; });
+    Wrote();
+    return TRUE;
+}
+
+BOOL WriteConsoleOutputAttribute(const HANDLE hConsoleOutput, const WORD* const lpAttribute, const DWORD nLength, const COORD dwWriteCoord, const LPDWORD lpNumberOfAttrsWritten)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfAttrsWritten = ForCells(dwWriteCoord, nLength, [lpAttribute](const long p, const DWORD i) { g_console.attrs[size_t(p)] = lpAttribute[i]; });
+    Wrote();
+    return TRUE;
+}
+
+BOOL FillConsoleOutputCharacterW(const HANDLE hConsoleOutput, const WCHAR cCharacter, const DWORD nLength, const COORD dwWriteCoord, const LPDWORD lpNumberOfCharsWritten)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfCharsWritten = ForCells(dwWriteCoord, nLength, [cCharacter](const long p, DWORD) { Cell(p) = cCharacter; });
+    Wrote();
+    return TRUE;
+}
+
+BOOL FillConsoleOutputAttribute(const HANDLE hConsoleOutput, const WORD wAttribute, const DWORD nLength, const COORD dwWriteCoord, const LPDWORD lpNumberOfAttrsWritten)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfAttrsWritten = ForCells(dwWriteCoord, nLength, [wAttribute](const long p, DWORD) { g_console.attrs[size_t(p)] = wAttribute; });
+    Wrote();
+    return TRUE;
+}
+
+BOOL ReadConsoleOutputCharacterA(const HANDLE hConsoleOutput, const LPSTR lpCharacter, const DWORD nLength, const COORD dwReadCoord, const LPDWORD lpNumberOfCharsRead)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::wstring cells;
+    ForCells(dwReadCoord, nLength, [&cells](const long p, DWORD) { cells += Cell(p); });
+    const std::string text = Encode(cells.data(), DWORD(cells.length()));
+    *lpNumberOfCharsRead = std::min(DWORD(text.length()), nLength);
+    memcpy(lpCharacter, text.data(), *lpNumberOfCharsRead);
+    return TRUE;
+}
+
+BOOL ReadConsoleOutputCharacterW(const HANDLE hConsoleOutput, const LPWSTR lpCharacter, const DWORD nLength, const COORD dwReadCoord, const LPDWORD lpNumberOfCharsRead)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfCharsRead = ForCells(dwReadCoord, nLength, [lpCharacter](const long p, const DWORD i) { lpCharacter[i] = Cell(p); });
+    return TRUE;
+}
+
+BOOL ReadConsoleOutputAttribute(const HANDLE hConsoleOutput, WORD* const lpAttribute, const DWORD nLength, const COORD dwReadCoord, const LPDWORD lpNumberOfAttrsRead)
+{
+    if (!IsConsole(hConsoleOutput, Kind::ConsoleOutput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    *lpNumberOfAttrsRead = ForCells(dwReadCoord, nLength, [lpAttribute](const long p, const DWORD i) { lpAttribute[i] = g_console.attrs[size_t(p)]; });
+    return TRUE;
+}
+
+// Only the modes the library falls back to ReadConsole for aren't emulated
+BOOL ReadConsoleA(HANDLE, LPVOID, DWORD, LPDWORD, PCONSOLE_READCONSOLE_CONTROL)
+{
+    return Fail(ERROR_CALL_NOT_IMPLEMENTED);
+}
+
+BOOL ReadConsoleW(HANDLE, LPVOID, DWORD, LPDWORD, PCONSOLE_READCONSOLE_CONTROL)
+{
+    return Fail(ERROR_CALL_NOT_IMPLEMENTED);
+}
+
+BOOL ReadConsoleInputW(const HANDLE hConsoleInput, const PINPUT_RECORD lpBuffer, const DWORD nLength, const LPDWORD lpNumberOfEventsRead)
+{
+    if (!IsConsole(hConsoleInput, Kind::ConsoleInput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::unique_lock<std::mutex> lock(g_lock);
+    if (!g_changed.wait_for(lock, std::chrono::milliseconds(Watchdog), []() { return !g_console.input.empty(); }))
+    {
+        fprintf(stderr, "FakeConsole: ReadConsoleInput waited %lu ms for input\n", Watchdog);
+        abort();
+    }
+    const DWORD n = DWORD(std::min(size_t(nLength), g_console.input.size()));
+    std::copy(g_console.input.begin(), g_console.input.begin() + n, lpBuffer);
+    g_console.input.erase(g_console.input.begin(), g_console.input.begin() + n);
+    *lpNumberOfEventsRead = n;
+    return TRUE;
+}
+
+BOOL PeekConsoleInputW(const HANDLE hConsoleInput, const PINPUT_RECORD lpBuffer, const DWORD nLength, const LPDWORD lpNumberOfEventsRead)
+{
+    if (!IsConsole(hConsoleInput, Kind::ConsoleInput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    const DWORD n = DWORD(std::min(size_t(nLength), g_console.input.size()));
+    std::copy(g_console.input.begin(), g_console.input.begin() + n, lpBuffer);
+    *lpNumberOfEventsRead = n;
+    return TRUE;
+}
+
+BOOL WriteConsoleInputW(const HANDLE hConsoleInput, const INPUT_RECORD* lpBuffer, const DWORD nLength, const LPDWORD lpNumberOfEventsWritten)
+{
+    if (!IsConsole(hConsoleInput, Kind::ConsoleInput))
+        return Fail(ERROR_INVALID_HANDLE);
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_console.input.insert(g_console.input.end(), lpBuffer, lpBuffer + nLength);
+    *lpNumberOfEventsWritten = nLength;
+    Changed();
+    return TRUE;
+}
+
+DWORD GetConsoleAliasA(LPSTR, LPSTR, DWORD, LPSTR)
+{
+    return Fail(ERROR_FILE_NOT_FOUND);
+}
+
+DWORD GetConsoleAliasW(LPWSTR, LPWSTR, DWORD, LPWSTR)
+{
+    return Fail(ERROR_FILE_NOT_FOUND);
+}
+
+DWORD GetConsoleAliasesLengthW(LPWSTR)
+{
+    return 0;
+}
+
+DWORD GetConsoleAliasesW(LPWSTR, DWORD, LPWSTR)
+{
+    return 0;
+}
+
+// Files and pipes
+
+HANDLE CreateFileW(const LPCWSTR lpFileName, const DWORD dwDesiredAccess, DWORD, LPSECURITY_ATTRIBUTES, const DWORD dwCreationDisposition, DWORD, HANDLE)
+{
+    int flags = (dwDesiredAccess & GENERIC_WRITE) ? ((dwDesiredAccess & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+    switch (dwCreationDisposition)
+    {
+    case CREATE_ALWAYS: flags |= O_CREAT | O_TRUNC; break;
+    case OPEN_ALWAYS: flags |= O_CREAT; break;
+    case OPEN_EXISTING: break;
+    default:
+        Fail(ERROR_CALL_NOT_IMPLEMENTED);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    const int fd = open(PathName(lpFileName).c_str(), flags | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        Fail(ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    }
+    return new File(fd, false);
+}
+
+BOOL ReadFile(const HANDLE hFile, const LPVOID lpBuffer, const DWORD nNumberOfBytesToRead, const LPDWORD lpNumberOfBytesRead, LPVOID)
+{
+    const File* f = AsFile(hFile);
+    if (f == nullptr)
+        return Fail(ERROR_INVALID_HANDLE);
+    ssize_t n;
+    while ((n = read(f->fd, lpBuffer, nNumberOfBytesToRead)) < 0 && errno == EINTR)
+        ;
+    *lpNumberOfBytesRead = n > 0 ? DWORD(n) : 0;
+    if (n < 0)
+        return Fail(ERROR_INVALID_HANDLE);
+    // The end of a pipe is an error, the end of a file isn't
+    if (n == 0 && f->pipe && nNumberOfBytesToRead > 0)
+        return Fail(ERROR_BROKEN_PIPE);
+    return TRUE;
+}
+
+BOOL WriteFile(const HANDLE hFile, const LPCVOID lpBuffer, const DWORD nNumberOfBytesToWrite, const LPDWORD lpNumberOfBytesWritten, LPVOID)
+{
+    if (IsConsole(hFile, Kind::ConsoleOutput))
+        return WriteConsoleA(hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, nullptr);
+    const File* f = AsFile(hFile);
+    if (f == nullptr)
+        return Fail(ERROR_INVALID_HANDLE);
+    const char* p = static_cast<const char*>(lpBuffer);
+    DWORD written = 0;
+    while (written < nNumberOfBytesToWrite)
+    {
+        const ssize_t n = write(f->fd, p + written, nNumberOfBytesToWrite - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += DWORD(n);
+    }
+    if (lpNumberOfBytesWritten != nullptr)
+        *lpNumberOfBytesWritten = written;
+    return written == nNumberOfBytesToWrite ? TRUE : Fail(ERROR_BROKEN_PIPE);
+}
+
+BOOL GetFileSizeEx(const HANDLE hFile, const PLARGE_INTEGER lpFileSize)
+{
+    const File* f = AsFile(hFile);
+    struct stat st = {};
+    if (f == nullptr || fstat(f->fd, &st) != 0)
+        return Fail(ERROR_INVALID_HANDLE);
+    lpFileSize->QuadPart = st.st_size;
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(const HANDLE hFile, const LARGE_INTEGER liDistanceToMove, const PLARGE_INTEGER lpNewFilePointer, const DWORD dwMoveMethod)
+{
+    const File* f = AsFile(hFile);
+    if (f == nullptr)
+        return Fail(ERROR_INVALID_HANDLE);
+    const off_t offset = lseek(f->fd, liDistanceToMove.QuadPart, dwMoveMethod == FILE_BEGIN ? SEEK_SET : dwMoveMethod == FILE_CURRENT ? SEEK_CUR : SEEK_END);
+    if (offset < 0)
+        return Fail(ERROR_INVALID_HANDLE);
+    if (lpNewFilePointer != nullptr)
+        lpNewFilePointer->QuadPart = offset;
+    return TRUE;
+}
+
+DWORD GetFileType(const HANDLE hFile)
+{
+    if (IsConsole(hFile, Kind::ConsoleInput) || IsConsole(hFile, Kind::ConsoleOutput))
+        return FILE_TYPE_CHAR;
+    const File* f = AsFile(hFile);
+    struct stat st = {};
+    if (f == nullptr || fstat(f->fd, &st) != 0)
+        return FILE_TYPE_UNKNOWN;
+    return S_ISFIFO(st.st_mode) ? FILE_TYPE_PIPE : S_ISCHR(st.st_mode) ? FILE_TYPE_CHAR : FILE_TYPE_DISK;
+}
+
+BOOL GetFileAttributesExW(const LPCWSTR lpFileName, GET_FILEEX_INFO_LEVELS, const LPVOID lpFileInformation)
+{
+    struct stat st = {};
+    if (stat(PathName(lpFileName).c_str(), &st) != 0)
+        return Fail(ERROR_FILE_NOT_FOUND);
+    WIN32_FILE_ATTRIBUTE_DATA* data = static_cast<WIN32_FILE_ATTRIBUTE_DATA*>(lpFileInformation);
+    *data = {};
+    data->dwFileAttributes = S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+    data->ftLastWriteTime = ToFileTime(st.st_mtim);
+    data->nFileSizeLow = DWORD(st.st_size);
+    data->nFileSizeHigh = DWORD(uint64_t(st.st_size) >> 32);
+    return TRUE;
+}
+
+BOOL CreateDirectoryW(const LPCWSTR lpPathName, LPSECURITY_ATTRIBUTES)
+{
+    return mkdir(PathName(lpPathName).c_str(), 0777) == 0 ? TRUE : Fail(ERROR_FILE_NOT_FOUND);
+}
+
+BOOL DeleteFileW(const LPCWSTR lpFileName)
+{
+    return unlink(PathName(lpFileName).c_str()) == 0 ? TRUE : Fail(ERROR_FILE_NOT_FOUND);
+}
+
+BOOL MoveFileExW(const LPCWSTR lpExistingFileName, const LPCWSTR lpNewFileName, const DWORD dwFlags)
+{
+    const std::string to = PathName(lpNewFileName);
+    struct stat st = {};
+    if ((dwFlags & MOVEFILE_REPLACE_EXISTING) == 0 && stat(to.c_str(), &st) == 0)
+        return Fail(ERROR_FILE_NOT_FOUND);
+    return rename(PathName(lpExistingFileName).c_str(), to.c_str()) == 0 ? TRUE : Fail(ERROR_FILE_NOT_FOUND);
+}
+
+// Only directory\* patterns
+HANDLE FindFirstFileExW(const LPCWSTR lpFileName, FINDEX_INFO_LEVELS, const LPVOID lpFindFileData, FINDEX_SEARCH_OPS, LPVOID, DWORD)
+{
+    std::string path = PathName(lpFileName);
+    if (path.length() < 2 || path.compare(path.length() - 2, 2, "/*") != 0)
+    {
+        Fail(ERROR_CALL_NOT_IMPLEMENTED);
+        return INVALID_HANDLE_VALUE;
+    }
+    path.resize(path.length() - 2);
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        Fail(ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    }
+    Find* f = new Find(dir, path);
+    if (!FindNext(f, static_cast<LPWIN32_FIND_DATAW>(lpFindFileData)))
+    {
+        delete f;
+        Fail(ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    }
+    return f;
+}
+
+BOOL FindNextFileW(const HANDLE hFindFile, const LPWIN32_FIND_DATAW lpFindFileData)
+{
+    return FindNext(static_cast<Find*>(static_cast<Object*>(hFindFile)), lpFindFileData) ? TRUE : Fail(ERROR_FILE_NOT_FOUND);
+}
+
+BOOL FindClose(const HANDLE hFindFile)
+{
+    delete static_cast<Object*>(hFindFile);
+    return TRUE;
+}
+
+BOOL CreatePipe(const PHANDLE hReadPipe, const PHANDLE hWritePipe, LPSECURITY_ATTRIBUTES, DWORD)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return Fail(ERROR_NOT_ENOUGH_MEMORY);
+    *hReadPipe = new File(fds[0], true);
+    *hWritePipe = new File(fds[1], true);
+    return TRUE;
+}
+
+BOOL SetHandleInformation(HANDLE, DWORD, DWORD)
+{
+    return TRUE;
+}
+
+BOOL CloseHandle(const HANDLE hObject)
+{
+    Object* o = static_cast<Object*>(hObject);
+    if (o == nullptr || hObject == INVALID_HANDLE_VALUE)
+        return Fail(ERROR_INVALID_HANDLE);
+    if (o == &g_input || o == &g_output)
+        return TRUE;
+    if (o->kind == Kind::Thread)
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        Release(static_cast<Thread*>(o));
+        return TRUE;
+    }
+    delete o;
+    return TRUE;
+}
+
+HANDLE CreateFileMappingW(HANDLE, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCWSTR)
+{
+    Fail(ERROR_CALL_NOT_IMPLEMENTED);
+    return nullptr;
+}
+
+LPVOID MapViewOfFile(HANDLE, DWORD, DWORD, DWORD, SIZE_T)
+{
+    Fail(ERROR_CALL_NOT_IMPLEMENTED);
+    return nullptr;
+}
+
+BOOL UnmapViewOfFile(LPCVOID)
+{
+    return TRUE;
+}
+
+BOOL CreateProcessW(LPCWSTR, LPWSTR, LPSECURITY_ATTRIBUTES, LPSECURITY_ATTRIBUTES, BOOL, DWORD, LPVOID, LPCWSTR, LPSTARTUPINFOW, LPPROCESS_INFORMATION)
+{
+    return Fail(ERROR_CALL_NOT_IMPLEMENTED);
+}
+
+BOOL OpenClipboard(HWND)
+{
+    return Fail(ERROR_CALL_NOT_IMPLEMENTED);
+}
+
+BOOL CloseClipboard()
+{
+    return TRUE;
+}
+
+HANDLE GetClipboardData(UINT)
+{
+    return nullptr;
+}
+
+LPVOID GlobalLock(HANDLE)
+{
+    return nullptr;
+}
+
+BOOL GlobalUnlock(HANDLE)
+{
+    return TRUE;
+}
+
+// Threads and synchronization
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES, SIZE_T, const LPTHREAD_START_ROUTINE lpStartAddress, const LPVOID lpParameter, DWORD, const LPDWORD lpThreadId)
+{
+    Thread* t = new Thread;
+    std::thread([t, lpStartAddress, lpParameter]()
+        {
+            lpStartAddress(lpParameter);
+            std::lock_guard<std::mutex> lock(g_lock);
+            t->done = true;
+            Changed();
+            Release(t);
+        }).detach();
+    if (lpThreadId != nullptr)
+        *lpThreadId = 0;
+    return t;
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES, const BOOL bManualReset, const BOOL bInitialState, LPCWSTR)
+{
+    return new Event(bManualReset != FALSE, bInitialState != FALSE);
+}
+
+BOOL SetEvent(const HANDLE hEvent)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    static_cast<Event*>(static_cast<Object*>(hEvent))->signaled = true;
+    Changed();
+    return TRUE;
+}
+
+BOOL ResetEvent(const HANDLE hEvent)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    static_cast<Event*>(static_cast<Object*>(hEvent))->signaled = false;
+    return TRUE;
+}
+
+DWORD WaitForSingleObject(const HANDLE hHandle, const DWORD dwMilliseconds)
+{
+    return WaitForMultipleObjects(1, &hHandle, FALSE, dwMilliseconds);
+}
+
+// Only waits for any one of them
+DWORD WaitForMultipleObjects(const DWORD nCount, const HANDLE* const lpHandles, const BOOL bWaitAll, const DWORD dwMilliseconds)
+{
+    if (bWaitAll || nCount == 0)
+        return Fail(ERROR_CALL_NOT_IMPLEMENTED), WAIT_FAILED;
+
+    const auto timeout = std::chrono::milliseconds(dwMilliseconds == INFINITE ? Watchdog : dwMilliseconds);
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(g_lock);
+    while (true)
+    {
+        for (DWORD i = 0; i < nCount; ++i)
+        {
+            Object* o = static_cast<Object*>(lpHandles[i]);
+            if (o == nullptr || lpHandles[i] == INVALID_HANDLE_VALUE)
+                return Fail(ERROR_INVALID_HANDLE), WAIT_FAILED;
+            if (IsReady(o))
+            {
+                Acquired(o);
+                return WAIT_OBJECT_0 + i;
+            }
+        }
+
+        if (g_changed.wait_until(lock, deadline) == std::cv_status::timeout && std::chrono::steady_clock::now() >= deadline)
+        {
+            if (dwMilliseconds != INFINITE)
+                return WAIT_TIMEOUT;
+            fprintf(stderr, "FakeConsole: waited %lu ms for an object\n", Watchdog);
+            abort();
+        }
+    }
+}
+
+namespace
+{
+    intptr_t* LockWord(const PSRWLOCK SRWLock)
+    {
+        return reinterpret_cast<intptr_t*>(&SRWLock->Ptr);
+    }
+}
+
+void InitializeSRWLock(const PSRWLOCK SRWLock)
+{
+    SRWLock->Ptr = nullptr;
+}
+
+void AcquireSRWLockExclusive(const PSRWLOCK SRWLock)
+{
+    intptr_t* word = LockWord(SRWLock);
+    for (int spins = 0;; ++spins)
+    {
+        intptr_t expected = 0;
+        if (__atomic_compare_exchange_n(word, &expected, -1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        if (spins > 16)
+            std::this_thread::yield();
+    }
+}
+
+void ReleaseSRWLockExclusive(const PSRWLOCK SRWLock)
+{
+    __atomic_store_n(LockWord(SRWLock), 0, __ATOMIC_RELEASE);
+}
+
+void AcquireSRWLockShared(const PSRWLOCK SRWLock)
+{
+    intptr_t* word = LockWord(SRWLock);
+    for (int spins = 0;; ++spins)
+    {
+        intptr_t v = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if (v >= 0 && __atomic_compare_exchange_n(word, &v, v + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        if (spins > 16)
+            std::this_thread::yield();
+    }
+}
+
+void ReleaseSRWLockShared(const PSRWLOCK SRWLock)
+{
+    __atomic_fetch_sub(LockWord(SRWLock), 1, __ATOMIC_RELEASE);
+}
+
+LONG InterlockedExchange(LONG volatile* const Target, const LONG Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+LONG InterlockedCompareExchange(LONG volatile* const Destination, const LONG Exchange, LONG Comperand)
+{
+    __atomic_compare_exchange_n(Destination, &Comperand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comperand;
+}
+
+DWORD GetCurrentProcessId()
+{
+    return DWORD(getpid());
+}
+
+// Environment, time, strings and errors
+
+DWORD GetEnvironmentVariableW(const LPCWSTR lpName, const LPWSTR lpBuffer, const DWORD nSize)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    ++g_console.counters.environment_calls;
+    const auto it = g_console.environment.find(lpName);
+    if (it == g_console.environment.end())
+        return Fail(ERROR_ENVVAR_NOT_FOUND);
+    const std::wstring& value = it->second;
+    if (lpBuffer == nullptr || nSize <= value.length())
+        return DWORD(value.length() + 1);
+    std::char_traits<WCHAR>::copy(lpBuffer, value.data(), value.length());
+    lpBuffer[value.length()] = L'\0';
+    return DWORD(value.length());
+}
+
+DWORD GetModuleFileNameW(HMODULE, const LPWSTR lpFilename, const DWORD nSize)
+{
+    const WCHAR name[] = L"C:\\Test\\Test.exe";
+    const DWORD length = std::min(DWORD(ARRAYSIZE(name) - 1), nSize - 1);
+    std::char_traits<WCHAR>::copy(lpFilename, name, length);
+    lpFilename[length] = L'\0';
+    return length;
+}
+
+ULONGLONG GetTickCount64()
+{
+    // Not 0 at the start, as on Windows
+    return ULONGLONG(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - g_start).count()) + 1000000;
+}
+
+void GetSystemTimeAsFileTime(const LPFILETIME lpSystemTimeAsFileTime)
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    *lpSystemTimeAsFileTime = ToFileTime(ts);
+}
+
+// Code pages other than UTF-8 are taken as Latin-1
+int MultiByteToWideChar(const UINT CodePage, DWORD, const LPCCH lpMultiByteStr, int cbMultiByte, const LPWSTR lpWideCharStr, const int cchWideChar)
+{
+    if (cbMultiByte < 0)
+        cbMultiByte = int(strlen(lpMultiByteStr) + 1);
+    std::wstring wide;
+    if (CodePage == CP_UTF8)
+        wide = Widen(lpMultiByteStr, size_t(cbMultiByte));
+    else
+        for (int i = 0; i < cbMultiByte; ++i)
+            wide += WCHAR(BYTE(lpMultiByteStr[i]));
+    if (cchWideChar == 0)
+        return int(wide.length());
+    if (size_t(cchWideChar) < wide.length())
+        return int(Fail(ERROR_INSUFFICIENT_BUFFER));
+    std::char_traits<WCHAR>::copy(lpWideCharStr, wide.data(), wide.length());
+    return int(wide.length());
+}
+
+int WideCharToMultiByte(const UINT CodePage, DWORD, const LPCWCH lpWideCharStr, int cchWideChar, const LPSTR lpMultiByteStr, const int cbMultiByte, LPCCH, BOOL* const lpUsedDefaultChar)
+{
+    if (cchWideChar < 0)
+        cchWideChar = int(_tcslen(lpWideCharStr) + 1);
+    std::string bytes;
+    if (CodePage == CP_UTF8)
+    {
+        bytes.resize(Utf::Utf8Size(size_t(cchWideChar)) + 3);
+        Utf::Utf16ToUtf8<WCHAR> utf8;
+        size_t n = utf8.Convert(lpWideCharStr, size_t(cchWideChar), reinterpret_cast<uint8_t*>(&bytes[0]));
+        n += utf8.Finish(reinterpret_cast<uint8_t*>(&bytes[n]));
+        bytes.resize(n);
+    }
+    else
+    {
+        for (int i = 0; i < cchWideChar; ++i)
+        {
+            const bool mapped = lpWideCharStr[i] < 0x100;
+            bytes += mapped ? char(lpWideCharStr[i]) : '?';
+            if (!mapped && lpUsedDefaultChar != nullptr)
+                *lpUsedDefaultChar = TRUE;
+        }
+    }
+    if (cbMultiByte == 0)
+        return int(bytes.length());
+    if (size_t(cbMultiByte) < bytes.length())
+        return int(Fail(ERROR_INSUFFICIENT_BUFFER));
+    memcpy(lpMultiByteStr, bytes.data(), bytes.length());
+    return int(bytes.length());
+}
+
+// Only single byte and UTF-8 code pages are emulated
+BOOL IsDBCSLeadByteEx(UINT, BYTE)
+{
+    return FALSE;
+}
+
+int lstrcmpiW(const LPCWSTR lpString1, const LPCWSTR lpString2)
+{
+    return CompareFold(lpString1, lpString2);
+}
+
+DWORD GetLastError()
+{
+    return t_error;
+}
+
+void SetLastError(const DWORD dwErrCode)
+{
+    t_error = dwErrCode;
+}
+
+void OutputDebugStringW(const LPCWSTR lpOutputString)
+{
+    fputs(Narrow(lpOutputString).c_str(), stderr);
+}
+
+LPWSTR PathFindFileNameW(const LPCWSTR pszPath)
+{
+    LPCWSTR name = pszPath;
+    for (LPCWSTR p = pszPath; *p != L'\0'; ++p)
+        if (*p == L'\\' || *p == L'/')
+            name = p + 1;
+    return const_cast<LPWSTR>(name);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <string>
+
+// The console the library reads from and writes to in the tests, a screen buffer of one cell for each
+// UTF-16 code unit, an input queue, the modes and the environment variables.
+// Input can be added and the screen looked at from another thread while a read runs.
+namespace FakeConsole
+{
+    // Clears the screen, input and environment and sets the modes a new console starts with
+    void Reset(SHORT width, SHORT height);
+
+    // As the user resizing the window, the screen is cut or padded without reflowing
+    // A WINDOW_BUFFER_SIZE_EVENT is queued if the input mode has ENABLE_WINDOW_INPUT
+    void Resize(SHORT width, SHORT height);
+
+    // A key down and up
+    void Key(WORD wVirtualKeyCode, WCHAR c, DWORD dwControlKeyState = 0);
+
+    // A key for each character, \r is Enter
+    void Type(const std::wstring& text);
+
+    // Input records not read yet
+    size_t Pending();
+
+    // Trailing spaces are left out
+    std::wstring Row(SHORT y);
+    COORD Cursor();
+
+    DWORD InputMode();
+    DWORD OutputMode();
+    void SetCodePage(UINT CodePage);
+
+    // nullptr removes the variable
+    void SetEnvironment(LPCWSTR lpName, LPCWSTR lpValue);
+
+    struct Counters
+    {
+        long mode_calls;            // GetConsoleMode and SetConsoleMode
+        long environment_calls;     // GetEnvironmentVariable
+        long screen_writes;         // Calls that wrote to the screen
+    };
+
+    Counters GetCounters();
+
+    // Waits for a write to the screen after the one counted in screen_writes, returns false on timeout
+    bool WaitForWrite(long screen_writes, DWORD dwMilliseconds);
+}
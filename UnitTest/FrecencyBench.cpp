@@ -0,0 +1,80 @@
+#include "Frecency.h"
+#include "UnitTest.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// Cost of an update at 1M runs, against sorting every command by score again after each run.
+// Commands are picked with a skewed distribution so a few are run all day among many one-off ones.
+
+typedef char16_t Char;
+typedef FrecencyRank<Char> Rank;
+
+std::u16string Command(const uint32_t i)
+{
+    const std::string s = "command " + std::to_string(i);
+    return std::u16string(s.begin(), s.end());
+}
+
+int main(int argc, char* argv[])
+{
+    const long runs = BenchSize(argc, argv, 1000000);
+    const uint32_t commands = uint32_t(std::max(1L, runs / 10));
+    const double halflife = 3 * 24 * 60 * 60;
+
+    std::mt19937 rng(1);
+    std::vector<std::u16string> text(commands);
+    for (uint32_t i = 0; i < commands; ++i)
+        text[i] = Command(i);
+
+    // Zipf-like, the k-th most common command is run about 1/k as often as the most common
+    std::vector<uint32_t> picks(runs);
+    std::vector<int64_t> times(runs);
+    for (long r = 0; r < runs; ++r)
+    {
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        picks[r] = std::min(commands - 1, uint32_t(std::pow(double(commands), u)) - 1);
+        times[r] = r * 30;  // A command every 30 seconds
+    }
+
+    Rank rank(std::pmr::get_default_resource(), halflife);
+    const double start = Now();
+    for (long r = 0; r < runs; ++r)
+        rank.Update(text[picks[r]].data(), text[picks[r]].length(), times[r]);
+    const double update = (Now() - start) * 1000.0 / runs;
+
+    // What each update would cost without the incremental ranking, scoring and sorting every command
+    std::vector<std::pair<double, uint32_t>> scores;
+    const double sort_start = Now();
+    for (auto it = rank.begin(); it != rank.end(); ++it)
+        scores.emplace_back(rank.GetStats(it).score, it->second);
+    std::sort(scores.begin(), scores.end(), std::greater<std::pair<double, uint32_t>>());
+    const double sort = (Now() - sort_start) * 1000.0;
+
+    printf("%ld runs of %zu distinct commands\n", runs, rank.size());
+    printf("incremental update %10.3f us\n", update);
+    printf("full re-sort       %10.0f us\n", sort);
+
+    // The ranking matches scores worked out from every run
+    std::vector<double> sums(commands, 0.0);
+    const double top = double(times[runs - 1]) / halflife;
+    for (long r = 0; r < runs; ++r)
+        sums[picks[r]] += std::exp2(double(times[r]) / halflife - top);
+    std::vector<std::pair<double, uint32_t>> expected;
+    for (uint32_t i = 0; i < commands; ++i)
+        if (sums[i] > 0)
+            expected.emplace_back(std::log2(sums[i]) + top, i);
+    std::sort(expected.begin(), expected.end(), std::greater<std::pair<double, uint32_t>>());
+
+    CHECK(expected.size() == rank.size());
+    auto it = rank.begin();
+    for (size_t i = 0; i < std::min<size_t>(expected.size(), 100); ++i, ++it)
+    {
+        CHECK(std::abs(rank.GetStats(it).score - expected[i].first) < 1e-6);
+        CHECK(rank.Text(it) == std::u16string_view(text[expected[i].second]));
+    }
+
+    return g_failures;
+}
@@ -0,0 +1,86 @@
+#include "Unicode.h"
+#include "UnitTest.h"
+
+#include <string>
+
+// Cost of stepping over a line by grapheme cluster forwards and backwards, the extra cost of measuring each
+// cluster, and stepping over the same text by code point for comparison, for text held as UTF-16.
+
+typedef std::u16string Text;
+
+Text Repeat(const Text& s, const size_t length)
+{
+    Text text;
+    while (text.length() < length)
+        text += s;
+    return text;
+}
+
+template <class F>
+double Time(const int repeat, const size_t count, F f)
+{
+    const double start = Now();
+    for (int r = 0; r < repeat; ++r)
+        f();
+    return (Now() - start) * 1e6 / (double(repeat) * count);
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t length = size_t(BenchSize(argc, argv, 1024 * 1024));
+    const int repeat = 4;
+
+    struct Sample
+    {
+        const char* name;
+        Text text;
+    } samples[] = {
+        { "ASCII", u"git commit -m \"fix the build\" && dir /s *.cpp " },
+        { "CJK", u"中文字符和空格 " },
+        { "combining", u"éäô " },
+        { "emoji", u"\U0001F468‍\U0001F469‍\U0001F467 \U0001F44D\U0001F3FD \U0001F1FA\U0001F1F8 " },
+    };
+
+    printf("%zu UTF-16 code units, ns per cluster\n", length);
+    printf("%-12s %10s %10s %10s %12s\n", "", "next", "prev", "+ width", "code points");
+    for (const Sample& sample : samples)
+    {
+        const Text text = Repeat(sample.text, length);
+        const char16_t* s = text.data();
+        const size_t n = text.length();
+
+        size_t clusters = 0;
+        for (size_t i = 0; i < n; i = Unicode::NextGrapheme(s, n, i))
+            ++clusters;
+
+        size_t check = 0;
+        const double next = Time(repeat, clusters, [&]() {
+            for (size_t i = 0; i < n; i = Unicode::NextGrapheme(s, n, i))
+                ++check;
+        });
+        const double prev = Time(repeat, clusters, [&]() {
+            for (size_t i = n; i > 0; i = Unicode::PrevGrapheme(s, n, i))
+                ++check;
+        });
+        int width = 0;
+        const double widths = Time(repeat, clusters, [&]() {
+            for (size_t i = 0; i < n;)
+            {
+                const size_t end = Unicode::NextGrapheme(s, n, i);
+                width += Unicode::GetGraphemeWidth(s + i, end - i);
+                i = end;
+            }
+        });
+        size_t code_points = 0;
+        const double decode = Time(repeat, clusters, [&]() {
+            for (size_t i = 0; i < n;)
+                code_points += Unicode::GetWidth(Unicode::Decode(s, n, i, &i));
+        });
+
+        CHECK(check == clusters * 2 * repeat);
+        CHECK(width > 0 && code_points > 0);
+        printf("%-12s %10.1f %10.1f %10.1f %12.1f\n", sample.name, next, prev, widths - next, decode);
+    }
+
+    return g_failures;
+}
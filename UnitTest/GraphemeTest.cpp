@@ -0,0 +1,181 @@
+#include "Unicode.h"
+#include "UnitTest.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Runs GraphemeBreakTest.txt, for the Unicode version the tables were generated from, through NextGrapheme
+// stepping forwards and PrevGrapheme stepping backwards, with the text held as UTF-16 and as UTF-32.
+// A few cases in the same notation are always run, the file is passed as the first argument.
+
+const int Skipped = 77;
+
+// ÷ and × in UTF-8
+const char Break[] = "\xC3\xB7";
+const char NoBreak[] = "\xC3\x97";
+
+struct Case
+{
+    std::vector<char32_t> code_points;
+    std::vector<bool> breaks;       // Before each code point and at the end
+};
+
+bool Parse(const std::string& line, Case& c)
+{
+    c.code_points.clear();
+    c.breaks.clear();
+    const std::string text = line.substr(0, line.find('#'));
+    size_t i = 0;
+    while (i < text.length())
+    {
+        if (isspace(uint8_t(text[i])))
+            ++i;
+        else if (text.compare(i, 2, Break) == 0 || text.compare(i, 2, NoBreak) == 0)
+        {
+            c.breaks.push_back(text.compare(i, 2, Break) == 0);
+            i += 2;
+        }
+        else
+        {
+            size_t end = 0;
+            c.code_points.push_back(char32_t(std::stoul(text.substr(i), &end, 16)));
+            i += end;
+        }
+    }
+    return !c.code_points.empty() && c.breaks.size() == c.code_points.size() + 1;
+}
+
+template <class C>
+std::basic_string<C> Encode(const Case& c, std::vector<size_t>& offsets)
+{
+    std::basic_string<C> s;
+    offsets.clear();
+    for (const char32_t cp : c.code_points)
+    {
+        offsets.push_back(s.length());
+        if (sizeof(C) == 2 && cp >= 0x10000)
+        {
+            s += C(0xD800 + ((cp - 0x10000) >> 10));
+            s += C(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        }
+        else
+            s += C(cp);
+    }
+    offsets.push_back(s.length());
+    return s;
+}
+
+template <class C>
+bool Check(const Case& c)
+{
+    std::vector<size_t> offsets;
+    const std::basic_string<C> s = Encode<C>(c, offsets);
+
+    std::vector<size_t> expected;
+    for (size_t i = 1; i < offsets.size(); ++i)
+        if (c.breaks[i])
+            expected.push_back(offsets[i]);
+
+    std::vector<size_t> forwards;
+    for (size_t i = 0; i < s.length();)
+    {
+        const size_t next = Unicode::NextGrapheme(s.data(), s.length(), i);
+        if (next <= i)
+            return false;
+        forwards.push_back(i = next);
+    }
+
+    std::vector<size_t> backwards;
+    for (size_t i = s.length(); i > 0;)
+    {
+        backwards.insert(backwards.begin(), i);
+        const size_t prev = Unicode::PrevGrapheme(s.data(), s.length(), i);
+        if (prev >= i)
+            return false;
+        i = prev;
+    }
+
+    return forwards == expected && backwards == expected;
+}
+
+bool Run(const std::string& line, const char* where)
+{
+    Case c;
+    if (!Parse(line, c))
+    {
+        fprintf(stderr, "%s: can't parse %s\n", where, line.c_str());
+        return false;
+    }
+    const bool utf16 = Check<char16_t>(c);
+    const bool utf32 = Check<char32_t>(c);
+    if (!utf16 || !utf32)
+        fprintf(stderr, "%s: %s%s%s\n", where, line.c_str(), utf16 ? "" : " UTF-16", utf32 ? "" : " UTF-32");
+    return utf16 && utf32;
+}
+
+const char* const Cases[] = {
+    "÷ 0061 × 0308 ÷ 0062 ÷",                                   // Combining mark
+    "÷ 000D × 000A ÷ 0061 ÷ 000A ÷ 000D ÷",                     // CRLF is one cluster, LF CR isn't
+    "÷ 1F468 × 200D × 1F469 × 200D × 1F467 ÷ 0061 ÷",           // ZWJ family
+    "÷ 0061 × 200D ÷ 1F469 ÷",                                  // ZWJ only joins pictographs
+    "÷ 1F1FA × 1F1F8 ÷ 1F1EB × 1F1F7 ÷ 1F1E6 ÷",                // Flags pair regional indicators
+    "÷ 1100 × 1161 × 11A8 ÷ AC00 × 11A8 ÷ AC01 × 11A8 ÷ 1100 ÷",// Hangul jamo and syllables
+    "÷ 0600 × 0661 ÷ 0062 ÷",                                   // Prepend
+    "÷ 0915 × 093F ÷ 0915 ÷",                                   // Spacing mark
+    "÷ 1F44D × 1F3FD ÷ 0061 ÷",                                 // Emoji modifier
+    "÷ 2764 × FE0F ÷ 0020 ÷",                                   // Emoji presentation
+    "÷ 0001 ÷ 0308 ÷",                                          // Nothing extends a control
+};
+
+struct Width
+{
+    std::u16string text;
+    int width;
+};
+
+int main(int argc, char* argv[])
+{
+    for (const char* line : Cases)
+        CHECK(Run(line, "case"));
+
+    const Width widths[] = {
+        { u"a", 1 }, { u"ä", 1 }, { u"中", 2 }, { u"Ａ", 2 }, { u"̈", 0 },
+        { u"\U0001F44D\U0001F3FD", 2 }, { u"\U0001F1FA\U0001F1F8", 2 }, { u"❤️", 2 }, { u"❤", 1 },
+        { u"\U0001F468‍\U0001F469‍\U0001F467", 2 }, { u"각", 2 },
+    };
+    for (const Width& w : widths)
+        CHECK(Unicode::GetGraphemeWidth(w.text.data(), w.text.length()) == w.width);
+
+    if (argc < 2)
+        return g_failures;
+
+    std::ifstream file(argv[1]);
+    std::string line;
+    if (!file || !std::getline(file, line))
+    {
+        printf("Can't read %s\n", argv[1]);
+        return g_failures != 0 ? g_failures : Skipped;
+    }
+
+    // The first line names the file and its version
+    CHECK(line.find(std::string("GraphemeBreakTest-") + Unicode::Version + ".txt") != std::string::npos);
+
+    int count = 0;
+    int failed = 0;
+    for (int number = 2; std::getline(file, line); ++number)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        const std::string where = std::string(argv[1]) + "(" + std::to_string(number) + ")";
+        ++count;
+        if (!Run(line, where.c_str()))
+            ++failed;
+    }
+    printf("%d of %d cases passed\n", count - failed, count);
+    CHECK(count > 0);
+    CHECK(failed == 0);
+
+    return g_failures;
+}
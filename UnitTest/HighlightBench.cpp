@@ -0,0 +1,99 @@
+#include "Highlight.h"
+#include "UnitTest.h"
+
+#include <iterator>
+#include <string>
+
+// Cost of a keystroke on a long line, incremental against lexing the whole line again
+
+typedef Highlighter<wchar_t> Lexer;
+
+std::wstring MakeLine(const size_t length)
+{
+    const wchar_t* words[] = { L"git", L"log", L"--oneline", L"\"some quoted text\"", L"%PATH%", L">", L"out.txt", L"|", L"findstr", L"^&" };
+    std::wstring line;
+    for (size_t i = 0; line.length() < length; ++i)
+    {
+        line += words[(i * 7) % std::size(words)];
+        line += L' ';
+    }
+    line.resize(length);
+    return line;
+}
+
+bool SameTokens(const Lexer& incremental, const std::wstring& line)
+{
+    Lexer full;
+    full.Update(line.data(), line.length());
+    return std::equal(full.Tokens(), full.Tokens() + line.length(), incremental.Tokens());
+}
+
+// Each edit is a character typed at pos, then deleted again so the line stays the same length
+template <class F>
+double Time(const std::wstring& line, const long keys, F& lex)
+{
+    std::wstring text = line;
+    const double start = Now();
+    for (long k = 0; k < keys; ++k)
+    {
+        const size_t pos = lex.Position(text.length(), k);
+        text.insert(text.begin() + pos, lex.Char(k));
+        lex(text);
+        text.erase(text.begin() + pos);
+        lex(text);
+    }
+    return (Now() - start) * 1000.0 / (keys * 2.0);
+}
+
+struct Edit
+{
+    const wchar_t* name;
+    size_t (*position)(size_t length, long k);
+    wchar_t (*character)(long k);
+};
+
+int main(int argc, char* argv[])
+{
+    const size_t length = size_t(BenchSize(argc, argv, 8 * 1024));
+    const long keys = 2000;
+    const std::wstring line = MakeLine(length);
+
+    const Edit edits[] = {
+        { L"end", [](size_t length, long) { return length; }, [](long) { return L'x'; } },
+        { L"middle", [](size_t length, long) { return length / 2; }, [](long) { return L'x'; } },
+        { L"start", [](size_t, long) { return size_t(0); }, [](long) { return L'x'; } },
+        { L"quote in middle", [](size_t length, long) { return length / 2; }, [](long) { return L'"'; } },
+        { L"quote at start", [](size_t, long) { return size_t(0); }, [](long) { return L'"'; } },
+    };
+
+    printf("%zu character line, microseconds per keystroke\n", length);
+    printf("%-16s %12s %12s\n", "edit", "incremental", "full");
+    for (const Edit& edit : edits)
+    {
+        struct Incremental
+        {
+            explicit Incremental(const Edit& edit) : edit(edit) {}
+            const Edit& edit;
+            Lexer lexer;
+            size_t Position(size_t length, long k) const { return edit.position(length, k); }
+            wchar_t Char(long k) const { return edit.character(k); }
+            void operator()(const std::wstring& text) { lexer.Update(text.data(), text.length()); }
+        } incremental(edit);
+        incremental(line);
+
+        struct Full
+        {
+            const Edit& edit;
+            size_t Position(size_t length, long k) const { return edit.position(length, k); }
+            wchar_t Char(long k) const { return edit.character(k); }
+            void operator()(const std::wstring& text) { Lexer lexer; lexer.Update(text.data(), text.length()); }
+        } full{ edit };
+
+        const double i = Time(line, keys, incremental);
+        const double f = Time(line, keys, full);
+        CHECK(SameTokens(incremental.lexer, line));
+        printf("%-16ls %12.3f %12.3f\n", edit.name, i, f);
+    }
+
+    return g_failures;
+}
@@ -0,0 +1,148 @@
+#include "History.h"
+#include "UnitTest.h"
+
+#include <deque>
+#include <iterator>
+#include <string>
+
+// Memory and time to load history, packed in the arena as UTF-16 or UTF-8 against a string per entry
+
+typedef char16_t Char;
+typedef std::basic_string<Char> String;
+
+// Counts what is allocated through it
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t bytes = 0;
+    size_t blocks = 0;
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override
+    {
+        bytes += size;
+        ++blocks;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* p, size_t size, size_t alignment) override
+    {
+        bytes -= size;
+        --blocks;
+        std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+String MakeEntry(const long i)
+{
+    static const char* commands[] = { "git status", "git commit -m \"fix the build\"", "cd ..", "dir /s /b *.cpp",
+        "msbuild RadReadConsole.sln /p:Configuration=Release", "findstr /s /i \"TODO\" *.h", "copy a.txt b.txt", "echo %PATH%" };
+    const std::string s = std::string(commands[i % std::size(commands)]) + " " + std::to_string(i);
+    String entry(s.begin(), s.end());
+    if (i % 50 == 0)
+        entry += u" é中\U0001F600";     // Some entries aren't ASCII
+    return entry;
+}
+
+struct Result
+{
+    double load;
+    double iterate;
+    size_t bytes;
+    size_t blocks;
+};
+
+template <class F, class G>
+Result Run(CountingResource& memory, F load, G iterate)
+{
+    Result r = {};
+    double start = Now();
+    load();
+    r.load = Now() - start;
+    r.bytes = memory.bytes;
+    r.blocks = memory.blocks;
+    start = Now();
+    iterate();
+    r.iterate = Now() - start;
+    return r;
+}
+
+void Print(const char* name, const long n, const Result& r)
+{
+    printf("%-16s %10.1f %10.1f %12.1f %10zu %10.1f\n", name, r.load, r.iterate, r.bytes / 1048576.0, r.blocks, double(r.bytes) / n);
+}
+
+int main(int argc, char* argv[])
+{
+    const long n = BenchSize(argc, argv, 1000000);
+
+    std::vector<String> entries;
+    entries.reserve(n);
+    size_t chars = 0;
+    for (long i = 0; i < n; ++i)
+    {
+        entries.push_back(MakeEntry(i));
+        chars += entries.back().length();
+    }
+
+    printf("%ld entries, %.1f characters each\n", n, double(chars) / n);
+    printf("%-16s %10s %10s %12s %10s %10s\n", "", "load ms", "up ms", "MB", "blocks", "bytes each");
+
+    for (const bool utf8 : { false, true })
+    {
+        CountingResource memory;
+        {
+            HistoryStore<Char> history(&memory);
+            history.SetUtf8(utf8);
+            size_t total = 0;
+            const Result r = Run(memory,
+                [&]() { for (const String& e : entries) history.push_front(e.data(), e.length()); },
+                [&]() {
+                    std::pmr::basic_string<Char> text(&memory);
+                    for (size_t i = 0; i < history.size(); ++i)
+                    {
+                        history.Get(i, text);
+                        total += text.length();
+                    }
+                });
+            Print(utf8 ? "arena UTF-8" : "arena UTF-16", n, r);
+            CHECK(total == chars);
+
+            std::pmr::basic_string<Char> text(&memory);
+            for (long i = 0; i < n; i += n / 97 + 1)
+            {
+                history.Get(n - 1 - i, text);
+                CHECK(String(text.begin(), text.end()) == entries[i]);
+            }
+        }
+        CHECK(memory.bytes == 0);
+    }
+
+    {
+        // What history was before, a deque of strings
+        CountingResource memory;
+        {
+            std::pmr::deque<std::pmr::basic_string<Char>> history(&memory);
+            size_t total = 0;
+            const Result r = Run(memory,
+                [&]() { for (const String& e : entries) history.emplace_front(e.data(), e.length()); },
+                [&]() {
+                    std::pmr::basic_string<Char> text(&memory);
+                    for (const auto& e : history)
+                    {
+                        text = e;
+                        total += text.length();
+                    }
+                });
+            Print("deque<string>", n, r);
+            CHECK(total == chars);
+        }
+    }
+
+    return g_failures;
+}
@@ -0,0 +1,99 @@
+#include "FakeConsole.h"
+#include "RadReadConsole.h"
+#include "UnitTest.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// Time to the first prompt with a large history file loading, from RadLoadHistory to a key typed at the prompt being
+// drawn, then to Up showing the newest entry of the file and to the whole file being loaded.
+
+const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+
+// Written as WriteHistory would, one in a hundred entries spread over two lines
+std::wstring History(const long entries)
+{
+    std::wstring text = L"#RadReadConsole history 2\n";
+    char line[128];
+    for (long i = 0; i < entries; ++i)
+    {
+        const int length = i % 100 == 0
+            ? snprintf(line, sizeof(line), "echo %ld\\necho \\\\\\\\server\\\\share\n", i)
+            : snprintf(line, sizeof(line), "git commit -m \"change %ld\" && dir /s *.cpp\n", i);
+        text.append(line, line + length);
+    }
+    return text;
+}
+
+// Sends a key and waits for it to be drawn
+void Send(const WORD wVirtualKeyCode, const WCHAR c)
+{
+    const long writes = FakeConsole::GetCounters().screen_writes;
+    FakeConsole::Key(wVirtualKeyCode, c);
+    CHECK(FakeConsole::WaitForWrite(writes, 10 * 1000));
+}
+
+int main(int argc, char* argv[])
+{
+    const long entries = BenchSize(argc, argv, 1000000);
+    const std::wstring text = History(entries);
+    char name[] = "/tmp/HistoryLoadBenchXXXXXX";
+    const int fd = mkstemp(name);
+    CHECK(fd >= 0 && write(fd, text.data(), text.size() * sizeof(WCHAR)) == ssize_t(text.size() * sizeof(WCHAR)));
+    close(fd);
+    std::wstring path;
+    for (const char* p = name; *p != '\0'; ++p)
+        path += WCHAR(*p);
+
+    FakeConsole::Reset(120, 50);
+    const double start = Now();
+    CHECK(RadLoadHistory(path.c_str()));
+    std::thread reader([]()
+        {
+            WCHAR buffer[256];
+            DWORD read = 0;
+            CHECK(RadReadConsole(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+        });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+    Send(WORD('X'), L'x');
+    const double prompt = Now() - start;
+
+    // Up does nothing until the first entries are added, the screen is drawn in order so once the x typed after Up is
+    // there so is the entry
+    const SHORT y = FakeConsole::Cursor().Y;
+    const size_t last = text.rfind(L'\n', text.length() - 2) + 1;
+    const std::wstring newest = text.substr(last, text.length() - 1 - last);
+    std::wstring row;
+    do
+    {
+        FakeConsole::Key(VK_ESCAPE, 0);
+        while (!FakeConsole::Row(y).empty())
+            std::this_thread::yield();
+        FakeConsole::Key(VK_UP, 0);
+        FakeConsole::Key(WORD('X'), L'x');
+        while ((row = FakeConsole::Row(y)).empty() || row.back() != L'x')
+            std::this_thread::yield();
+    } while (row == L"x");
+    CHECK(row == newest + L"x");
+    const double up = Now() - start;
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+
+    // Waits for the rest of the file
+    const HANDLE hNull = CreateFile(L"/dev/null", GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK(WriteHistory(hNull));
+    CloseHandle(hNull);
+    const double all = Now() - start;
+    unlink(name);
+
+    printf("%ld entries, %.1f MB\n", entries, text.size() * sizeof(WCHAR) / 1e6);
+    printf("%-24s %10.2f ms\n", "first prompt", prompt);
+    printf("%-24s %10.2f ms\n", "newest entry on Up", up);
+    printf("%-24s %10.2f ms\n", "loaded and written", all);
+
+    return g_failures;
+}
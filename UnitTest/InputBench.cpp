@@ -0,0 +1,125 @@
+#include "FakeConsole.h"
+#include "RadReadConsole.h"
+#include "UnitTest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keys per second the editor takes from a burst typed ahead, and the time from a key arriving to the screen
+// changing while a read waits, reading the console directly and on the input thread of RAD_INPUT_THREAD.
+
+const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+bool g_threaded = false;
+
+void NewConsole(const SHORT width, const SHORT height)
+{
+    FakeConsole::Reset(width, height);
+    FakeConsole::SetEnvironment(L"RAD_INPUT_THREAD", g_threaded ? L"1" : nullptr);
+}
+
+std::wstring ReadLine()
+{
+    static WCHAR buffer[64 * 1024];
+    DWORD read = 0;
+    CHECK(RadReadConsole(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+    return std::wstring(buffer, read);
+}
+
+std::wstring Letters(const size_t length)
+{
+    std::wstring s;
+    for (size_t i = 0; i < length; ++i)
+        s += WCHAR(L'a' + i % 26);
+    return s;
+}
+
+// Lines typed ahead come back in order, a read leaves the keys after its Enter on the console, up to the Enter's own
+// key up, for whatever reads it next
+void TestTypeAhead()
+{
+    NewConsole(80, 25);
+    const std::wstring ahead = L"second\rthird\r";
+    FakeConsole::Type(L"first\r" + ahead);
+    CHECK(ReadLine() == L"first\r\n");
+    CHECK(FakeConsole::Pending() == 2 * ahead.length() + 1);
+    FakeConsole::Type(L"fourth\r");
+    CHECK(ReadLine() == L"second\r\n");
+    CHECK(ReadLine() == L"third\r\n");
+    CHECK(ReadLine() == L"fourth\r\n");
+}
+
+// A burst of resizes is reflowed without waiting for the burst to end
+void TestResize()
+{
+    NewConsole(80, 25);
+    std::thread reader([]() { CHECK(ReadLine() == L"resized\r\n"); });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+    for (SHORT width = 60; width > 40; width -= 5)
+        FakeConsole::Resize(width, 25);
+    FakeConsole::Type(L"resized\r");
+    reader.join();
+}
+
+double Throughput(const size_t length)
+{
+    NewConsole(120, 50);
+    const std::wstring line = Letters(length);
+    FakeConsole::Type(line + L"\r");
+    const double start = Now();
+    const std::wstring read = ReadLine();
+    const double time = Now() - start;
+    CHECK(read == line + L"\r\n");
+    return double(length) / time;
+}
+
+struct Latency
+{
+    double mean;
+    double max;
+};
+
+// Each key is only sent once the previous one reached the screen
+Latency KeyLatency(const int keys)
+{
+    NewConsole(120, 50);
+    std::thread reader([keys]() { CHECK(ReadLine() == Letters(size_t(keys)) + L"\r\n"); });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+
+    Latency latency = { 0, 0 };
+    for (int i = 0; i < keys; ++i)
+    {
+        const long writes = FakeConsole::GetCounters().screen_writes;
+        const double start = Now();
+        FakeConsole::Key(WORD('A' + i % 26), WCHAR(L'a' + i % 26));
+        CHECK(FakeConsole::WaitForWrite(writes, 10 * 1000));
+        const double time = Now() - start;
+        latency.mean += time / keys;
+        latency.max = std::max(latency.max, time);
+    }
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+    return latency;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t length = size_t(BenchSize(argc, argv, 16 * 1024));
+    const int keys = int(std::min(length, size_t(1000)));
+
+    printf("%zu keys typed ahead, %d keys one at a time\n", length, keys);
+    printf("%-10s %14s %16s %16s\n", "", "keys/s", "mean latency us", "max latency us");
+    for (const bool threaded : { false, true })
+    {
+        g_threaded = threaded;
+        TestTypeAhead();
+        TestResize();
+        const double rate = Throughput(length) * 1000;
+        const Latency latency = KeyLatency(keys);
+        printf("%-10s %14.0f %16.1f %16.1f\n", threaded ? "thread" : "direct", rate, latency.mean * 1000, latency.max * 1000);
+    }
+
+    return g_failures;
+}
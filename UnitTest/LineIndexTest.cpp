@@ -0,0 +1,112 @@
+#include "LineIndex.h"
+#include "PrefixSums.h"
+#include "UnitTest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks PrefixSums and LineIndex against sums and line starts worked out from scratch, over random edits.
+
+typedef std::u16string Text;
+
+void TestPrefixSums()
+{
+    std::mt19937 random(1);
+    std::vector<long> values;
+    PrefixSums<long> sums;
+    for (int step = 0; step < 2000; ++step)
+    {
+        const size_t first = values.empty() ? 0 : random() % (values.size() + 1);
+        const size_t last = first + (first == values.size() ? 0 : random() % std::min<size_t>(3, values.size() - first + 1));
+        std::vector<long> inserted(random() % 4);
+        for (long& v : inserted)
+            v = long(random() % 5);     // Including 0
+        if (step % 3 == 0)
+            inserted.resize(last - first);
+        values.erase(values.begin() + first, values.begin() + last);
+        values.insert(values.begin() + first, inserted.begin(), inserted.end());
+        sums.Replace(first, last, inserted.data(), inserted.size());
+
+        CHECK(sums.Size() == values.size());
+        long sum = 0;
+        for (size_t i = 0; i <= values.size(); ++i)
+        {
+            CHECK(sums.Sum(i) == sum);
+            if (i < values.size())
+            {
+                CHECK(sums[i] == values[i]);
+                sum += values[i];
+            }
+        }
+        CHECK(sums.Total() == sum);
+        for (long s = 0; s <= sum; ++s)
+        {
+            size_t i = 0;
+            while (i < values.size() && sums.Sum(i + 1) <= s)
+                ++i;
+            CHECK(sums.Find(s) == i);
+        }
+    }
+}
+
+void CheckIndex(const LineIndex<char16_t>& index, const Text& text)
+{
+    std::vector<size_t> starts(1, 0);
+    for (size_t i = 0; i < text.length(); ++i)
+        if (text[i] == u'\n')
+            starts.push_back(i + 1);
+
+    CHECK(index.Lines() == starts.size());
+    for (size_t line = 0; line < starts.size(); ++line)
+    {
+        CHECK(index.Start(line) == starts[line]);
+        CHECK(index.End(line, text.length()) == ((line + 1) < starts.size() ? starts[line + 1] - 1 : text.length()));
+    }
+    size_t line = 0;
+    for (size_t offset = 0; offset <= text.length(); ++offset)
+    {
+        if ((line + 1) < starts.size() && starts[line + 1] == offset)
+            ++line;
+        CHECK(index.Find(offset) == line);
+    }
+}
+
+void TestLineIndex()
+{
+    std::mt19937 random(2);
+    const Text pieces[] = { u"a", u"bc", u"\n", u"d\ne", u"\n\n", u"fgh\n" };
+    Text text;
+    LineIndex<char16_t> index;
+    CheckIndex(index, text);
+    for (int step = 0; step < 2000; ++step)
+    {
+        const size_t offset = random() % (text.length() + 1);
+        if (random() % 3 == 0 && offset < text.length())
+        {
+            const size_t length = 1 + random() % std::min<size_t>(5, text.length() - offset);
+            text.erase(offset, length);
+            index.Erase(offset, length);
+        }
+        else
+        {
+            const Text& piece = pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+            text.insert(offset, piece);
+            index.Insert(offset, piece.data(), piece.length());
+        }
+        CheckIndex(index, text);
+
+        if (step % 500 == 0)
+        {
+            index.Reset(text.data(), text.length());
+            CheckIndex(index, text);
+        }
+    }
+}
+
+int main()
+{
+    TestPrefixSums();
+    TestLineIndex();
+    return g_failures;
+}
@@ -0,0 +1,111 @@
+#include "FakeConsole.h"
+#include "RadReadConsole.h"
+#include "UnitTest.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// Lines per second and bytes per second read from a pipe fed by another thread and from a file, a script of commands
+// given as the input instead of a console, in the console code page and in UTF-8.
+
+std::string Script(const long lines)
+{
+    std::string script;
+    char line[128];
+    for (long i = 0; i < lines; ++i)
+    {
+        snprintf(line, sizeof(line), "git commit -m \"change %ld\" && dir /s *.cpp\r\n", i);
+        script += line;
+    }
+    return script;
+}
+
+struct Result
+{
+    long lines;
+    double ms;
+};
+
+// Reads lines until the end of the input
+Result ReadAll(const HANDLE hInput)
+{
+    Result result = { 0, 0 };
+    const double start = Now();
+    WCHAR buffer[1024];
+    DWORD read = 0;
+    while (RadReadConsoleW(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr) && read > 0)
+        if (buffer[read - 1] == L'\n')
+            ++result.lines;
+    result.ms = Now() - start;
+    return result;
+}
+
+Result ReadPipe(const std::string& script)
+{
+    HANDLE hRead = NULL;
+    HANDLE hWrite = NULL;
+    CHECK(CreatePipe(&hRead, &hWrite, nullptr, 0));
+    std::thread writer([&script, hWrite]()
+        {
+            // In pieces no larger than a pipe buffer, as a program writing its output would
+            const DWORD Piece = 4096;
+            for (size_t i = 0; i < script.size(); i += Piece)
+            {
+                DWORD written = 0;
+                WriteFile(hWrite, script.data() + i, DWORD(std::min(size_t(Piece), script.size() - i)), &written, nullptr);
+            }
+            CloseHandle(hWrite);
+        });
+    const Result result = ReadAll(hRead);
+    writer.join();
+    CloseHandle(hRead);
+    return result;
+}
+
+Result ReadScriptFile(const std::string& script)
+{
+    char name[] = "/tmp/PipeBenchXXXXXX";
+    const int fd = mkstemp(name);
+    CHECK(fd >= 0 && write(fd, script.data(), script.size()) == ssize_t(script.size()));
+    close(fd);
+
+    std::wstring path;
+    for (const char* p = name; *p != '\0'; ++p)
+        path += WCHAR(*p);
+    const HANDLE hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    const Result result = ReadAll(hFile);
+    CloseHandle(hFile);
+    unlink(name);
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const long lines = BenchSize(argc, argv, 200000);
+    const std::string script = Script(lines);
+    FakeConsole::Reset(80, 25);
+
+    // Each line goes to the history, the first pass adds them and the timed ones find them there
+    ReadScriptFile(script);
+
+    printf("%ld lines, %.1f MB\n", lines, script.size() / 1e6);
+    printf("%-14s %14s %10s\n", "", "lines/s", "MB/s");
+    for (const bool utf8 : { false, true })
+    {
+        FakeConsole::SetEnvironment(L"RAD_INPUT_ENCODING", utf8 ? L"UTF8" : nullptr);
+        for (const bool pipe : { true, false })
+        {
+            const Result result = pipe ? ReadPipe(script) : ReadScriptFile(script);
+            CHECK(result.lines == lines);
+            char name[32];
+            snprintf(name, sizeof(name), "%s %s", pipe ? "pipe" : "file", utf8 ? "UTF-8" : "code page");
+            printf("%-14s %14.0f %10.1f\n", name, result.lines * 1000 / result.ms, script.size() / 1e3 / result.ms);
+        }
+    }
+
+    return g_failures;
+}
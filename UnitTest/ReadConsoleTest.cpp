@@ -0,0 +1,428 @@
+#include "FakeConsole.h"
+#include "RadReadConsole.h"
+#include "UnitTest.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// Reads lines from the emulated console through the exported functions.
+
+const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+
+// Reads with RadReadConsoleUtf8 in pieces of size bytes until the end of the line, keeping where each piece ended
+std::string ReadUtf8(const DWORD size, std::string* pPieces = nullptr)
+{
+    std::string line;
+    while (line.empty() || line.back() != '\n')
+    {
+        CHAR buffer[64];
+        DWORD read = 0;
+        if (!RadReadConsoleUtf8(hInput, buffer, size, &read, nullptr))
+            return line + "<error>";
+        CHECK(read > 0 && read <= size);
+        line.append(buffer, read);
+        if (pPieces != nullptr)
+            pPieces->append(buffer, read).append("|");
+    }
+    return line;
+}
+
+// A line is transcoded into the callers buffer as far as it fits and the rest comes over the following reads of the
+// handle, a grapheme cluster is never split
+void TestUtf8()
+{
+    FakeConsole::Reset(80, 25);
+
+    FakeConsole::Type(L"abc\r");
+    CHAR buffer[8];
+    DWORD read = 0;
+    CHECK(RadReadConsoleUtf8(hInput, buffer, 5, &read, nullptr));
+    CHECK(std::string(buffer, read) == "abc\r\n");
+
+    FakeConsole::Type(L"a\u00E9\U0001F600\r");
+    std::string pieces;
+    CHECK(ReadUtf8(4, &pieces) == "a\xC3\xA9\xF0\x9F\x98\x80\r\n");
+    CHECK(pieces == "a\xC3\xA9|\xF0\x9F\x98\x80|\r\n|");
+
+    // e and a combining acute accent are one cluster
+    FakeConsole::Type(L"ae\u0301x\r");
+    pieces.clear();
+    CHECK(ReadUtf8(3, &pieces) == "ae\xCC\x81x\r\n");
+    CHECK(pieces == "a|e\xCC\x81|x\r\n|");
+    FakeConsole::Type(L"\u00E9\r");
+    CHECK(!RadReadConsoleUtf8(hInput, buffer, 1, &read, nullptr));
+    CHECK(GetLastError() == ERROR_INSUFFICIENT_BUFFER);
+    CHECK(ReadUtf8(8) == "\xC3\xA9\r\n");
+}
+
+std::wstring ReadLine()
+{
+    WCHAR buffer[256];
+    DWORD read = 0;
+    CHECK(RadReadConsoleW(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+    return std::wstring(buffer, read);
+}
+
+// The callers modes are back after every read, in a session too, where a read only costs a GetConsoleMode for each
+// mode more than setting the modes and restoring them, and the environment isn't read again
+void TestSession()
+{
+    FakeConsole::Reset(80, 25);
+    const DWORD input = FakeConsole::InputMode();
+    const DWORD output = FakeConsole::OutputMode();
+
+    FakeConsole::Type(L"one\r");
+    CHECK(ReadLine() == L"one\r\n");
+    CHECK(FakeConsole::InputMode() == input);
+    CHECK(FakeConsole::OutputMode() == output);
+
+    RadBeginSession();
+    for (int i = 0; i < 3; ++i)
+    {
+        const FakeConsole::Counters before = FakeConsole::GetCounters();
+        FakeConsole::Type(L"two\r");
+        CHECK(ReadLine() == L"two\r\n");
+        CHECK(FakeConsole::InputMode() == input);
+        CHECK(FakeConsole::OutputMode() == output);
+        const FakeConsole::Counters after = FakeConsole::GetCounters();
+        if (i > 0)
+        {
+            CHECK(after.mode_calls - before.mode_calls == 6);
+            CHECK(after.environment_calls == before.environment_calls);
+        }
+    }
+
+    // A program run between prompts changed the mode, it is taken as the callers
+    const DWORD changed = input & ~ENABLE_INSERT_MODE;
+    SetConsoleMode(hInput, changed);
+    FakeConsole::Type(L"three\r");
+    CHECK(ReadLine() == L"three\r\n");
+    CHECK(FakeConsole::InputMode() == changed);
+    CHECK(FakeConsole::OutputMode() == output);
+
+    // The output mode too
+    const HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    const DWORD changed_output = output & ~ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    SetConsoleMode(hOutput, changed_output);
+    FakeConsole::Type(L"four\r");
+    CHECK(ReadLine() == L"four\r\n");
+    CHECK(FakeConsole::InputMode() == changed);
+    CHECK(FakeConsole::OutputMode() == changed_output);
+    SetConsoleMode(hOutput, output);
+    FakeConsole::Type(L"five\r");
+    CHECK(ReadLine() == L"five\r\n");
+    CHECK(FakeConsole::OutputMode() == output);
+    RadEndSession();
+
+    FakeConsole::Type(L"six\r");
+    CHECK(ReadLine() == L"six\r\n");
+    CHECK(FakeConsole::InputMode() == changed);
+    CHECK(FakeConsole::OutputMode() == output);
+}
+
+// Waits for the editor to take the keys sent and draw them, up to 10 seconds, returns false if it didn't
+template<class F>
+bool WaitFor(const F& shown)
+{
+    const double start = Now();
+    while (!shown() && (Now() - start) < 10 * 1000)
+        std::this_thread::yield();
+    return shown();
+}
+
+bool CursorAt(const SHORT x, const SHORT y)
+{
+    const COORD cursor = FakeConsole::Cursor();
+    return cursor.X == x && cursor.Y == y;
+}
+
+// A line wrapped by a resize in the middle of editing is drawn again over the new width and edited at that width, in a
+// single line and with RAD_MULTILINE
+void TestResize()
+{
+    const std::wstring line = L"abcdefghijklmnopqrstuvwxyz0123";
+    for (const LPCWSTR lpName : { LPCWSTR(nullptr), L"RAD_MULTILINE" })
+    {
+        FakeConsole::Reset(80, 25);
+        if (lpName != nullptr)
+            FakeConsole::SetEnvironment(lpName, L"1");
+        std::thread reader([&line]() { CHECK(ReadLine() == line + L"\r\n"); });
+        while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+            std::this_thread::yield();
+
+        FakeConsole::Type(line);
+        for (int i = 0; i < 15; ++i)
+            FakeConsole::Key(VK_LEFT, 0);
+        CHECK(WaitFor([]() { return CursorAt(15, 0); }));
+
+        // The emulated console doesn't reflow, the editor wraps the tail onto the next row
+        FakeConsole::Resize(20, 25);
+        CHECK(WaitFor([&line]() { return FakeConsole::Row(1) == line.substr(20); }));
+        CHECK(FakeConsole::Row(0) == line.substr(0, 20));
+        CHECK(FakeConsole::Row(1) == line.substr(20));
+        CHECK(CursorAt(15, 0));
+        FakeConsole::Key(VK_END, 0);
+        CHECK(WaitFor([]() { return CursorAt(10, 1); }));
+
+        // Wide enough again
+        FakeConsole::Resize(80, 25);
+        CHECK(WaitFor([&line]() { return FakeConsole::Row(0) == line && FakeConsole::Row(1).empty(); }));
+        CHECK(FakeConsole::Row(0) == line);
+        CHECK(FakeConsole::Row(1).empty());
+        CHECK(CursorAt(30, 0));
+
+        FakeConsole::Key(VK_RETURN, L'\r');
+        reader.join();
+    }
+}
+
+std::string ReadLineA()
+{
+    static CHAR buffer[10000];
+    DWORD read = 0;
+    CHECK(RadReadConsoleA(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+    return std::string(buffer, read);
+}
+
+// RadReadConsoleA edits the line in the console code page, a character taking more than one byte is stepped over and
+// erased whole, what doesn't fit the buffer isn't taken and a line isn't limited to the length of RadReadConsoleView
+void TestCodePage()
+{
+    FakeConsole::Reset(80, 25);
+    FakeConsole::SetCodePage(CP_UTF8);
+
+    FakeConsole::Type(L"\u00E9\u00E9\u00E9\u00E9\r");
+    CHAR buffer[8];
+    DWORD read = 0;
+    CHECK(RadReadConsoleA(hInput, buffer, ARRAYSIZE(buffer), &read, nullptr));
+    CHECK(std::string(buffer, read) == "\xC3\xA9\xC3\xA9\xC3\xA9\r\n");
+    CHECK(!RadReadConsoleA(hInput, buffer, 1, &read, nullptr));
+    CHECK(GetLastError() == ERROR_INSUFFICIENT_BUFFER);
+
+    std::thread reader([]() { CHECK(ReadLineA() == "ab\r\n"); });
+    FakeConsole::Type(L"a\u00E9b");
+    FakeConsole::Key(VK_LEFT, 0);
+    CHECK(WaitFor([]() { return CursorAt(2, 1); }));
+    FakeConsole::Key(VK_BACK, L'\b');
+    CHECK(WaitFor([]() { return FakeConsole::Row(1) == L"ab"; }));
+    CHECK(CursorAt(1, 1));
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+
+    FakeConsole::Reset(200, 50);
+    FakeConsole::SetCodePage(CP_UTF8);
+    FakeConsole::Type(std::wstring(8200, L'a') + L"\u4E2D\r");
+    CHECK(ReadLineA() == std::string(8200, 'a') + "\xE4\xB8\xAD\r\n");
+}
+
+// With RAD_MULTILINE, Ctrl+Enter starts a line of its own, Up and Down move between the lines keeping the column as
+// far as the line allows, and Backspace at the start of a line joins it to the one before
+void TestMultiLine()
+{
+    FakeConsole::Reset(80, 25);
+    FakeConsole::SetEnvironment(L"RAD_MULTILINE", L"1");
+    std::thread reader([]() { CHECK(ReadLine() == L"echo one two\necho three\r\n"); });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+
+    FakeConsole::Type(L"echo one");
+    FakeConsole::Key(VK_RETURN, L'\n', LEFT_CTRL_PRESSED);
+    FakeConsole::Type(L"echo three");
+    CHECK(WaitFor([]() { return CursorAt(10, 1); }));
+    CHECK(FakeConsole::Row(0) == L"echo one");
+    CHECK(FakeConsole::Row(1) == L"echo three");
+
+    // The first line is shorter
+    FakeConsole::Key(VK_UP, 0);
+    CHECK(WaitFor([]() { return CursorAt(8, 0); }));
+    FakeConsole::Type(L" two");
+    CHECK(WaitFor([]() { return FakeConsole::Row(0) == L"echo one two"; }));
+    CHECK(FakeConsole::Row(1) == L"echo three");
+    CHECK(CursorAt(12, 0));
+    FakeConsole::Key(VK_DOWN, 0);
+    CHECK(WaitFor([]() { return CursorAt(10, 1); }));
+
+    // Down on the last line leaves the text as it is
+    FakeConsole::Key(VK_DOWN, 0);
+    FakeConsole::Key(VK_HOME, 0);
+    CHECK(WaitFor([]() { return CursorAt(0, 1); }));
+    FakeConsole::Key(VK_BACK, L'\b');
+    CHECK(WaitFor([]() { return FakeConsole::Row(1).empty(); }));
+    CHECK(FakeConsole::Row(0) == L"echo one twoecho three");
+    CHECK(CursorAt(12, 0));
+
+    // And split again
+    FakeConsole::Key(VK_RETURN, L'\n', LEFT_CTRL_PRESSED);
+    CHECK(WaitFor([]() { return FakeConsole::Row(1) == L"echo three"; }));
+    CHECK(FakeConsole::Row(0) == L"echo one two");
+    CHECK(CursorAt(0, 1));
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+}
+
+// A file of its own in /tmp, removed at the end of the test
+class TempFile
+{
+public:
+    TempFile()
+    {
+        const int fd = mkstemp(m_name);
+        CHECK(fd >= 0);
+        close(fd);
+        for (const char* p = m_name; *p != '\0'; ++p)
+            m_path += WCHAR(*p);
+    }
+
+    ~TempFile()
+    {
+        unlink(m_name);
+    }
+
+    LPCWSTR Path() const { return m_path.c_str(); }
+
+    std::wstring Read() const
+    {
+        const HANDLE hFile = CreateFile(Path(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        std::wstring text;
+        WCHAR buffer[1024];
+        DWORD read = 0;
+        while (ReadFile(hFile, buffer, sizeof(buffer), &read, nullptr) && read > 0)
+            text.append(buffer, read / sizeof(WCHAR));
+        CloseHandle(hFile);
+        return text;
+    }
+
+    void Write(const std::wstring& text) const
+    {
+        const HANDLE hFile = Create();
+        DWORD written = 0;
+        CHECK(WriteFile(hFile, text.data(), DWORD(text.length() * sizeof(WCHAR)), &written, nullptr));
+        CloseHandle(hFile);
+    }
+
+    void WriteHistory() const
+    {
+        const HANDLE hFile = Create();
+        CHECK(::WriteHistory(hFile));
+        CloseHandle(hFile);
+    }
+
+private:
+    HANDLE Create() const
+    {
+        return CreateFile(Path(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+
+    char m_name[32] = "/tmp/ReadConsoleTestXXXXXX";
+    std::wstring m_path;
+};
+
+// Entries with newlines and backslashes come back from a history file as they went in
+void TestHistoryFile()
+{
+    FakeConsole::Reset(80, 25);
+    FakeConsole::SetEnvironment(L"RAD_MULTILINE", L"1");
+
+    FakeConsole::Type(L"echo one");
+    FakeConsole::Key(VK_RETURN, L'\n', LEFT_CTRL_PRESSED);
+    FakeConsole::Type(L"echo two\r");
+    CHECK(ReadLine() == L"echo one\necho two\r\n");
+    FakeConsole::Type(L"type \\\\server\\new.txt\r");
+    CHECK(ReadLine() == L"type \\\\server\\new.txt\r\n");
+
+    // After the version line, a backslash is only doubled before n, r or another backslash
+    TempFile first;
+    first.WriteHistory();
+    const std::wstring written = first.Read();
+    const std::wstring header = L"#RadReadConsole history 2\n";
+    CHECK(written.compare(0, header.length(), header) == 0);
+    const std::wstring escaped = L"echo one\\necho two\ntype \\\\\\server\\\\new.txt\n";
+    CHECK(written.length() >= escaped.length() && written.compare(written.length() - escaped.length(), escaped.length(), escaped) == 0);
+
+    // Loaded as older than all the history, so written again before it
+    CHECK(RadLoadHistory(first.Path()));
+    TempFile second;
+    second.WriteHistory();
+    CHECK(second.Read() == written + written.substr(header.length()));
+
+    // A file from before entries were escaped is taken as it is
+    TempFile old;
+    old.Write(L"dir C:\\new\\readme\n");
+    CHECK(RadLoadHistory(old.Path()));
+    TempFile third;
+    third.WriteHistory();
+    const std::wstring loaded = header + L"dir C:\\\\new\\\\readme\n";
+    CHECK(third.Read().compare(0, loaded.length(), loaded) == 0);
+}
+
+// The entries of a file rank newest first, as if each was run a little after the one before it
+void TestLoadedRanking()
+{
+    FakeConsole::Reset(80, 25);
+    FakeConsole::SetEnvironment(L"RAD_HISTORY_RANKED", L"1");
+    TempFile file;
+    file.Write(L"rank a\nrank b\nrank c\n");
+    CHECK(RadLoadHistory(file.Path()));
+    TempFile written;
+    written.WriteHistory();     // Waits for the load
+
+    // Each read runs the entry again, which moves it above the ones after it
+    const std::wstring expected[] = { L"rank c", L"rank b", L"rank a" };
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int up = 0; up <= i; ++up)
+            FakeConsole::Key(VK_UP, 0);
+        FakeConsole::Type(L"\r");
+        CHECK(ReadLine() == expected[i] + L"\r\n");
+    }
+}
+
+// Entries that arrive while browsing the frecency ranking are added once the line is changed, in the same read
+void TestLoadWhileBrowsing()
+{
+    FakeConsole::Reset(80, 25);
+    FakeConsole::SetEnvironment(L"RAD_HISTORY_RANKED", L"1");
+    FakeConsole::SetEnvironment(L"RAD_AUTOSUGGEST", L"1");
+    TempFile file;
+    file.Write(L"echo loaded\n");
+
+    std::thread reader([]() { CHECK(ReadLine() == L"echo lo\r\n"); });
+    while (!(FakeConsole::InputMode() & ENABLE_WINDOW_INPUT))
+        std::this_thread::yield();
+
+    // Sent once the keys before have been taken and drawn
+    const auto send = [](const WORD wVirtualKeyCode, const WCHAR c)
+        {
+            const long writes = FakeConsole::GetCounters().screen_writes;
+            FakeConsole::Key(wVirtualKeyCode, c);
+            CHECK(FakeConsole::WaitForWrite(writes, 10 * 1000));
+            while (FakeConsole::Pending() > 0)
+                std::this_thread::yield();
+        };
+    send(VK_UP, 0);
+    CHECK(RadLoadHistory(file.Path()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    send(VK_ESCAPE, 0);
+    for (const WCHAR c : std::wstring(L"echo lo"))
+        send(c == L' ' ? VK_SPACE : WORD(c - L'a' + 'A'), c);
+    // The suggestion is drawn after the key
+    CHECK(WaitFor([]() { return FakeConsole::Row(0) == L"echo loaded"; }));
+    FakeConsole::Key(VK_RETURN, L'\r');
+    reader.join();
+}
+
+int main()
+{
+    TestLoadedRanking();     // First, with no other history
+    TestUtf8();
+    TestSession();
+    TestResize();
+    TestCodePage();
+    TestMultiLine();
+    TestHistoryFile();
+    TestLoadWhileBrowsing();
+    return g_failures;
+}
@@ -0,0 +1,262 @@
+#include "SharedHistory.h"
+#include "UnitTest.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <new>
+#include <sched.h>
+#include <vector>
+
+// Writers and readers are separate processes sharing the ring through POSIX shared memory.
+// Every entry is derived from its writer and index so a reader can tell a torn copy from a whole one,
+// and a reader keeps a bit for each entry so it can tell if one is read twice.
+
+typedef char16_t Char;
+
+const uint32_t SlotCount = 16;      // Small so the ring wraps many times during the test
+const uint32_t SlotChars = 2048;   // Large so copies take long enough to be overlapped
+const uint32_t Writers = 3;        // And one more that is killed
+const uint32_t Readers = 2;
+const uint32_t Entries = 20000;     // Per writer
+
+// Shared with the children after the ring
+struct Status
+{
+    std::atomic<uint32_t> writers;
+};
+
+uint32_t Length(const uint32_t owner, const uint32_t index)
+{
+    return 2 + (owner * 7919 + index * 104729) % (SlotChars - 1);
+}
+
+void MakeEntry(const uint32_t owner, const uint32_t index, Char* text)
+{
+    text[0] = Char(index & 0xFFFF);
+    text[1] = Char(index >> 16);
+    for (uint32_t i = 2; i < Length(owner, index); ++i)
+        text[i] = Char(owner * 1000 + index + i);
+}
+
+// Returns false if the entry isn't one a writer could have appended
+bool CheckEntry(const Char* text, const uint32_t length, const uint32_t owner, uint32_t* pIndex)
+{
+    if (owner < 1 || owner > Writers + 1 || length < 2)
+        return false;
+    const uint32_t index = text[0] | (uint32_t(text[1]) << 16);
+    if (index >= Entries || length != Length(owner, index))
+        return false;
+    Char expected[SlotChars];
+    MakeEntry(owner, index, expected);
+    if (memcmp(text, expected, length * sizeof(Char)) != 0)
+        return false;
+    *pIndex = index;
+    return true;
+}
+
+// Gives up the processor at short intervals, often mid-copy, so the processes interleave even on one core
+void Interleave()
+{
+    signal(SIGALRM, [](int) { sched_yield(); });
+    const itimerval interval = { { 0, 200 }, { 0, 200 } };
+    setitimer(ITIMER_REAL, &interval, nullptr);
+}
+
+int Writer(void* p, const uint32_t owner)
+{
+    Interleave();
+    SharedHistoryRing<Char> ring;
+    if (!ring.Open(p, SharedHistoryRing<Char>::Size(SlotCount, SlotChars), SlotCount, SlotChars))
+        return 3;
+    Char text[SlotChars];
+    for (uint32_t i = 0; i < Entries; ++i)
+    {
+        MakeEntry(owner, i, text);
+        ring.Append(owner, text, Length(owner, i));
+    }
+    return 0;
+}
+
+// Exit codes so the parent can tell what went wrong
+enum { ReadOk = 0, ReadTorn = 1, ReadTwice = 2, ReadNone = 4 };
+
+int Reader(void* p, const Status* status)
+{
+    SharedHistoryRing<Char> ring;
+    if (!ring.Open(p, SharedHistoryRing<Char>::Size(SlotCount, SlotChars), SlotCount, SlotChars))
+        return 3;
+
+    Interleave();
+    std::vector<bool> seen(size_t(Writers + 2) * Entries);
+    Char text[SlotChars];
+    uint64_t seq = 0;
+    uint64_t read = 0;
+    int result = ReadOk;
+    for (;;)
+    {
+        const bool done = status->writers.load() == 0;
+        const uint64_t head = ring.Head();
+        for (seq = std::max(seq, ring.Tail()); seq < head; ++seq)
+        {
+            uint32_t length = 0;
+            uint32_t owner = 0;
+            if (!ring.Read(seq, text, &length, &owner))
+                continue;   // Overwritten, or pending which is the same as abandoned here
+            uint32_t index = 0;
+            if (!CheckEntry(text, length, owner, &index))
+                result |= ReadTorn;
+            else if (seen[owner * Entries + index])
+                result |= ReadTwice;
+            else
+                seen[owner * Entries + index] = true;
+            ++read;
+        }
+        if (done)
+            break;
+        sched_yield();
+    }
+    return read == 0 ? result | ReadNone : result;
+}
+
+template <class F>
+pid_t Fork(F f)
+{
+    const pid_t pid = fork();
+    if (pid == 0)
+        _exit(f());
+    return pid;
+}
+
+int Wait(const pid_t pid)
+{
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Processes opening a new ring together all get it, and one left half initialised by a process that died is taken over
+void TestOpen()
+{
+    const uint32_t Openers = 8;
+    const size_t size = SharedHistoryRing<Char>::Size(SlotCount, SlotChars);
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(p != MAP_FAILED);
+
+    std::vector<pid_t> openers;
+    for (uint32_t i = 1; i <= Openers; ++i)
+        openers.push_back(Fork([p, size, i]()
+            {
+                SharedHistoryRing<Char> ring;
+                const Char text[] = { Char(i) };
+                return ring.Open(p, size, SlotCount, SlotChars) && ring.Append(i, text, 1) ? 0 : 1;
+            }));
+    for (const pid_t pid : openers)
+        CHECK(Wait(pid) == 0);
+    SharedHistoryRing<Char> ring;
+    CHECK(ring.Open(p, size, SlotCount, SlotChars));
+    CHECK(ring.Head() == Openers);
+
+    // As a process that died after claiming the header, the magic is its first member
+    memset(p, 0, size);
+    static_cast<std::atomic<uint32_t>*>(p)->store((7 << 8) | SharedHistoryRing<Char>::Initialising);
+    const auto start = std::chrono::steady_clock::now();
+    SharedHistoryRing<Char> stuck;
+    CHECK(stuck.Open(p, size, SlotCount, SlotChars));
+    CHECK((std::chrono::steady_clock::now() - start) >= SharedHistoryRing<Char>::InitialiseTimeout);
+    CHECK(stuck.Head() == 0);
+    const Char text[] = { Char(1) };
+    CHECK(stuck.Append(1, text, 1));
+
+    munmap(p, size);
+}
+
+int main()
+{
+    TestOpen();
+
+    const size_t ring_size = SharedHistoryRing<Char>::Size(SlotCount, SlotChars);
+    const size_t size = ring_size + sizeof(Status);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/RadReadConsoleTest.%d", int(getpid()));
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, off_t(size)) != 0)
+    {
+        perror("shm_open");
+        return 1;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    shm_unlink(name);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    Status* status = new (static_cast<char*>(p) + ring_size) Status;
+    status->writers = Writers + 1;
+
+    std::vector<pid_t> readers;
+    for (uint32_t r = 0; r < Readers; ++r)
+        readers.push_back(Fork([p, status]() { return Reader(p, status); }));
+
+    std::vector<pid_t> writers;
+    for (uint32_t w = 1; w <= Writers; ++w)
+        writers.push_back(Fork([p, w]() { return Writer(p, w); }));
+
+    // A writer that dies part way, maybe mid-append, may leave a slot busy but must not tear any entry
+    const pid_t crashed = Fork([p]() { return Writer(p, Writers + 1); });
+    usleep(2000);
+    kill(crashed, SIGKILL);
+    Wait(crashed);
+    --status->writers;
+
+    for (const pid_t pid : writers)
+    {
+        CHECK(Wait(pid) == 0);
+        --status->writers;
+    }
+    for (const pid_t pid : readers)
+        CHECK(Wait(pid) == ReadOk);
+
+    // Once everything is published the last SlotCount entries are distinct, all readable except
+    // where a writer was killed mid-append or one that stalled wrote over a newer entry
+    SharedHistoryRing<Char> ring;
+    CHECK(ring.Open(p, ring_size, SlotCount, SlotChars));
+    CHECK(ring.Head() >= Writers * Entries);
+    std::vector<bool> seen(size_t(Writers + 2) * Entries);
+    uint32_t unreadable = 0;
+    for (uint64_t seq = ring.Tail(); seq < ring.Head(); ++seq)
+    {
+        Char text[SlotChars];
+        uint32_t length = 0;
+        uint32_t owner = 0;
+        uint32_t index = 0;
+        if (!ring.Read(seq, text, &length, &owner))
+        {
+            ++unreadable;
+            continue;
+        }
+        CHECK(CheckEntry(text, length, owner, &index));
+        CHECK(!seen[owner * Entries + index]);
+        seen[owner * Entries + index] = true;
+    }
+    CHECK(unreadable <= Writers + 1);
+
+    // Layouts that don't match are refused
+    SharedHistoryRing<Char> other;
+    CHECK(!other.Open(p, ring_size, SlotCount, SlotChars + 1));
+    CHECK(!other.Open(p, ring_size - 1, SlotCount, SlotChars));
+    SharedHistoryRing<char32_t> wide;
+    CHECK(!wide.Open(p, ring_size * 2, SlotCount, SlotChars));
+
+    munmap(p, size);
+    return g_failures;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Checks for the tests, a failure is reported and the test carries on, main returns the failure count
+inline int g_failures = 0;
+
+#define CHECK(x) ((x) ? (void) 0 : (fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #x), ++g_failures, (void) 0))
+
+// Benchmarks take their size from the first argument, ctest passes a small one so they are only smoke tested
+inline long BenchSize(int argc, char* argv[], long def)
+{
+    return argc > 1 ? atol(argv[1]) : def;
+}
+
+inline double Now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
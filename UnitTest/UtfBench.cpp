@@ -0,0 +1,101 @@
+#include "Utf.h"
+#include "UnitTest.h"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Throughput of the transcoders, built twice like UtfTest to compare the SSE2 and scalar code.
+// Converts a large buffer in one call and history sized lines one at a time.
+
+typedef std::u16string Utf16;
+
+Utf16 MakeText(const size_t length, const bool ascii)
+{
+    const char16_t* words[] = { u"git", u"commit", u"-m", u"\"fix the build\"", u"C:\\Users\\rad\\source", u"dir", u"/s", u"*.cpp" };
+    const char16_t* other[] = { u"r\u00E9sum\u00E9", u"\u4E2D\u6587", u"\U0001F600" };
+    Utf16 text;
+    for (size_t i = 0; text.length() < length; ++i)
+    {
+        text += !ascii && i % 5 == 0 ? other[i % std::size(other)] : words[i % std::size(words)];
+        text += i % 9 == 8 ? u'\n' : u' ';
+    }
+    text.resize(length);
+    if (text.length() > 0 && text.back() >= 0xD800 && text.back() < 0xDC00)
+        text.back() = u'x';
+    return text;
+}
+
+// Returns MB of UTF-16 input a second
+double ToUtf8(const Utf16& text, const size_t line, const int repeat, std::vector<uint8_t>& out)
+{
+    out.resize(Utf::Utf8Size(text.length()) + 3);
+    size_t bytes = 0;
+    const double start = Now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        bytes = 0;
+        for (size_t i = 0; i < text.length(); i += line)
+        {
+            Utf::Utf16ToUtf8<char16_t> utf8;
+            bytes += utf8.Convert(text.data() + i, std::min(line, text.length() - i), out.data() + bytes);
+            bytes += utf8.Finish(out.data() + bytes);
+        }
+    }
+    const double ms = Now() - start;
+    out.resize(bytes);
+    return text.length() * 2.0 * repeat / (ms * 1000.0);
+}
+
+// Returns MB of UTF-8 input a second
+double ToUtf16(const std::vector<uint8_t>& bytes, const size_t line, const int repeat, Utf16& out)
+{
+    out.resize(Utf::Utf16Size(bytes.size()) + 4);
+    size_t chars = 0;
+    const double start = Now();
+    for (int r = 0; r < repeat; ++r)
+    {
+        chars = 0;
+        for (size_t i = 0; i < bytes.size(); i += line)
+        {
+            Utf::Utf8ToUtf16<char16_t> utf16;
+            chars += utf16.Convert(bytes.data() + i, std::min(line, bytes.size() - i), &out[chars]);
+            chars += utf16.Finish(&out[chars]);
+        }
+    }
+    const double ms = Now() - start;
+    out.resize(chars);
+    return bytes.size() * double(repeat) / (ms * 1000.0);
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t length = size_t(BenchSize(argc, argv, 16 * 1024 * 1024));
+    const int repeat = 4;
+
+#ifdef RAD_UTF_SSE2
+    printf("SSE2, %zu characters, MB/s of input\n", length);
+#else
+    printf("Scalar, %zu characters, MB/s of input\n", length);
+#endif
+    printf("%-20s %12s %12s\n", "", "UTF-16>8", "UTF-8>16");
+    for (const bool ascii : { true, false })
+    {
+        const Utf16 text = MakeText(length, ascii);
+        for (const size_t line : { length, size_t(32) })
+        {
+            std::vector<uint8_t> utf8;
+            Utf16 utf16;
+            const double to8 = ToUtf8(text, line, repeat, utf8);
+            // Lines in UTF-8 are a different length, split the whole of it the same way for both
+            const double to16 = ToUtf16(utf8, line == length ? utf8.size() : line, repeat, utf16);
+            if (line == length)
+                CHECK(utf16 == text);
+            char name[32];
+            snprintf(name, sizeof(name), "%s %s", ascii ? "ASCII" : "mixed", line == length ? "buffer" : "lines");
+            printf("%-20s %12.0f %12.0f\n", name, to8, to16);
+        }
+    }
+
+    return g_failures;
+}
@@ -0,0 +1,194 @@
+#include "Utf.h"
+#include "UnitTest.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Built twice, once as is and once with RAD_UTF_NO_SSE2 for the scalar code.
+// Valid text is checked against a plain encoder, any text is checked to convert the same in one call
+// as split over many, which is how the history pipe and files are read.
+
+typedef std::u16string Utf16;
+typedef std::vector<uint8_t> Utf8;
+
+void Encode(const uint32_t c, Utf16& utf16, Utf8& utf8)
+{
+    if (c >= 0x10000)
+    {
+        utf16 += char16_t(0xD800 + ((c - 0x10000) >> 10));
+        utf16 += char16_t(0xDC00 + ((c - 0x10000) & 0x3FF));
+    }
+    else
+        utf16 += char16_t(c);
+
+    if (c < 0x80)
+        utf8.push_back(uint8_t(c));
+    else if (c < 0x800)
+        utf8.insert(utf8.end(), { uint8_t(0xC0 | (c >> 6)), uint8_t(0x80 | (c & 0x3F)) });
+    else if (c < 0x10000)
+        utf8.insert(utf8.end(), { uint8_t(0xE0 | (c >> 12)), uint8_t(0x80 | ((c >> 6) & 0x3F)), uint8_t(0x80 | (c & 0x3F)) });
+    else
+        utf8.insert(utf8.end(), { uint8_t(0xF0 | (c >> 18)), uint8_t(0x80 | ((c >> 12) & 0x3F)), uint8_t(0x80 | ((c >> 6) & 0x3F)), uint8_t(0x80 | (c & 0x3F)) });
+}
+
+// Runs of ASCII long enough for the vector code, mixed with every length of sequence
+uint32_t RandomCodePoint(std::mt19937& rng)
+{
+    switch (rng() % 8)
+    {
+    case 0: return 0x80 + rng() % (0x800 - 0x80);
+    case 1: { uint32_t c = 0x800 + rng() % (0x10000 - 0x800); return c >= 0xD800 && c < 0xE000 ? c + 0x800 : c; }
+    case 2: return 0x10000 + rng() % (0x110000 - 0x10000);
+    default: return rng() % 0x80;
+    }
+}
+
+void RandomText(std::mt19937& rng, const size_t count, Utf16& utf16, Utf8& utf8)
+{
+    utf16.clear();
+    utf8.clear();
+    while (utf16.length() < count)
+    {
+        if (rng() % 4 == 0)
+        {
+            const size_t run = rng() % 40;
+            for (size_t i = 0; i < run; ++i)
+                Encode(' ' + rng() % 95, utf16, utf8);
+        }
+        else
+            Encode(RandomCodePoint(rng), utf16, utf8);
+    }
+}
+
+// Converts in pieces of random length, a length of 0 is one call for all of it
+template <class Converter, class In, class Out>
+Out Convert(const In& in, std::mt19937& rng, const size_t max_piece, size_t* pInvalid)
+{
+    Converter converter;
+    Out out(in.size() * 3 + 8, 0);
+    size_t used = 0;
+    for (size_t i = 0; i < in.size();)
+    {
+        const size_t piece = max_piece == 0 ? in.size() : std::min(in.size() - i, 1 + rng() % max_piece);
+        used += converter.Convert(&in[i], piece, &out[used]);
+        i += piece;
+    }
+    used += converter.Finish(&out[used]);
+    out.resize(used);
+    *pInvalid = converter.Invalid();
+    return out;
+}
+
+Utf8 ToUtf8(const Utf16& in, std::mt19937& rng, const size_t max_piece = 0, size_t* pInvalid = nullptr)
+{
+    size_t invalid = 0;
+    Utf8 out = Convert<Utf::Utf16ToUtf8<char16_t>, Utf16, Utf8>(in, rng, max_piece, &invalid);
+    if (pInvalid)
+        *pInvalid = invalid;
+    return out;
+}
+
+Utf16 ToUtf16(const Utf8& in, std::mt19937& rng, const size_t max_piece = 0, size_t* pInvalid = nullptr)
+{
+    size_t invalid = 0;
+    Utf16 out = Convert<Utf::Utf8ToUtf16<char16_t>, Utf8, Utf16>(in, rng, max_piece, &invalid);
+    if (pInvalid)
+        *pInvalid = invalid;
+    return out;
+}
+
+Utf8 Bytes(const char* s)
+{
+    return Utf8(s, s + strlen(s));
+}
+
+void TestRoundTrip(std::mt19937& rng)
+{
+    Utf16 utf16;
+    Utf8 utf8;
+    for (int i = 0; i < 2000; ++i)
+    {
+        RandomText(rng, rng() % 300, utf16, utf8);
+        size_t invalid = 0;
+        CHECK(ToUtf8(utf16, rng, 0, &invalid) == utf8);
+        CHECK(invalid == 0);
+        CHECK(ToUtf16(utf8, rng, 0, &invalid) == utf16);
+        CHECK(invalid == 0);
+    }
+}
+
+void TestChunked(std::mt19937& rng)
+{
+    Utf16 utf16;
+    Utf8 utf8;
+    for (int i = 0; i < 2000; ++i)
+    {
+        RandomText(rng, rng() % 300, utf16, utf8);
+
+        // Break some of it, unpaired surrogates in UTF-16 and stray or missing bytes in UTF-8
+        for (int k = rng() % 4; k > 0 && !utf16.empty(); --k)
+            utf16[rng() % utf16.size()] = char16_t(0xD800 + rng() % 0x800);
+        for (int k = rng() % 4; k > 0 && !utf8.empty(); --k)
+        {
+            if (rng() % 2)
+                utf8[rng() % utf8.size()] = uint8_t(0x80 + rng() % 0x80);
+            else
+                utf8.erase(utf8.begin() + rng() % utf8.size());
+        }
+
+        size_t invalid = 0;
+        size_t pieces_invalid = 0;
+        const Utf8 whole8 = ToUtf8(utf16, rng, 0, &invalid);
+        CHECK(Utf::Utf8Length(utf16.data(), utf16.size()) == whole8.size());
+        for (const size_t piece : { 1, 2, 3, 7, 17 })
+        {
+            CHECK(ToUtf8(utf16, rng, piece, &pieces_invalid) == whole8);
+            CHECK(pieces_invalid == invalid);
+        }
+
+        const Utf16 whole16 = ToUtf16(utf8, rng, 0, &invalid);
+        for (const size_t piece : { 1, 2, 3, 5, 33 })
+        {
+            CHECK(ToUtf16(utf8, rng, piece, &pieces_invalid) == whole16);
+            CHECK(pieces_invalid == invalid);
+        }
+
+        // Whatever went in, what comes out is valid and round trips
+        CHECK(ToUtf16(whole8, rng, 0, &invalid) == ToUtf16(whole8, rng, 1));
+        CHECK(invalid == 0);
+        CHECK(ToUtf8(whole16, rng, 0, &invalid).size() >= whole16.size());
+        CHECK(invalid == 0);
+    }
+}
+
+void TestInvalid(std::mt19937& rng)
+{
+    size_t invalid = 0;
+    CHECK(ToUtf8(u"a\xD800", rng, 0, &invalid) == Bytes("a\xEF\xBF\xBD"));     // High surrogate left at the end
+    CHECK(invalid == 1);
+    CHECK(ToUtf8(u"a\xDC00" u"b", rng, 0, &invalid) == Bytes("a\xEF\xBF\xBD" "b"));
+    CHECK(ToUtf8(u"\xD800\xD800\xDC00", rng, 1, &invalid) == Bytes("\xEF\xBF\xBD\xF0\x90\x80\x80"));
+    CHECK(invalid == 1);
+
+    CHECK(ToUtf16(Bytes("\xE2\x82x"), rng, 0, &invalid) == u"\xFFFDx");        // Missing a byte
+    CHECK(ToUtf16(Bytes("x\xE2\x82"), rng, 1, &invalid) == u"x\xFFFD");        // At the end
+    CHECK(ToUtf16(Bytes("\xED\xA0\x80"), rng, 0, &invalid) == u"\xFFFD");      // Encoded surrogate
+    CHECK(ToUtf16(Bytes("\xF4\x90\x80\x80"), rng, 0, &invalid) == u"\xFFFD");  // Past U+10FFFF
+    CHECK(ToUtf16(Bytes("\xC0\xAF"), rng, 0, &invalid) == u"\xFFFD");          // Overlong
+    CHECK(ToUtf16(Bytes("\xFF" "a"), rng, 0, &invalid) == u"\xFFFD" u"a");
+    CHECK(ToUtf16(Bytes("\x80\x80"), rng, 1, &invalid) == u"\xFFFD\xFFFD");
+    CHECK(invalid == 2);
+    CHECK(ToUtf16(Bytes("\xF0\x9F\x98\x80"), rng, 1, &invalid) == u"\U0001F600");
+    CHECK(invalid == 0);
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    TestRoundTrip(rng);
+    TestChunked(rng);
+    TestInvalid(rng);
+    return g_failures;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cassert>
+
+#define _ASSERT(x) assert(x)
+#define _ASSERTE(x) assert(x)
+#define _ASSERT_EXPR(x, m) assert((x) && m)
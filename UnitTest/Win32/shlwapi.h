@@ -0,0 +1,5 @@
+#pragma once
+
+LPWSTR PathFindFileNameW(LPCWSTR pszPath);
+
+#define PathFindFileName PathFindFileNameW
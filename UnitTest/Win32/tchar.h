@@ -0,0 +1,43 @@
+#pragma once
+
+// The generic text functions the library uses, for 2 byte wchar_t
+
+#include <cstddef>
+
+inline size_t _tcslen(const wchar_t* s)
+{
+    size_t n = 0;
+    while (s[n] != L'\0')
+        ++n;
+    return n;
+}
+
+inline wchar_t* _tcschr(const wchar_t* s, const wchar_t c)
+{
+    for (;; ++s)
+    {
+        if (*s == c)
+            return const_cast<wchar_t*>(s);
+        if (*s == L'\0')
+            return nullptr;
+    }
+}
+
+template <size_t size>
+inline int _ultot_s(unsigned long value, wchar_t (&buffer)[size], const int radix)
+{
+    wchar_t digits[64];
+    size_t n = 0;
+    do
+    {
+        const unsigned long d = value % radix;
+        digits[n++] = wchar_t(d < 10 ? L'0' + d : L'a' + d - 10);
+        value /= radix;
+    } while (value != 0);
+    if (n >= size)
+        return 34;  // ERANGE
+    for (size_t i = 0; i < n; ++i)
+        buffer[i] = digits[n - 1 - i];
+    buffer[n] = L'\0';
+    return 0;
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Define RAD_UTF_NO_SSE2 to only build the scalar code
+#if (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)) && !defined(RAD_UTF_NO_SSE2)
+#define RAD_UTF_SSE2
+#include <emmintrin.h>
+#endif
+
+// UTF-16 <-> UTF-8 transcoding.
+// Runs of ASCII are converted 8 or 16 code units at a time with SSE2 where available,
+// everything else goes through the scalar code which also validates the input.
+// Invalid input (unpaired surrogates, malformed UTF-8) is replaced with U+FFFD.
+namespace Utf
+{
+    const uint32_t Replacement = 0xFFFD;
+
+    // Worst case output sizes
+    inline size_t Utf8Size(size_t utf16length) { return utf16length * 3; }
+    inline size_t Utf16Size(size_t utf8length) { return utf8length; }
+
+    namespace detail
+    {
+        inline uint8_t* Put(uint8_t* out, const uint32_t c)
+        {
+            if (c < 0x80)
+                *out++ = uint8_t(c);
+            else if (c < 0x800)
+            {
+                *out++ = uint8_t(0xC0 | (c >> 6));
+                *out++ = uint8_t(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                *out++ = uint8_t(0xE0 | (c >> 12));
+                *out++ = uint8_t(0x80 | ((c >> 6) & 0x3F));
+                *out++ = uint8_t(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                *out++ = uint8_t(0xF0 | (c >> 18));
+                *out++ = uint8_t(0x80 | ((c >> 12) & 0x3F));
+                *out++ = uint8_t(0x80 | ((c >> 6) & 0x3F));
+                *out++ = uint8_t(0x80 | (c & 0x3F));
+            }
+            return out;
+        }
+
+        inline bool IsHighSurrogate(const uint32_t c) { return c >= 0xD800 && c < 0xDC00; }
+        inline bool IsLowSurrogate(const uint32_t c) { return c >= 0xDC00 && c < 0xE000; }
+    }
+
+    // The bytes Utf16ToUtf8 writes for in converted in one call and finished, exactly
+    template <class C16>
+    size_t Utf8Length(const C16* in, const size_t length)
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            const uint32_t c = uint16_t(in[i]);
+            if (c < 0x80)
+                bytes += 1;
+            else if (c < 0x800)
+                bytes += 2;
+            else if (detail::IsHighSurrogate(c) && (i + 1) < length && detail::IsLowSurrogate(uint16_t(in[i + 1])))
+            {
+                bytes += 4;
+                ++i;
+            }
+            else
+                bytes += 3;
+        }
+        return bytes;
+    }
+
+    // Streaming UTF-16 to UTF-8, a high surrogate at the end of one call is paired with the start of the next
+    // out must hold Utf8Size(length) + 3 bytes, or only Utf8Length(in, length) for text converted in one call and finished
+    template <class C16>
+    class Utf16ToUtf8
+    {
+    public:
+        static_assert(sizeof(C16) == 2, "UTF-16 code unit");
+
+        Utf16ToUtf8()
+            : m_high(0), m_invalid(0)
+        {
+        }
+
+        size_t Invalid() const { return m_invalid; }
+
+        // Returns the number of bytes written
+        size_t Convert(const C16* in, const size_t length, uint8_t* const out)
+        {
+            uint8_t* o = out;
+            size_t i = 0;
+
+            if (m_high != 0 && length > 0)
+            {
+                const uint32_t c = uint16_t(in[0]);
+                if (detail::IsLowSurrogate(c))
+                {
+                    o = detail::Put(o, 0x10000 + ((m_high - 0xD800) << 10) + (c - 0xDC00));
+                    ++i;
+                }
+                else
+                    o = Invalid(o);
+                m_high = 0;
+            }
+
+            while (i < length)
+            {
+#ifdef RAD_UTF_SSE2
+                while ((i + 8) <= length)
+                {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                    const __m128i high = _mm_and_si128(v, _mm_set1_epi16(short(0xFF80)));
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF)
+                        break;
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(v, v));
+                    o += 8;
+                    i += 8;
+                }
+                if (i >= length)
+                    break;
+#endif
+                const uint32_t c = uint16_t(in[i++]);
+                if (c < 0x80)
+                    *o++ = uint8_t(c);
+                else if (detail::IsHighSurrogate(c))
+                {
+                    if (i == length)
+                        m_high = c;     // Wait for the next call
+                    else if (detail::IsLowSurrogate(uint16_t(in[i])))
+                        o = detail::Put(o, 0x10000 + ((c - 0xD800) << 10) + (uint16_t(in[i++]) - 0xDC00));
+                    else
+                        o = Invalid(o);
+                }
+                else if (detail::IsLowSurrogate(c))
+                    o = Invalid(o);
+                else
+                    o = detail::Put(o, c);
+            }
+            return o - out;
+        }
+
+        // Flushes a dangling high surrogate, returns the number of bytes written
+        size_t Finish(uint8_t* const out)
+        {
+            if (m_high == 0)
+                return 0;
+            m_high = 0;
+            return Invalid(out) - out;
+        }
+
+    private:
+        uint8_t* Invalid(uint8_t* o)
+        {
+            ++m_invalid;
+            return detail::Put(o, Replacement);
+        }
+
+        uint32_t m_high;
+        size_t m_invalid;
+    };
+
+    // Streaming UTF-8 to UTF-16, an incomplete sequence at the end of one call is completed by the next
+    // out must hold Utf16Size(length) + 4 code units
+    template <class C16>
+    class Utf8ToUtf16
+    {
+    public:
+        static_assert(sizeof(C16) == 2, "UTF-16 code unit");
+
+        Utf8ToUtf16()
+            : m_pending(0), m_invalid(0)
+        {
+        }
+
+        size_t Invalid() const { return m_invalid; }
+
+        // Returns the number of code units written
+        size_t Convert(const uint8_t* in, size_t length, C16* const out)
+        {
+            C16* o = out;
+
+            // Complete a sequence split by the previous call, it is never longer than m_partial
+            while (m_pending > 0 && m_pending < sizeof(m_partial) && length > 0)
+            {
+                m_partial[m_pending++] = *in++;
+                --length;
+                const size_t need = SequenceLength(m_partial[0]);
+                if ((m_partial[m_pending - 1] & 0xC0) != 0x80 || m_pending == need)
+                {
+                    size_t used = 0;
+                    o = Decode(m_partial, m_pending, &used, o);
+                    // Bytes that weren't part of a valid sequence are decoded again from the input
+                    const size_t unused = m_pending - used;
+                    in -= unused;
+                    length += unused;
+                    m_pending = 0;
+                }
+            }
+
+            size_t i = 0;
+            while (i < length)
+            {
+#ifdef RAD_UTF_SSE2
+                while ((i + 16) <= length)
+                {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                    if (_mm_movemask_epi8(v) != 0)
+                        break;
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+                    o += 16;
+                    i += 16;
+                }
+                if (i >= length)
+                    break;
+#endif
+                if (in[i] < 0x80)
+                {
+                    *o++ = C16(in[i++]);
+                    continue;
+                }
+
+                const size_t need = SequenceLength(in[i]);
+                if (need > (length - i) && in[i] <= 0xF4 && Continues(in + i + 1, length - i - 1))
+                {
+                    // Save the incomplete sequence for the next call
+                    while (i < length)
+                        m_partial[m_pending++] = in[i++];
+                    break;
+                }
+
+                size_t used = 0;
+                o = Decode(in + i, length - i, &used, o);
+                i += used;
+            }
+            return o - out;
+        }
+
+        // Flushes an incomplete sequence, returns the number of code units written
+        size_t Finish(C16* const out)
+        {
+            if (m_pending == 0)
+                return 0;
+            m_pending = 0;
+            ++m_invalid;
+            out[0] = C16(Replacement);
+            return 1;
+        }
+
+    private:
+        static size_t SequenceLength(const uint8_t lead)
+        {
+            if (lead >= 0xF0)
+                return 4;
+            else if (lead >= 0xE0)
+                return 3;
+            else if (lead >= 0xC0)
+                return 2;
+            else
+                return 1;
+        }
+
+        static bool Continues(const uint8_t* p, const size_t length)
+        {
+            for (size_t i = 0; i < length; ++i)
+                if ((p[i] & 0xC0) != 0x80)
+                    return false;
+            return true;
+        }
+
+        // Decodes one sequence from a non ASCII lead byte, *pUsed is the number of bytes consumed
+        C16* Decode(const uint8_t* p, const size_t length, size_t* pUsed, C16* o)
+        {
+            static const uint32_t Minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+            const uint8_t lead = p[0];
+            const size_t need = SequenceLength(lead);
+            *pUsed = 1;
+            if (need == 1 || lead > 0xF4)
+                return Invalid(o);
+
+            uint32_t c = lead & (0x7F >> need);
+            for (size_t i = 1; i < need; ++i)
+            {
+                if (i >= length || (p[i] & 0xC0) != 0x80)
+                {
+                    *pUsed = i;
+                    return Invalid(o);
+                }
+                c = (c << 6) | (p[i] & 0x3F);
+            }
+            *pUsed = need;
+
+            if (c < Minimum[need] || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000))
+                return Invalid(o);
+
+            if (c >= 0x10000)
+            {
+                c -= 0x10000;
+                *o++ = C16(0xD800 + (c >> 10));
+                *o++ = C16(0xDC00 + (c & 0x3FF));
+            }
+            else
+                *o++ = C16(c);
+            return o;
+        }
+
+        C16* Invalid(C16* o)
+        {
+            ++m_invalid;
+            *o++ = C16(Replacement);
+            return o;
+        }
+
+        uint8_t m_partial[4];
+        size_t m_pending;
+        size_t m_invalid;
+    };
+}